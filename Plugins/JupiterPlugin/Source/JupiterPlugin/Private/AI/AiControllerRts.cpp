@@ -85,12 +85,19 @@ void AAiControllerRts::CommandMove(const FCommandData Cmd, bool bAttack)
         bPatrolling = false;
         bMoveComplete = false;
         bAttackTarget = bShouldAttack;
+        GroupMoveId = INDEX_NONE;
 
         if (bAttackTarget && CurrentCommand.Target)
         {
                 CurrentCommand.Location = CurrentCommand.Target->GetActorLocation();
                 MoveToActor(CurrentCommand.Target, GetAcceptanceRadius());
         }
+        else if (PendingGroupMoveId != INDEX_NONE)
+        {
+                // Steered by the order component from the shared group path, no navmesh query until the slot approach.
+                GroupMoveId = PendingGroupMoveId;
+                StopMovement();
+        }
         else
         {
                 MoveToLocation(CurrentCommand.Location);
@@ -99,9 +106,31 @@ void AAiControllerRts::CommandMove(const FCommandData Cmd, bool bAttack)
         OnNewDestination.Broadcast(CurrentCommand);
 }
 
+bool AAiControllerRts::FollowGroupDirection(const FVector& Direction, float SlotApproachRadius)
+{
+        APawn* ControlledPawn = GetPawn();
+        if (GroupMoveId == INDEX_NONE || !ControlledPawn)
+                return false;
+
+        const bool bNearSlot = FVector::DistSquared2D(ControlledPawn->GetActorLocation(), CurrentCommand.Location) <= FMath::Square(SlotApproachRadius);
+        if (bNearSlot || Direction.IsNearlyZero())
+        {
+                GroupMoveId = INDEX_NONE;
+                MoveToLocation(CurrentCommand.Location);
+                return false;
+        }
+
+        ControlledPawn->AddMovementInput(Direction);
+        return true;
+}
+
 void AAiControllerRts::OnMoveCompleted(FAIRequestID RequestID, const FPathFollowingResult& Result)
 {
     Super::OnMoveCompleted(RequestID, Result);
+
+    // The path aborted when joining a group move is not the end of the order.
+    if (GroupMoveId != INDEX_NONE)
+        return;
     
     bMoveComplete = true;
     OnReachedDestination.Broadcast(CurrentCommand);
@@ -303,6 +332,7 @@ void AAiControllerRts::CommandPatrol(const FCommandData Cmd)
 {
 	StopAttack();
 	CurrentCommand = Cmd;
+	GroupMoveId = INDEX_NONE;
 	bPatrolling = true;
 	bMoveComplete = false;
 
@@ -1,7 +1,41 @@
 ﻿#include "Components/Unit/SoldierManagerComponent.h"
+#include "AI/AiControllerRts.h"
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "HAL/PlatformTime.h"
 #include "Kismet/GameplayStatics.h"
 #include "Units/SoldierRts.h"
 
+namespace
+{
+    /** Soldiers scanned per worker thread between two budget checks. */
+    constexpr int32 DetectionSoldiersPerWorker = 16;
+
+    /** Walks two neighbour lists sorted by id and collects the actors only present in one of them. */
+    template <typename NeighborType>
+    void DiffNeighbors(const TArray<NeighborType>& Previous, const TArray<NeighborType>& Current, TArray<TWeakObjectPtr<AActor>>& OutEntered, TArray<TWeakObjectPtr<AActor>>& OutLeft)
+    {
+        int32 PreviousIndex = 0;
+        int32 CurrentIndex = 0;
+        while (PreviousIndex < Previous.Num() || CurrentIndex < Current.Num())
+        {
+            if (CurrentIndex == Current.Num() || (PreviousIndex < Previous.Num() && Previous[PreviousIndex].Id < Current[CurrentIndex].Id))
+            {
+                OutLeft.Add(Previous[PreviousIndex++].Actor);
+            }
+            else if (PreviousIndex == Previous.Num() || Current[CurrentIndex].Id < Previous[PreviousIndex].Id)
+            {
+                OutEntered.Add(Current[CurrentIndex++].Actor);
+            }
+            else
+            {
+                ++PreviousIndex;
+                ++CurrentIndex;
+            }
+        }
+    }
+}
+
 USoldierManagerComponent::USoldierManagerComponent()
 {
     PrimaryComponentTick.bCanEverTick = true;
@@ -36,79 +70,397 @@ void USoldierManagerComponent::TickComponent(float DeltaTime, ELevelTick TickTyp
 
     if (GetOwner()->GetNetMode() == NM_Client || Soldiers.Num() == 0)
         return;
-	
-    const int32 SafeBuckets = FMath::Max(1, TargetBuckets);
-    const float TimePerBucket = FullLoopDuration / static_cast<float>(SafeBuckets);
 
-    TimeSinceLastBucket += DeltaTime;
+    ProcessDetection();
+}
 
-    if (TimeSinceLastBucket >= TimePerBucket)
+void USoldierManagerComponent::ProcessDetection()
+{
+    const double EndTime = FPlatformTime::Seconds() + FMath::Max(DetectionBudgetMs, 0.01f) * 0.001;
+    const double Now = GetWorld()->GetTimeSeconds();
+
+    // Order preserving, so both detection queries see the soldiers in the same order.
+    int32 NumValidSoldiers = 0;
+    for (int32 Index = 0; Index < Soldiers.Num(); ++Index)
     {
-        ProcessDetectionBucket(CurrentBucketIndex);
-        
-        CurrentBucketIndex = (CurrentBucketIndex + 1) % SafeBuckets;
-        TimeSinceLastBucket -= TimePerBucket;
+        if (IsValid(Soldiers[Index]))
+        {
+            Soldiers[NumValidSoldiers] = Soldiers[Index];
+            SoldierSlots[NumValidSoldiers] = SoldierSlots[Index];
+            ++NumValidSoldiers;
+        }
+        else
+        {
+            ReleaseDetectionSlot(SoldierSlots[Index]);
+        }
     }
-}
+    Soldiers.SetNum(NumValidSoldiers, EAllowShrinking::No);
+    SoldierSlots.SetNum(NumValidSoldiers, EAllowShrinking::No);
 
-void USoldierManagerComponent::ProcessDetectionBucket(int32 BucketIndex)
-{
     if (Soldiers.Num() == 0)
     	return;
 
-    const int32 TotalSoldiers = Soldiers.Num();
-    const int32 SafeBuckets = FMath::Max(1, TargetBuckets);
-    const int32 BucketSize = FMath::CeilToInt(static_cast<float>(TotalSoldiers) / static_cast<float>(SafeBuckets));
-    
-    const int32 StartIndex = BucketIndex * BucketSize;
-    const int32 EndIndex = FMath::Min(StartIndex + BucketSize, TotalSoldiers);
+    // Soldiers registered since the last refresh get their first scan once the next one picks them up.
+    if (Now >= NextDetectionSnapshotTime)
+    {
+        NextDetectionSnapshotTime = Now + DetectionSnapshotInterval;
+        RefreshDetectionSnapshot();
+
+        if (bAdaptiveDetection)
+        {
+            RebuildTeamPresenceGrid();
+        }
+
+        if (DetectionQuery == ESoldierDetectionQuery::SpatialHash)
+        {
+            RebuildDetectionGrid();
+        }
+    }
 
-    if (StartIndex >= TotalSoldiers)
+    // Most overdue first, so a budget too small for the load delays every soldier evenly. Soldiers unregistered since
+    // the refresh no longer own their slot and are left out.
+    DueSoldiers.Reset();
+    for (int32 Index = 0; Index < DetectionSlotIndices.Num(); ++Index)
+    {
+        const FDetectionSlot& Slot = DetectionSlots[DetectionSlotIndices[Index]];
+        if (Slot.Generation == static_cast<uint32>(DetectionNeighborIds[Index] >> 32) && Slot.NextScanTime <= Now)
+        {
+            DueSoldiers.Add(Index);
+        }
+    }
+
+    if (DueSoldiers.Num() == 0)
     	return;
 
-    TArray<AActor*> FoundEnemies;
-    TArray<AActor*> FoundAllies;
-    FoundEnemies.Reserve(20);
-    FoundAllies.Reserve(20);
+    DueSoldiers.Sort([this](int32 A, int32 B)
+    {
+        const double TimeA = DetectionSlots[DetectionSlotIndices[A]].NextScanTime;
+        const double TimeB = DetectionSlots[DetectionSlotIndices[B]].NextScanTime;
+        return TimeA != TimeB ? TimeA < TimeB : A < B;
+    });
+
+    const int32 NumWorkers = bParallelDetection ? FTaskGraphInterface::Get().GetNumWorkerThreads() + 1 : 1;
+    const int32 BatchSize = NumWorkers * DetectionSoldiersPerWorker;
+    if (DetectionResults.Num() < BatchSize)
+    {
+        DetectionResults.SetNum(BatchSize);
+    }
 
-    for (int32 i = StartIndex; i < EndIndex; ++i)
+    int32 NextDue = 0;
+    do
     {
-        ASoldierRts* Subject = Soldiers[i];
+        const int32 FirstDue = NextDue;
+        const int32 NumBatchSoldiers = FMath::Min(BatchSize, DueSoldiers.Num() - FirstDue);
+        NextDue += NumBatchSoldiers;
 
-        if (!IsValid(Subject))
+        // Phase 1: detection over the snapshot, each soldier only writing its result and its own slot.
+        ParallelForWithTaskContext(DetectionCandidateContexts, NumBatchSoldiers, [this, FirstDue, Now](TArray<int32>& Candidates, int32 Offset)
         {
-            Soldiers.RemoveAtSwap(i);
-            --i;
-        	
-            continue;
-        }
+            UpdateSoldierNeighbors(Offset, DueSoldiers[FirstDue + Offset], Candidates, Now);
+        }, bParallelDetection ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread);
 
-        const FVector SubjectLoc = Subject->GetActorLocation();
-        const float EnemyRangeSq = FMath::Square(Subject->GetAttackRange());
-        const float AllyRangeSq = FMath::Square(Subject->GetAllyDetectionRange());
-        
-        FoundEnemies.Reset();
-        FoundAllies.Reset();
-    	
-        for (ASoldierRts* Other : Soldiers)
+        // Phase 2: the events mutate gameplay state, delivered on the game thread in scan order.
+        for (int32 Offset = 0; Offset < NumBatchSoldiers; ++Offset)
         {
-            if (Other == Subject || !IsValid(Other))
-            	continue;
+            ASoldierRts* Subject = DetectionSoldiers[DueSoldiers[FirstDue + Offset]].Get();
+            if (!IsValid(Subject))
+                continue;
 
-            const float DistSq = FVector::DistSquared(SubjectLoc, Other->GetActorLocation());
+            // Leave events first: an actor registered again under a new slot leaves with its old id and enters with
+            // the new one, and must end up in range. Neighbours destroyed since the subject's previous scan can no
+            // longer be named, the subject drops them from its ranges in a single OnNeighborDestroyed instead.
+            const FDetectionResult& Result = DetectionResults[Offset];
+            bool bNeighborDestroyed = false;
+            for (const TWeakObjectPtr<AActor>& Enemy : Result.LeftEnemies)
+            {
+                if (AActor* EnemyActor = Enemy.Get())
+                {
+                    Subject->OnEnemyLeft(EnemyActor);
+                }
+                else
+                {
+                    bNeighborDestroyed = true;
+                }
+            }
+            for (const TWeakObjectPtr<AActor>& Ally : Result.LeftAllies)
+            {
+                if (AActor* AllyActor = Ally.Get())
+                {
+                    Subject->OnAllyLeft(AllyActor);
+                }
+                else
+                {
+                    bNeighborDestroyed = true;
+                }
+            }
 
-            if (DistSq <= EnemyRangeSq && Subject->IsEnemyActor(Other))
+            if (bNeighborDestroyed)
             {
-                FoundEnemies.Add(Other);
+                Subject->OnNeighborDestroyed();
             }
-            else if (DistSq <= AllyRangeSq && Subject->IsFriendlyActor(Other))
+
+            for (const TWeakObjectPtr<AActor>& Enemy : Result.EnteredEnemies)
             {
-                FoundAllies.Add(Other);
+                if (AActor* EnemyActor = Enemy.Get())
+                {
+                    Subject->OnEnemyEntered(EnemyActor);
+                }
             }
+            for (const TWeakObjectPtr<AActor>& Ally : Result.EnteredAllies)
+            {
+                if (AActor* AllyActor = Ally.Get())
+                {
+                    Subject->OnAllyEntered(AllyActor);
+                }
+            }
+
+            Subject->OnDetectionUpdated();
         }
+    }
+    while (NextDue < DueSoldiers.Num() && FPlatformTime::Seconds() < EndTime);
+}
 
-        Subject->ProcessDetectionResults(FoundEnemies, FoundAllies);
+void USoldierManagerComponent::RefreshDetectionSnapshot()
+{
+    DetectionSoldiers.Reset(Soldiers.Num());
+    for (ASoldierRts* Soldier : Soldiers)
+    {
+        DetectionSoldiers.Add(Soldier);
     }
+    DetectionSlotIndices = SoldierSlots;
+
+    const int32 NumSoldiers = Soldiers.Num();
+    DetectionLocations.SetNumUninitialized(NumSoldiers);
+    DetectionEnemyRangesSq.SetNumUninitialized(NumSoldiers);
+    DetectionAllyRangesSq.SetNumUninitialized(NumSoldiers);
+    DetectionQueryRanges.SetNumUninitialized(NumSoldiers);
+    DetectionTeams.SetNumUninitialized(NumSoldiers);
+    DetectionEnemyMasks.SetNumUninitialized(NumSoldiers);
+    DetectionAllyMasks.SetNumUninitialized(NumSoldiers);
+    DetectionSelectable.Init(false, NumSoldiers);
+    DetectionNeighborIds.SetNumUninitialized(NumSoldiers);
+    DetectionInCombat.Init(false, NumSoldiers);
+
+    for (int32 Index = 0; Index < NumSoldiers; ++Index)
+    {
+        ASoldierRts* Soldier = Soldiers[Index];
+        const float AttackRange = Soldier->GetAttackRange();
+        const float AllyRange = Soldier->GetAllyDetectionRange();
+
+        const int32 Slot = DetectionSlotIndices[Index];
+        DetectionNeighborIds[Index] = (static_cast<uint64>(DetectionSlots[Slot].Generation) << 32) | static_cast<uint32>(Slot);
+
+        DetectionLocations[Index] = Soldier->GetActorLocation();
+        DetectionEnemyRangesSq[Index] = FMath::Square(AttackRange);
+        DetectionAllyRangesSq[Index] = FMath::Square(AllyRange);
+        DetectionQueryRanges[Index] = FMath::Max3(AttackRange, AllyRange, 0.f);
+
+        // IsEnemyActor and IsFriendlyActor compare against the soldier's own team: every other team is hostile.
+        const uint8 OwnTeam = static_cast<uint8>(Soldier->GetTeam());
+        checkSlow(OwnTeam < 32);
+        DetectionAllyMasks[Index] = 1u << OwnTeam;
+        DetectionEnemyMasks[Index] = ~DetectionAllyMasks[Index];
+
+        // Mirrors ASoldierRts::IsValidSelectableActor, the interface call is what the detection must not do off the game thread.
+        const bool bSelectable = Soldier->Implements<USelectable>();
+        DetectionSelectable[Index] = bSelectable;
+        DetectionTeams[Index] = bSelectable ? static_cast<uint8>(ISelectable::Execute_GetCurrentTeam(Soldier)) : OwnTeam;
+
+        const AAiControllerRts* Controller = Soldier->GetAiController();
+        DetectionInCombat[Index] = Controller && Controller->HasAttackTarget();
+    }
+}
+
+void USoldierManagerComponent::UpdateSoldierNeighbors(int32 BatchOffset, int32 SubjectIndex, TArray<int32>& Candidates, double Now)
+{
+    FDetectionResult& Result = DetectionResults[BatchOffset];
+    Result.Enemies.Reset();
+    Result.Allies.Reset();
+    Result.EnteredEnemies.Reset();
+    Result.LeftEnemies.Reset();
+    Result.EnteredAllies.Reset();
+    Result.LeftAllies.Reset();
+
+    // Released by the events of an earlier batch of this tick, the slot may already belong to another soldier.
+    FDetectionSlot& Slot = DetectionSlots[DetectionSlotIndices[SubjectIndex]];
+    if (Slot.Generation != static_cast<uint32>(DetectionNeighborIds[SubjectIndex] >> 32))
+        return;
+
+    const FVector SubjectLoc = DetectionLocations[SubjectIndex];
+    const float EnemyRangeSq = DetectionEnemyRangesSq[SubjectIndex];
+    const float AllyRangeSq = DetectionAllyRangesSq[SubjectIndex];
+    const uint32 EnemyMask = DetectionEnemyMasks[SubjectIndex];
+    const uint32 AllyMask = DetectionAllyMasks[SubjectIndex];
+
+    auto TestOther = [&](int32 OtherIndex)
+    {
+        if (OtherIndex == SubjectIndex || !DetectionSelectable[OtherIndex])
+            return;
+
+        const float DistSq = FVector::DistSquared(SubjectLoc, DetectionLocations[OtherIndex]);
+        const uint32 OtherTeamBit = 1u << DetectionTeams[OtherIndex];
+
+        if (DistSq <= EnemyRangeSq && (EnemyMask & OtherTeamBit) != 0)
+        {
+            Result.Enemies.Add({ DetectionNeighborIds[OtherIndex], DetectionSoldiers[OtherIndex] });
+        }
+        else if (DistSq <= AllyRangeSq && (AllyMask & OtherTeamBit) != 0)
+        {
+            Result.Allies.Add({ DetectionNeighborIds[OtherIndex], DetectionSoldiers[OtherIndex] });
+        }
+    };
+
+    if (DetectionQuery == ESoldierDetectionQuery::SpatialHash)
+    {
+        GatherDetectionCandidates(SubjectLoc, DetectionQueryRanges[SubjectIndex], Candidates);
+        for (const int32 CandidateIndex : Candidates)
+        {
+            TestOther(CandidateIndex);
+        }
+    }
+    else
+    {
+        for (int32 OtherIndex = 0; OtherIndex < DetectionLocations.Num(); ++OtherIndex)
+        {
+            TestOther(OtherIndex);
+        }
+    }
+
+    auto ById = [](const FDetectionNeighbor& A, const FDetectionNeighbor& B) { return A.Id < B.Id; };
+    Result.Enemies.Sort(ById);
+    Result.Allies.Sort(ById);
+
+    // Static battles produce no events at all; the current lists become the slot's and the old ones are recycled.
+    DiffNeighbors(Slot.Enemies, Result.Enemies, Result.EnteredEnemies, Result.LeftEnemies);
+    DiffNeighbors(Slot.Allies, Result.Allies, Result.EnteredAllies, Result.LeftAllies);
+    Swap(Slot.Enemies, Result.Enemies);
+    Swap(Slot.Allies, Result.Allies);
+
+    const bool bSignificant = !bAdaptiveDetection || DetectionInCombat[SubjectIndex] || Slot.Enemies.Num() > 0 || IsNearHostileTeam(SubjectIndex);
+    Slot.NextScanTime = Now + (bSignificant ? ActiveScanInterval : IdleScanInterval);
+}
+
+void USoldierManagerComponent::RebuildTeamPresenceGrid()
+{
+    TeamPresenceCells.Reset();
+
+    for (int32 Index = 0; Index < DetectionLocations.Num(); ++Index)
+    {
+        // Soldiers no detection can see do not make their team present either.
+        if (!DetectionSelectable[Index])
+            continue;
+
+        const FVector& Location = DetectionLocations[Index];
+        const FIntPoint Cell(FMath::FloorToInt32(Location.X / TeamPresenceCellSize), FMath::FloorToInt32(Location.Y / TeamPresenceCellSize));
+        TeamPresenceCells.FindOrAdd(Cell) |= 1u << DetectionTeams[Index];
+    }
+}
+
+bool USoldierManagerComponent::IsNearHostileTeam(int32 SoldierIndex) const
+{
+    const FVector& Location = DetectionLocations[SoldierIndex];
+    const FIntPoint Center(FMath::FloorToInt32(Location.X / TeamPresenceCellSize), FMath::FloorToInt32(Location.Y / TeamPresenceCellSize));
+
+    for (int32 OffsetY = -1; OffsetY <= 1; ++OffsetY)
+    {
+        for (int32 OffsetX = -1; OffsetX <= 1; ++OffsetX)
+        {
+            const uint32* Teams = TeamPresenceCells.Find(Center + FIntPoint(OffsetX, OffsetY));
+            if (Teams && (*Teams & DetectionEnemyMasks[SoldierIndex]) != 0)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+void USoldierManagerComponent::RebuildDetectionGrid()
+{
+    const int32 NumSoldiers = DetectionLocations.Num();
+
+    // Cells as large as the largest range, so any query covers at most 2x2 cells.
+    float MaxRange = 0.f;
+    for (const float QueryRange : DetectionQueryRanges)
+    {
+        MaxRange = FMath::Max(MaxRange, QueryRange);
+    }
+    DetectionCellSize = FMath::Max(MaxRange, MinDetectionCellSize);
+
+    DetectionSoldierCells.SetNumUninitialized(NumSoldiers);
+    DetectionCellEntries.SetNumUninitialized(NumSoldiers);
+    for (int32 Index = 0; Index < NumSoldiers; ++Index)
+    {
+        DetectionSoldierCells[Index] = GetDetectionCell(DetectionLocations[Index]);
+        DetectionCellEntries[Index] = Index;
+    }
+
+    DetectionCellEntries.Sort([this](int32 A, int32 B)
+    {
+        const FIntPoint& CellA = DetectionSoldierCells[A];
+        const FIntPoint& CellB = DetectionSoldierCells[B];
+        if (CellA.Y != CellB.Y)
+            return CellA.Y < CellB.Y;
+        if (CellA.X != CellB.X)
+            return CellA.X < CellB.X;
+        return A < B;
+    });
+
+    DetectionCells.Reset();
+    for (int32 Entry = 0; Entry < NumSoldiers; ++Entry)
+    {
+        FDetectionCell& Cell = DetectionCells.FindOrAdd(DetectionSoldierCells[DetectionCellEntries[Entry]]);
+        if (Cell.Num == 0)
+        {
+            Cell.First = Entry;
+        }
+        ++Cell.Num;
+    }
+}
+
+void USoldierManagerComponent::GatherDetectionCandidates(const FVector& Location, float Range, TArray<int32>& OutSoldierIndices) const
+{
+    OutSoldierIndices.Reset();
+
+    // Cells are hashed in XY only, the distance test still uses the full 3D distance.
+    const FIntPoint MinCell = GetDetectionCell(Location - FVector(Range, Range, 0.f));
+    const FIntPoint MaxCell = GetDetectionCell(Location + FVector(Range, Range, 0.f));
+
+    for (int32 CellY = MinCell.Y; CellY <= MaxCell.Y; ++CellY)
+    {
+        for (int32 CellX = MinCell.X; CellX <= MaxCell.X; ++CellX)
+        {
+            if (const FDetectionCell* Cell = DetectionCells.Find(FIntPoint(CellX, CellY)))
+            {
+                OutSoldierIndices.Append(&DetectionCellEntries[Cell->First], Cell->Num);
+            }
+        }
+    }
+}
+
+FIntPoint USoldierManagerComponent::GetDetectionCell(const FVector& Location) const
+{
+    return FIntPoint(FMath::FloorToInt32(Location.X / DetectionCellSize), FMath::FloorToInt32(Location.Y / DetectionCellSize));
+}
+
+int32 USoldierManagerComponent::AcquireDetectionSlot()
+{
+    if (FreeDetectionSlots.Num() > 0)
+    {
+        return FreeDetectionSlots.Pop(EAllowShrinking::No);
+    }
+
+    return DetectionSlots.AddDefaulted();
+}
+
+void USoldierManagerComponent::ReleaseDetectionSlot(int32 Slot)
+{
+    FDetectionSlot& DetectionSlot = DetectionSlots[Slot];
+    DetectionSlot.Enemies.Reset();
+    DetectionSlot.Allies.Reset();
+    ++DetectionSlot.Generation;
+    DetectionSlot.NextScanTime = 0.0;
+
+    FreeDetectionSlots.Add(Slot);
 }
 
 // --------------------------------------------------------
@@ -122,6 +474,7 @@ void USoldierManagerComponent::RegisterSoldier(ASoldierRts* Soldier)
         if (IsValid(Soldier) && !Soldiers.Contains(Soldier))
         {
             Soldiers.Add(Soldier);
+            SoldierSlots.Add(AcquireDetectionSlot());
         }
     }
     else
@@ -132,9 +485,12 @@ void USoldierManagerComponent::RegisterSoldier(ASoldierRts* Soldier)
 
 void USoldierManagerComponent::UnregisterSoldier(ASoldierRts* Soldier)
 {
-    if (IsValid(Soldier))
+    const int32 Index = IsValid(Soldier) ? Soldiers.Find(Soldier) : INDEX_NONE;
+    if (Index != INDEX_NONE)
     {
-        Soldiers.RemoveSwap(Soldier);
+        ReleaseDetectionSlot(SoldierSlots[Index]);
+        Soldiers.RemoveAtSwap(Index);
+        SoldierSlots.RemoveAtSwap(Index);
     }
 }
 
@@ -3,11 +3,15 @@
 #include "Components/Unit/UnitSelectionComponent.h"
 #include "Components/Patrol/UnitPatrolComponent.h"
 #include "Interfaces/Selectable.h"
+#include "AI/AiControllerRts.h"
+#include "GameFramework/Pawn.h"
+#include "EngineUtils.h"
 
 
 UUnitOrderComponent::UUnitOrderComponent()
 {
-    PrimaryComponentTick.bCanEverTick = false;
+    PrimaryComponentTick.bCanEverTick = true;
+    PrimaryComponentTick.bStartWithTickEnabled = false;
     SetIsReplicatedByDefault(false);
 }
 
@@ -27,6 +31,21 @@ void UUnitOrderComponent::BeginPlay()
     }
 }
 
+void UUnitOrderComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    ReleaseGroupMoves();
+    Super::EndPlay(EndPlayReason);
+}
+
+void UUnitOrderComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+    Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+    UpdateGroupMoves();
+    if (GroupMoves.IsEmpty())
+        SetComponentTickEnabled(false);
+}
+
 // -------------------------------------------------------------------------
 // PUBLIC API
 // -------------------------------------------------------------------------
@@ -146,6 +165,9 @@ void UUnitOrderComponent::DispatchOrder(const FCommandData& OriginalCommandData,
     TArray<FCommandData> Commands;
     ApplyFormationToCommands(FinalCommandData, Units, Commands);
 
+    const int32 GroupIndex = StartGroupMove(FinalCommandData, Units, Commands);
+    const int32 GroupMoveId = GroupIndex != INDEX_NONE ? GroupMoves[GroupIndex].Id : INDEX_NONE;
+
     for (int32 Index = 0; Index < Units.Num(); ++Index)
     {
         AActor* Unit = Units[Index];
@@ -158,7 +180,34 @@ void UUnitOrderComponent::DispatchOrder(const FCommandData& OriginalCommandData,
         if (ShouldIgnoreTarget(Unit, UnitCommand))
         	continue;
 
+        const APawn* Pawn = Cast<APawn>(Unit);
+        AAiControllerRts* Controller = GroupMoveId != INDEX_NONE && Pawn ? Cast<AAiControllerRts>(Pawn->GetController()) : nullptr;
+        if (Controller)
+            Controller->SetPendingGroupMove(GroupMoveId);
+
         ISelectable::Execute_CommandMove(Unit, UnitCommand);
+
+        if (Controller)
+        {
+            Controller->SetPendingGroupMove(INDEX_NONE);
+            if (Controller->GetGroupMoveId() == GroupMoveId)
+                GroupMoves[GroupIndex].Followers.Add(Controller);
+        }
+    }
+
+    if (GroupIndex != INDEX_NONE)
+    {
+        if (GroupMoves[GroupIndex].Followers.IsEmpty())
+        {
+            if (IGroupMovementProvider* Provider = GroupMovementProvider.Get())
+                Provider->ReleaseGroupPath(GroupMoves[GroupIndex].PathId);
+
+            GroupMoves.RemoveAtSwap(GroupIndex);
+        }
+        else
+        {
+            SetComponentTickEnabled(true);
+        }
     }
 
     OnOrdersDispatched.Broadcast(Units, FinalCommandData);
@@ -236,4 +285,119 @@ bool UUnitOrderComponent::ShouldIgnoreTarget(AActor* Unit, const FCommandData& C
     }
 
     return false;
-}
\ No newline at end of file
+}
+
+// -------------------------------------------------------------------------
+// GROUP MOVEMENT
+// -------------------------------------------------------------------------
+
+int32 UUnitOrderComponent::StartGroupMove(const FCommandData& BaseCommand, const TArray<AActor*>& Units, const TArray<FCommandData>& Commands)
+{
+    const bool bIsMoveOrder = BaseCommand.Type == CommandMove || BaseCommand.Type == CommandMoveFast || BaseCommand.Type == CommandMoveSlow;
+    if (!bUseGroupMovementForLargeOrders || !bIsMoveOrder || BaseCommand.Target || Units.Num() < MinUnitsForGroupMovement)
+        return INDEX_NONE;
+
+    IGroupMovementProvider* Provider = FindGroupMovementProvider();
+    if (!Provider)
+        return INDEX_NONE;
+
+    // The shared path leads to the footprint of the formation, each unit then walks to its own slot.
+    FBox GoalBounds(ForceInit);
+    float AgentRadius = 0.f;
+    for (int32 Index = 0; Index < Units.Num(); ++Index)
+    {
+        GoalBounds += Commands.IsValidIndex(Index) ? Commands[Index].Location : BaseCommand.Location;
+        if (IsValid(Units[Index]))
+            AgentRadius = FMath::Max(AgentRadius, Units[Index]->GetSimpleCollisionRadius());
+    }
+
+    const int32 PathId = Provider->AcquireGroupPath(GoalBounds, AgentRadius);
+    if (PathId == INDEX_NONE)
+        return INDEX_NONE;
+
+    FUnitGroupMove& GroupMove = GroupMoves.AddDefaulted_GetRef();
+    GroupMove.Id = NextGroupMoveId++;
+    GroupMove.PathId = PathId;
+    GroupMove.Followers.Reserve(Units.Num());
+    return GroupMoves.Num() - 1;
+}
+
+IGroupMovementProvider* UUnitOrderComponent::FindGroupMovementProvider()
+{
+    if (IGroupMovementProvider* Provider = GroupMovementProvider.Get())
+        return Provider;
+
+    UWorld* World = GetWorld();
+    if (!World)
+        return nullptr;
+
+    // Iterating every actor is too costly for each large order of a level without provider, so a failed search holds
+    // until a level is streamed in or out.
+    if (FailedProviderSearchWorld.Get() == World && FailedProviderSearchNumLevels == World->GetLevels().Num())
+        return nullptr;
+
+    for (TActorIterator<AActor> It(World); It; ++It)
+    {
+        if (It->Implements<UGroupMovementProvider>())
+        {
+            FailedProviderSearchWorld.Reset();
+            GroupMovementProvider = TWeakInterfacePtr<IGroupMovementProvider>(*It);
+            return GroupMovementProvider.Get();
+        }
+    }
+
+    FailedProviderSearchWorld = World;
+    FailedProviderSearchNumLevels = World->GetLevels().Num();
+    return nullptr;
+}
+
+void UUnitOrderComponent::UpdateGroupMoves()
+{
+    IGroupMovementProvider* Provider = GroupMovementProvider.Get();
+
+    for (int32 GroupIndex = GroupMoves.Num() - 1; GroupIndex >= 0; --GroupIndex)
+    {
+        FUnitGroupMove& GroupMove = GroupMoves[GroupIndex];
+
+        // Units given another order since, or destroyed, have left the group.
+        GroupMove.Followers.RemoveAllSwap([&GroupMove](const TWeakObjectPtr<AAiControllerRts>& Follower)
+        {
+            return !Follower.IsValid() || !Follower->GetPawn() || Follower->GetGroupMoveId() != GroupMove.Id;
+        });
+
+        GroupPositions.Reset(GroupMove.Followers.Num());
+        for (const TWeakObjectPtr<AAiControllerRts>& Follower : GroupMove.Followers)
+            GroupPositions.Add(Follower->GetPawn()->GetActorLocation());
+
+        // Without a provider the directions stay zero and every unit falls back to its own path.
+        GroupDirections.Reset();
+        GroupDirections.SetNumZeroed(GroupPositions.Num());
+        if (Provider && GroupPositions.Num() > 0)
+            Provider->SampleGroupPath(GroupMove.PathId, GroupPositions, GroupDirections);
+
+        for (int32 Index = GroupMove.Followers.Num() - 1; Index >= 0; --Index)
+        {
+            if (!GroupMove.Followers[Index]->FollowGroupDirection(GroupDirections[Index], SlotApproachRadius))
+                GroupMove.Followers.RemoveAtSwap(Index);
+        }
+
+        if (GroupMove.Followers.IsEmpty())
+        {
+            if (Provider)
+                Provider->ReleaseGroupPath(GroupMove.PathId);
+
+            GroupMoves.RemoveAtSwap(GroupIndex);
+        }
+    }
+}
+
+void UUnitOrderComponent::ReleaseGroupMoves()
+{
+    if (IGroupMovementProvider* Provider = GroupMovementProvider.Get())
+    {
+        for (const FUnitGroupMove& GroupMove : GroupMoves)
+            Provider->ReleaseGroupPath(GroupMove.PathId);
+    }
+
+    GroupMoves.Reset();
+}
@@ -336,44 +336,53 @@ bool ASoldierRts::IsEnemyActor(AActor* Actor) const
     return IsValidSelectableActor(Actor) && ISelectable::Execute_GetCurrentTeam(Actor) != CurrentTeam;
 }
 
-void ASoldierRts::ProcessDetectionResults(TArray<AActor*> NewEnemies, TArray<AActor*> NewAllies)
+void ASoldierRts::OnEnemyEntered(AActor* Enemy)
 {
-    if (DetectionSettings.bDebugDrawDetection)
-    {
-        DrawAttackDebug(NewEnemies, NewAllies);
-    }
+    ActorsInRange.AddUnique(Enemy);
+    HandleAutoEngage(Enemy);
+}
 
-    TSet<AActor*> PreviousEnemies;
-    PreviousEnemies.Reserve(ActorsInRange.Num());
-    
-    for (AActor* PrevEnemy : ActorsInRange)
-    {
-        if (PrevEnemy)
-            PreviousEnemies.Add(PrevEnemy);
-    }
+void ASoldierRts::OnEnemyLeft(AActor* Enemy)
+{
+    ActorsInRange.Remove(Enemy);
+    HandleTargetRemoval(Enemy);
+}
 
-    TSet<AActor*> CurrentEnemies;
-    CurrentEnemies.Reserve(NewEnemies.Num());
-    
-    for (AActor* Enemy : NewEnemies)
-    {
-        if (!Enemy)
-            continue;
+void ASoldierRts::OnAllyEntered(AActor* Ally)
+{
+    AllyInRange.AddUnique(Ally);
+}
 
-        CurrentEnemies.Add(Enemy);
+void ASoldierRts::OnAllyLeft(AActor* Ally)
+{
+    AllyInRange.Remove(Ally);
+}
 
-        if (!PreviousEnemies.Contains(Enemy))
-            HandleAutoEngage(Enemy);
+void ASoldierRts::OnNeighborDestroyed()
+{
+    // Destroyed enemies are only compared against the attack target, never dereferenced.
+    TArray<AActor*, TInlineAllocator<8>> DestroyedEnemies;
+    for (AActor* Enemy : ActorsInRange)
+    {
+        if (!IsValid(Enemy))
+            DestroyedEnemies.Add(Enemy);
     }
 
-    for (AActor* PrevEnemy : ActorsInRange)
+    ActorsInRange.RemoveAll([](const AActor* Actor) { return !IsValid(Actor); });
+    AllyInRange.RemoveAll([](const AActor* Actor) { return !IsValid(Actor); });
+
+    for (AActor* Enemy : DestroyedEnemies)
     {
-        if (PrevEnemy && !CurrentEnemies.Contains(PrevEnemy))
-            HandleTargetRemoval(PrevEnemy);
+        HandleTargetRemoval(Enemy);
     }
+}
 
-    ActorsInRange = MoveTemp(NewEnemies);
-    AllyInRange = MoveTemp(NewAllies);
+void ASoldierRts::OnDetectionUpdated()
+{
+    if (DetectionSettings.bDebugDrawDetection)
+    {
+        DrawAttackDebug(ActorsInRange, AllyInRange);
+    }
 }
 
 void ASoldierRts::DrawAttackDebug(const TArray<AActor*>& DetectedEnemies, const TArray<AActor*>& DetectedAllies) const
@@ -30,6 +30,18 @@ public:
 	UFUNCTION(BlueprintCallable, Category="AI")
 	void CommandPatrol(const FCommandData Cmd);
 
+	/** Makes the next CommandMove steer with the group move instead of requesting its own navmesh path. */
+	void SetPendingGroupMove(int32 InGroupMoveId) { PendingGroupMoveId = InGroupMoveId; }
+
+	/** Group move the unit is steering with, INDEX_NONE when it follows its own path. */
+	int32 GetGroupMoveId() const { return GroupMoveId; }
+
+	/**
+	 * Steers along a direction sampled from the group path. Once the unit is within SlotApproachRadius of its slot, or the
+	 * path gives no direction, it leaves the group and reaches the slot with a navmesh path; returns false in that case.
+	 */
+	bool FollowGroupDirection(const FVector& Direction, float SlotApproachRadius);
+
     UFUNCTION(BlueprintCallable, Category="AI")
     void UpdateCurrentPatrol(const TArray<FVector>& NewPath, bool bLoop, int32 NewStartIndex = -1);
 
@@ -95,6 +107,9 @@ private:
         UPROPERTY() bool bMoveComplete = true;
         UPROPERTY() bool bPatrolling = false;
 
+        int32 GroupMoveId = INDEX_NONE;
+        int32 PendingGroupMoveId = INDEX_NONE;
+
         UPROPERTY() bool bAttackTarget = false;
         UPROPERTY() bool bCanAttack = true;
 	
@@ -5,6 +5,15 @@
 
 class ASoldierRts;
 
+/** How the scan of a soldier finds the soldiers around it. Both produce the same results. */
+UENUM(BlueprintType)
+enum class ESoldierDetectionQuery : uint8
+{
+	/** Tests every registered soldier. */
+	BruteForce,
+	/** Only tests the soldiers of the spatial hash cells overlapping the detection ranges. */
+	SpatialHash
+};
 
 UCLASS(ClassGroup=(JupiterPlugin), meta=(BlueprintSpawnableComponent))
 class JUPITERPLUGIN_API USoldierManagerComponent : public UActorComponent
@@ -26,7 +35,41 @@ public:
 	const TArray<ASoldierRts*>& GetAllSoldiers() const { return Soldiers; }
 
 protected:
-	void ProcessDetectionBucket(int32 BucketIndex);
+	/**
+	 * Scans the soldiers whose scan is due, most overdue first, in batches until DetectionBudgetMs is spent. At least one
+	 * batch runs every tick so the detection keeps progressing under any budget. The snapshot and the grids are only
+	 * rebuilt every DetectionSnapshotInterval seconds, the ticks in between reuse them.
+	 */
+	void ProcessDetection();
+
+	/** Copies the state the detection reads from every registered soldier into the snapshot arrays. Game thread only. */
+	void RefreshDetectionSnapshot();
+
+	/**
+	 * Finds the enemies and allies of a soldier from the snapshot, diffs them against the neighbours of its slot into
+	 * DetectionResults[BatchOffset] and schedules its next scan. Only touches that result and the soldier's slot, safe to
+	 * run on any thread.
+	 */
+	void UpdateSoldierNeighbors(int32 BatchOffset, int32 SubjectIndex, TArray<int32>& Candidates, double Now);
+
+	/** Marks the teams present in every TeamPresenceCellSize cell. */
+	void RebuildTeamPresenceGrid();
+
+	/** Whether a team hostile to the soldier is present in its presence cell or one of the eight around it. */
+	bool IsNearHostileTeam(int32 SoldierIndex) const;
+
+	/** Hashes DetectionSoldiers into cells as large as the largest attack or ally range. */
+	void RebuildDetectionGrid();
+
+	/** Indices in DetectionSoldiers of the soldiers hashed in the cells within Range of Location, grouped by cell. */
+	void GatherDetectionCandidates(const FVector& Location, float Range, TArray<int32>& OutSoldierIndices) const;
+
+	FIntPoint GetDetectionCell(const FVector& Location) const;
+
+	int32 AcquireDetectionSlot();
+
+	/** Forgets the neighbours of the slot and bumps its generation, so soldiers that saw the previous owner see it leave. */
+	void ReleaseDetectionSlot(int32 Slot);
     
 	UFUNCTION(Server, Reliable)
 	void Server_RegisterSoldier(ASoldierRts* Soldier);
@@ -36,13 +79,141 @@ private:
 	TArray<ASoldierRts*> Soldiers;
 
 	// Settings
+	/** Game thread time (in milliseconds) the detection may spend each tick; due scans left over run on the next ticks. */
+	UPROPERTY(EditAnywhere, Category="Settings|Manager", meta=(ClampMin="0.01"))
+	float DetectionBudgetMs = 1.f;
+
+	/**
+	 * Seconds between two refreshes of the soldier snapshot, the spatial hash and the team presence grid, whose cost
+	 * grows with the soldier count rather than with the due scans. 0 refreshes them every tick.
+	 */
+	UPROPERTY(EditAnywhere, Category="Settings|Manager", meta=(ClampMin="0.0"))
+	float DetectionSnapshotInterval = 0.1f;
+
+	/** Seconds between two scans of a soldier in combat or near a hostile team. */
+	UPROPERTY(EditAnywhere, Category="Settings|Manager", meta=(ClampMin="0.0"))
+	float ActiveScanInterval = 0.5f;
+
+	/** Seconds between two scans of an idle soldier far from any hostile team. */
+	UPROPERTY(EditAnywhere, Category="Settings|Manager", meta=(ClampMin="0.0", EditCondition="bAdaptiveDetection"))
+	float IdleScanInterval = 2.f;
+
+	/** Scans idle soldiers far from hostile teams at IdleScanInterval instead of ActiveScanInterval. */
 	UPROPERTY(EditAnywhere, Category="Settings|Manager")
-	float FullLoopDuration = 0.5f;
+	bool bAdaptiveDetection = true;
+
+	/**
+	 * Cell size of the coarse grid deciding whether a hostile team is near, meant to be well above the detection ranges.
+	 * A soldier is near when a hostile soldier stands in its cell or one of the eight around it.
+	 */
+	UPROPERTY(EditAnywhere, Category="Settings|Manager", meta=(ClampMin="1.0", EditCondition="bAdaptiveDetection"))
+	float TeamPresenceCellSize = 5000.f;
 
 	UPROPERTY(EditAnywhere, Category="Settings|Manager")
-	int32 TargetBuckets = 10;
+	ESoldierDetectionQuery DetectionQuery = ESoldierDetectionQuery::SpatialHash;
+
+	/** Runs the detection of a batch on worker threads; results are still applied on the game thread in scan order. */
+	UPROPERTY(EditAnywhere, Category="Settings|Manager")
+	bool bParallelDetection = true;
+
+	/** Lower bound of the hash cell size, keeps soldiers without range from producing tiny cells. */
+	UPROPERTY(EditAnywhere, Category="Settings|Manager", meta=(ClampMin="1.0"))
+	float MinDetectionCellSize = 500.f;
+
+	struct FDetectionCell
+	{
+		int32 First = 0;
+		int32 Num = 0;
+	};
+
+	/**
+	 * Neighbour of a soldier, identified by slot and slot generation so a recycled slot reads as a new soldier. The slots
+	 * are not seen by the garbage collector, the actor is weak so a neighbour destroyed since the last scan is dropped.
+	 */
+	struct FDetectionNeighbor
+	{
+		uint64 Id = 0;
+		TWeakObjectPtr<AActor> Actor;
+	};
+
+	/** Persistent detection state of a registered soldier. Slots are recycled with their arrays' capacity. */
+	struct FDetectionSlot
+	{
+		/** Neighbours found by the last detection pass of the soldier, sorted by Id. */
+		TArray<FDetectionNeighbor> Enemies;
+		TArray<FDetectionNeighbor> Allies;
+		uint32 Generation = 0;
+
+		/** World time of the next scan, 0 for a soldier that was never scanned. */
+		double NextScanTime = 0.0;
+	};
+
+	struct FDetectionResult
+	{
+		/** Neighbours found by the current pass, swapped with the slot's once diffed. */
+		TArray<FDetectionNeighbor> Enemies;
+		TArray<FDetectionNeighbor> Allies;
+
+		TArray<TWeakObjectPtr<AActor>> EnteredEnemies;
+		TArray<TWeakObjectPtr<AActor>> LeftEnemies;
+		TArray<TWeakObjectPtr<AActor>> EnteredAllies;
+		TArray<TWeakObjectPtr<AActor>> LeftAllies;
+	};
+
+	TArray<FDetectionSlot> DetectionSlots;
+	TArray<int32> FreeDetectionSlots;
+
+	/** Detection slot of every soldier of Soldiers, at the same index. */
+	TArray<int32> SoldierSlots;
+
+	/**
+	 * Soldiers registered when the snapshot was last refreshed. The snapshot outlives the tick, so they are weak, and
+	 * soldiers unregistered since are recognised by their slot generation.
+	 */
+	TArray<TWeakObjectPtr<ASoldierRts>> DetectionSoldiers;
+	TArray<int32> DetectionSlotIndices;
+	TArray<uint64> DetectionNeighborIds;
+
+	/** World time of the next refresh of the snapshot and the grids. */
+	double NextDetectionSnapshotTime = 0.0;
+
+	/**
+	 * Snapshot of DetectionSoldiers, one entry per soldier in each array, so the pair test is arithmetic on contiguous
+	 * memory and workers never touch the actors.
+	 */
+	TArray<FVector> DetectionLocations;
+	TArray<float> DetectionEnemyRangesSq;
+	TArray<float> DetectionAllyRangesSq;
+
+	/** Largest of the attack and ally ranges, the radius of the spatial hash query. */
+	TArray<float> DetectionQueryRanges;
+
+	/** Team other soldiers see through ISelectable, as a bit index. */
+	TArray<uint8> DetectionTeams;
+
+	/** Teams the soldier treats as enemies and as allies, one bit per team. */
+	TArray<uint32> DetectionEnemyMasks;
+	TArray<uint32> DetectionAllyMasks;
+
+	/** Soldiers implementing ISelectable, the only ones IsEnemyActor and IsFriendlyActor accept. */
+	TBitArray<> DetectionSelectable;
+
+	/** Soldiers whose controller has an attack target, always scanned at ActiveScanInterval. */
+	TBitArray<> DetectionInCombat;
+
+	/** Indices in DetectionSoldiers of the soldiers due this tick, most overdue first. */
+	TArray<int32> DueSoldiers;
+
+	/** Teams present in each coarse cell, one bit per team. */
+	TMap<FIntPoint, uint32> TeamPresenceCells;
+
+	/** Results of the batch soldiers, kept between batches so a battle without movement allocates nothing. */
+	TArray<FDetectionResult> DetectionResults;
+	TArray<TArray<int32>> DetectionCandidateContexts;
 
-	// State
-	int32 CurrentBucketIndex = 0;
-	float TimeSinceLastBucket = 0.f;
+	/** Indices in DetectionSoldiers sorted by cell, each cell owning a contiguous range. */
+	TArray<int32> DetectionCellEntries;
+	TArray<FIntPoint> DetectionSoldierCells;
+	TMap<FIntPoint, FDetectionCell> DetectionCells;
+	float DetectionCellSize = 1.f;
 };
\ No newline at end of file
@@ -2,10 +2,13 @@
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
 #include "Data/AiData.h"
+#include "UObject/WeakInterfacePtr.h"
+#include "Interfaces/GroupMovementProvider.h"
 #include "UnitOrderComponent.generated.h"
 
 class UUnitSelectionComponent;
 class UUnitFormationComponent;
+class AAiControllerRts;
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnOrdersDispatchedSignature, const TArray<AActor*>&, AffectedUnits, const FCommandData&, IssuedCommand);
 
@@ -18,6 +21,8 @@ class JUPITERPLUGIN_API UUnitOrderComponent : public UActorComponent
 public:
     UUnitOrderComponent();
     virtual void BeginPlay() override;
+    virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+    virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 
     UFUNCTION(BlueprintCallable, Category = "RTS|Orders")
     void IssueOrder(const FCommandData& CommandData);
@@ -56,6 +61,22 @@ protected:
     void ApplyBehaviorToSelection(ECombatBehavior NewBehavior, const TArray<AActor*>& Units);
     bool ShouldIgnoreTarget(AActor* Unit, const FCommandData& CommandData) const;
 
+    // --- Group Movement ---
+
+    /** Units of a move order steering along one shared path until they are close to their formation slot. */
+    struct FUnitGroupMove
+    {
+        int32 Id = INDEX_NONE;
+        int32 PathId = INDEX_NONE;
+        TArray<TWeakObjectPtr<AAiControllerRts>> Followers;
+    };
+
+    /** Acquires a shared path toward the formation slots of a large move order. Returns the index of the new group, INDEX_NONE if the order is dispatched unit by unit. */
+    int32 StartGroupMove(const FCommandData& BaseCommand, const TArray<AActor*>& Units, const TArray<FCommandData>& Commands);
+    IGroupMovementProvider* FindGroupMovementProvider();
+    void UpdateGroupMoves();
+    void ReleaseGroupMoves();
+
 protected:
     UPROPERTY()
     TObjectPtr<UUnitSelectionComponent> SelectionComponent;
@@ -71,4 +92,29 @@ protected:
 
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "RTS|Orders")
     bool bAutoReapplyCachedFormation = true;
+
+    /** Large move orders share one path toward the formation area, e.g. a flow field, instead of a navmesh query per unit. Requires a group movement provider in the level. */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "RTS|Orders|Group Movement")
+    bool bUseGroupMovementForLargeOrders = true;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "RTS|Orders|Group Movement", meta = (ClampMin = "2", EditCondition = "bUseGroupMovementForLargeOrders"))
+    int32 MinUnitsForGroupMovement = 12;
+
+    /** Distance to its slot at which a unit stops steering with the group and reaches the slot with its own navmesh path. */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "RTS|Orders|Group Movement", meta = (ClampMin = "0.0", EditCondition = "bUseGroupMovementForLargeOrders"))
+    float SlotApproachRadius = 400.f;
+
+private:
+    TWeakInterfacePtr<IGroupMovementProvider> GroupMovementProvider;
+
+    /** World last searched without finding a provider, and its level count then; it is searched again once that changes. */
+    TWeakObjectPtr<UWorld> FailedProviderSearchWorld;
+    int32 FailedProviderSearchNumLevels = 0;
+
+    TArray<FUnitGroupMove> GroupMoves;
+    int32 NextGroupMoveId = 0;
+
+    /** Scratch buffers of the batched group samples. */
+    TArray<FVector> GroupPositions;
+    TArray<FVector> GroupDirections;
 };
\ No newline at end of file
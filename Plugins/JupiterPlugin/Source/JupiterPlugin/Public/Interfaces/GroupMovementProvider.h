@@ -0,0 +1,30 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Interface.h"
+#include "GroupMovementProvider.generated.h"
+
+UINTERFACE(meta = (CannotImplementInterfaceInBlueprint))
+class UGroupMovementProvider : public UInterface
+{
+	GENERATED_BODY()
+};
+
+/**
+ * Navigation shared by every unit of a group order, e.g. a flow field toward the formation area.
+ * The order component requests one path per order and steers the whole group from batched samples.
+ */
+class JUPITERPLUGIN_API IGroupMovementProvider
+{
+	GENERATED_BODY()
+
+public:
+	/** Prepares a path leading to GoalBounds for agents of AgentRadius. Returns INDEX_NONE if the area cannot be reached. */
+	virtual int32 AcquireGroupPath(const FBox& GoalBounds, float AgentRadius) = 0;
+
+	/** Writes the steering direction of every position, zero inside the goal area or where the path gives none. */
+	virtual void SampleGroupPath(int32 PathId, TConstArrayView<FVector> WorldPositions, TArrayView<FVector> OutDirections) = 0;
+
+	/** Called once no unit follows the path anymore. */
+	virtual void ReleaseGroupPath(int32 PathId) = 0;
+};
@@ -128,14 +128,26 @@ public:
     UFUNCTION(BlueprintCallable, BlueprintPure)
     ECombatBehavior GetCombatBehavior() const;
 
+    /** Team IsEnemyActor and IsFriendlyActor compare against, read without the ISelectable dispatch. */
+    ETeams GetTeam() const { return CurrentTeam; }
+
     UFUNCTION(BlueprintCallable, BlueprintPure)
     bool IsFriendlyActor(AActor* Actor) const;
 
     UFUNCTION(BlueprintCallable, BlueprintPure)
     bool IsEnemyActor(AActor* Actor) const;
 
-    UFUNCTION()
-    void ProcessDetectionResults(TArray<AActor*> NewEnemies, TArray<AActor*> NewAllies);
+    // Detection events, delivered by USoldierManagerComponent when a soldier enters or leaves a detection range
+    void OnEnemyEntered(AActor* Enemy);
+    void OnEnemyLeft(AActor* Enemy);
+    void OnAllyEntered(AActor* Ally);
+    void OnAllyLeft(AActor* Ally);
+
+    /** Called instead of the leave events of neighbours destroyed since the last detection pass of the soldier. */
+    void OnNeighborDestroyed();
+
+    /** Called after each detection pass of the soldier, once its events were delivered. */
+    void OnDetectionUpdated();
 
     // Weapon helpers
     UFUNCTION(BlueprintCallable, BlueprintPure)
@@ -1,50 +1,78 @@
 #include "FlowField.h"
-#include "Algo/Sort.h"
+#include "FlowFieldClearance.h"
+
+#include "Algo/BinarySearch.h"
+#include "Algo/Unique.h"
+#include "Async/ParallelFor.h"
+#include "HAL/PlatformTime.h"
 
 namespace
 {
-        constexpr float InvalidCost = TNumericLimits<float>::Max();
+        using FlowFieldIntegration::InvalidCost;
+        using FlowFieldIntegration::NeighborOffsets;
+
+        /** Number of settled cells between two checks of the cancellation flag. */
+        constexpr uint32 CancelCheckInterval = 4096;
+
+        /** Settled cells between two budget checks of a time-sliced integration. */
+        constexpr uint32 TimeSliceCheckInterval = 256;
+
+        /** Cells reset or quantised, and direction rows resolved, between two budget checks of Step. */
+        constexpr int32 ResumeChunkCells = 16 * 1024;
+
+        /** Cells resolved per call of the vector direction kernel, sized for stack buffers. */
+        constexpr int32 DirectionChunkSize = 256;
+
+        /** Grids smaller than this resolve their directions on the calling thread. */
+        constexpr int32 ParallelDirectionMinCells = 64 * 1024;
+
+        /** Side of the square tiles integrated concurrently by EFlowFieldIntegrationMethod::ParallelTiles. */
+        constexpr int32 IntegrationTileSize = 64;
+
+        /** Angles representable by a compact direction code. A multiple of 8 so the octant directions stay exact. */
+        constexpr int32 NumDirectionCodes = 240;
+        constexpr uint16 UnreachedIntegrationCode = MAX_uint16;
 
-        struct FOpenCell
+        uint8 EncodeDirection(const FVector2D& Direction)
         {
-                FOpenCell() = default;
-                FOpenCell(int32 InIndex, float InCost)
-                        : Index(InIndex)
-                        , Cost(InCost)
+                if (Direction.IsNearlyZero())
                 {
+                        return 0;
                 }
 
-                int32 Index = INDEX_NONE;
-                float Cost = InvalidCost;
-        };
+                const double Turns = FMath::Atan2(Direction.Y, Direction.X) / UE_DOUBLE_TWO_PI;
+                const int32 Code = FMath::RoundToInt32(Turns * NumDirectionCodes);
+                return static_cast<uint8>(1 + ((Code % NumDirectionCodes) + NumDirectionCodes) % NumDirectionCodes);
+        }
 
-        const TArray<FIntPoint>& GetNeighborOffsets(bool bAllowDiagonal)
+        /** Decoded direction of every code, built once. */
+        const FVector2D* GetDirectionDecodeTable()
         {
-                static const TArray<FIntPoint> CardinalOffsets = {
-                        FIntPoint(1, 0),
-                        FIntPoint(-1, 0),
-                        FIntPoint(0, 1),
-                        FIntPoint(0, -1)
-                };
-
-                static const TArray<FIntPoint> DiagonalOffsets = {
-                        FIntPoint(1, 1),
-                        FIntPoint(1, -1),
-                        FIntPoint(-1, 1),
-                        FIntPoint(-1, -1)
-                };
+                struct FDecodeTable
+                {
+                        FDecodeTable()
+                        {
+                                Directions[0] = FVector2D::ZeroVector;
+                                for (int32 Code = 1; Code < 256; ++Code)
+                                {
+                                        if (Code > NumDirectionCodes)
+                                        {
+                                                Directions[Code] = FVector2D::ZeroVector;
+                                                continue;
+                                        }
 
-                static TArray<FIntPoint> CachedWithDiagonal;
-                static bool bInitialised = false;
+                                        double Sin = 0.0;
+                                        double Cos = 0.0;
+                                        FMath::SinCos(&Sin, &Cos, UE_DOUBLE_TWO_PI * (Code - 1) / NumDirectionCodes);
+                                        Directions[Code] = FVector2D(Cos, Sin);
+                                }
+                        }
 
-                if (!bInitialised)
-                {
-                        CachedWithDiagonal = CardinalOffsets;
-                        CachedWithDiagonal.Append(DiagonalOffsets);
-                        bInitialised = true;
-                }
+                        FVector2D Directions[256];
+                };
 
-                return bAllowDiagonal ? CachedWithDiagonal : CardinalOffsets;
+                static const FDecodeTable Table;
+                return Table.Directions;
         }
 }
 
@@ -57,22 +85,53 @@ void FFlowField::ApplySettings(const FFlowFieldSettings& InSettings)
 {
         Settings = InSettings;
         const int32 ExpectedCells = Settings.GridSize.X * Settings.GridSize.Y;
-        IntegrationField.Init(InvalidCost, ExpectedCells);
-        DirectionField.Init(FVector2D::ZeroVector, ExpectedCells);
-        TraversalWeights.Init(255, ExpectedCells);
-        ResetFields();
+        EmptyFields();
+
+        TSharedRef<TArray<uint8>> DefaultWeights = MakeShared<TArray<uint8>>();
+        DefaultWeights->Init(255, ExpectedCells);
+        TraversalWeights = DefaultWeights;
+        Clearance.Reset();
+        GoalIndices.Reset();
+        SourceCells.Reset();
+        bBoundedBuild = false;
         Destination = FIntPoint(-1, -1);
 }
 
 void FFlowField::SetTraversalWeights(const TArray<uint8>& InWeights)
+{
+        SetSharedTraversalWeights(MakeShared<TArray<uint8>>(InWeights));
+}
+
+void FFlowField::SetSharedTraversalWeights(const TSharedPtr<const TArray<uint8>>& InWeights)
 {
         const int32 ExpectedCells = Settings.GridSize.X * Settings.GridSize.Y;
-        if (ensureMsgf(InWeights.Num() == ExpectedCells, TEXT("Traversal weight array does not match grid dimensions")))
+        if (ensureMsgf(InWeights.IsValid() && InWeights->Num() == ExpectedCells, TEXT("Traversal weight array does not match grid dimensions")))
         {
                 TraversalWeights = InWeights;
         }
 }
 
+void FFlowField::SetSharedClearance(const TSharedPtr<const FFlowFieldClearance>& InClearance)
+{
+        if (ensureMsgf(!InClearance.IsValid() || InClearance->GetGridSize() == Settings.GridSize, TEXT("Clearance layer does not match grid dimensions")))
+        {
+                Clearance = InClearance;
+        }
+}
+
+const TArray<uint8>& FFlowField::GetIntegrationWeights() const
+{
+        if (Settings.MinClearance > 1 && Clearance.IsValid())
+        {
+                if (const TArray<uint8>* ClassWeights = Clearance->GetClassWeights(Settings.MinClearance))
+                {
+                        return *ClassWeights;
+                }
+        }
+
+        return *TraversalWeights;
+}
+
 bool FFlowField::IsWalkable(const FIntPoint& Cell) const
 {
         const int32 Index = ToLinearIndex(Cell);
@@ -81,216 +140,1463 @@ bool FFlowField::IsWalkable(const FIntPoint& Cell) const
                         return false;
         }
 
-        return TraversalWeights.IsValidIndex(Index) && TraversalWeights[Index] > 0;
+        const TArray<uint8>& Weights = GetIntegrationWeights();
+        return Weights.IsValidIndex(Index) && Weights[Index] > 0;
+}
+
+bool FFlowField::Build(const FIntPoint& DestinationCell, const std::atomic<bool>* bCancelRequested)
+{
+        return BuildToCells(MakeArrayView(&DestinationCell, 1), bCancelRequested);
 }
 
-bool FFlowField::Build(const FIntPoint& DestinationCell)
+bool FFlowField::BuildToCells(TConstArrayView<FIntPoint> GoalCells, const std::atomic<bool>* bCancelRequested)
 {
-        if (!IsCellValid(DestinationCell) || !IsWalkable(DestinationCell))
+        if (!SetGoalCells(GoalCells))
         {
                 return false;
         }
 
-        ResetFields();
-        Destination = DestinationCell;
+        bBoundedBuild = false;
+        return BuildFromSources(bCancelRequested);
+}
+
+bool FFlowField::BuildBounded(TConstArrayView<FIntPoint> GoalCells, const FFlowFieldBuildBounds& Bounds, const std::atomic<bool>* bCancelRequested)
+{
+        if (!SetGoalCells(GoalCells))
+        {
+                return false;
+        }
 
-        const int32 DestinationIndex = ToLinearIndex(DestinationCell);
-        IntegrationField[DestinationIndex] = 0.0f;
+        const int32 GridX = Settings.GridSize.X;
+        BoundedRegion = FIntRect(FIntPoint::ZeroValue, Settings.GridSize);
+        if (Bounds.MaxRadius > 0)
+        {
+                // Goal indices are sorted, so only the columns need a scan.
+                FIntRect GoalBounds(GridX, GoalIndices[0] / GridX, 0, GoalIndices.Last() / GridX + 1);
+                for (const int32 Index : GoalIndices)
+                {
+                        GoalBounds.Min.X = FMath::Min(GoalBounds.Min.X, Index % GridX);
+                        GoalBounds.Max.X = FMath::Max(GoalBounds.Max.X, Index % GridX + 1);
+                }
 
-        TArray<FOpenCell> OpenSet;
-        OpenSet.Reserve(IntegrationField.Num());
-        OpenSet.Emplace(DestinationIndex, 0.0f);
+                GoalBounds.InflateRect(Bounds.MaxRadius);
+                BoundedRegion.Clip(GoalBounds);
+        }
 
-        while (OpenSet.Num() > 0)
+        BoundedMaxCost = Bounds.MaxCost;
+        BoundedQueryCells.Reset();
+        for (const FIntPoint& Cell : Bounds.QueryCells)
         {
-                OpenSet.Sort([](const FOpenCell& A, const FOpenCell& B)
+                if (BoundedRegion.Contains(Cell))
                 {
-                        return A.Cost < B.Cost;
-                });
+                        BoundedQueryCells.Add(ToLinearIndex(Cell));
+                }
+        }
 
-                const FOpenCell Current = OpenSet[0];
-                OpenSet.RemoveAt(0);
+        BoundedQueryCells.Sort();
+        BoundedQueryCells.SetNum(Algo::Unique(BoundedQueryCells));
 
-                if (!IntegrationField.IsValidIndex(Current.Index))
+        bBoundedBuild = true;
+        return BuildFromSources(bCancelRequested);
+}
+
+bool FFlowField::SetGoalCells(TConstArrayView<FIntPoint> GoalCells)
+{
+        TArray<int32> NewGoalIndices;
+        NewGoalIndices.Reserve(GoalCells.Num());
+        for (const FIntPoint& Cell : GoalCells)
+        {
+                if (IsCellValid(Cell))
                 {
-                        continue;
+                        NewGoalIndices.Add(ToLinearIndex(Cell));
                 }
+        }
+
+        NewGoalIndices.Sort();
+        NewGoalIndices.SetNum(Algo::Unique(NewGoalIndices));
+
+        const TArray<uint8>& Weights = GetIntegrationWeights();
+        TArray<int32> NewSourceCells = NewGoalIndices;
+        NewSourceCells.RemoveAll([&Weights](int32 Index) { return Weights[Index] == 0; });
+        if (NewSourceCells.Num() == 0)
+        {
+                return false;
+        }
+
+        GoalIndices = MoveTemp(NewGoalIndices);
+        SourceCells = MoveTemp(NewSourceCells);
+        Destination = FIntPoint(SourceCells[0] % Settings.GridSize.X, SourceCells[0] / Settings.GridSize.X);
+        return true;
+}
+
+bool FFlowField::BuildToArea(const FBox& WorldBounds, const std::atomic<bool>* bCancelRequested)
+{
+        const FIntRect Area = WorldBoundsToCellRect(WorldBounds);
 
-                const float RecordedCost = IntegrationField[Current.Index];
-                if (Current.Cost > RecordedCost + KINDA_SMALL_NUMBER)
+        TArray<FIntPoint> GoalCells;
+        GoalCells.Reserve(FMath::Max(Area.Area(), 0));
+        for (int32 CellY = Area.Min.Y; CellY < Area.Max.Y; ++CellY)
+        {
+                for (int32 CellX = Area.Min.X; CellX < Area.Max.X; ++CellX)
                 {
-                        continue;
+                        GoalCells.Add(FIntPoint(CellX, CellY));
                 }
+        }
+
+        return BuildToCells(GoalCells, bCancelRequested);
+}
+
+FIntRect FFlowField::WorldBoundsToCellRect(const FBox& WorldBounds) const
+{
+        if (!WorldBounds.IsValid)
+        {
+                return FIntRect();
+        }
+
+        FIntRect Rect(WorldToCell(WorldBounds.Min), WorldToCell(WorldBounds.Max) + FIntPoint(1, 1));
+        Rect.Clip(FIntRect(FIntPoint::ZeroValue, Settings.GridSize));
+        return Rect;
+}
+
+bool FFlowField::BuildFromSources(const std::atomic<bool>* bCancelRequested)
+{
+        ResetFields();
+        for (const int32 Index : SourceCells)
+        {
+                IntegrationField[Index] = 0.0f;
+        }
 
-                const int32 GridX = Settings.GridSize.X;
-                const FIntPoint CurrentCell(Current.Index % GridX, Current.Index / GridX);
+        StepCosts.Build(Settings);
 
-                for (const FIntPoint& Offset : GetNeighborOffsets(Settings.bAllowDiagonal))
+        bool bCompleted = false;
+        if (bBoundedBuild)
+        {
+                TouchedCells.Append(SourceCells);
+                bSparseFields = true;
+
+                // Stopping early needs the cells settled in cost order, which only the serial Dijkstra queues provide.
+                if (Settings.IntegrationMethod == EFlowFieldIntegrationMethod::BucketQueue && BucketOpenList.Configure(StepCosts.MinStepCost, StepCosts.MaxStepCost))
                 {
-                        const FIntPoint NeighborCell = CurrentCell + Offset;
-                        const int32 NeighborIndex = ToLinearIndex(NeighborCell);
-                        if (NeighborIndex == INDEX_NONE)
+                        for (const int32 Index : SourceCells)
                         {
-                                continue;
+                                BucketOpenList.Push(Index, 0.0f);
                         }
 
-                        const uint8 Weight = TraversalWeights.IsValidIndex(NeighborIndex) ? TraversalWeights[NeighborIndex] : 0;
-                        if (Weight == 0)
+                        bCompleted = IntegrateBounded(BucketOpenList, bCancelRequested);
+                }
+                else
+                {
+                        HeapOpenList.Reset(SourceCells.Num());
+                        for (const int32 Index : SourceCells)
                         {
-                                continue;
+                                HeapOpenList.Push(Index, 0.0f);
                         }
 
-                        const bool bDiagonal = Offset.X != 0 && Offset.Y != 0;
-                        const float StepCost = Settings.StepCost * (bDiagonal ? Settings.DiagonalCostMultiplier : 1.0f);
-                        const float NormalisedWeight = static_cast<float>(Weight) / 255.0f;
-                        const float TraversalCost = StepCost * Settings.CellTraversalWeightMultiplier / FMath::Max(NormalisedWeight, KINDA_SMALL_NUMBER);
-                        const float NewCost = RecordedCost + (TraversalCost * Settings.HeuristicWeight);
+                        bCompleted = IntegrateBounded(HeapOpenList, bCancelRequested);
+                }
+        }
+        else if (Settings.IntegrationMethod == EFlowFieldIntegrationMethod::ParallelTiles)
+        {
+                bCompleted = IntegrateTiles(bCancelRequested);
+        }
+        else if (Settings.IntegrationMethod == EFlowFieldIntegrationMethod::FastMarching)
+        {
+                HeapOpenList.Reset(Settings.GridSize.X + Settings.GridSize.Y + SourceCells.Num());
+                for (const int32 Index : SourceCells)
+                {
+                        HeapOpenList.Push(Index, 0.0f);
+                }
+
+                bCompleted = IntegrateFastMarching(bCancelRequested);
+        }
+        else if (Settings.IntegrationMethod == EFlowFieldIntegrationMethod::BucketQueue && BucketOpenList.Configure(StepCosts.MinStepCost, StepCosts.MaxStepCost))
+        {
+                for (const int32 Index : SourceCells)
+                {
+                        BucketOpenList.Push(Index, 0.0f);
+                }
+
+                bCompleted = Integrate(BucketOpenList, bCancelRequested);
+        }
+        else
+        {
+                HeapOpenList.Reset(Settings.GridSize.X + Settings.GridSize.Y + SourceCells.Num());
+                for (const int32 Index : SourceCells)
+                {
+                        HeapOpenList.Push(Index, 0.0f);
+                }
+
+                bCompleted = Integrate(HeapOpenList, bCancelRequested);
+        }
+
+        if (!bCompleted || (bCancelRequested && bCancelRequested->load(std::memory_order_relaxed)))
+        {
+                return false;
+        }
+
+        if (bBoundedBuild)
+        {
+                for (const int32 Index : TouchedCells)
+                {
+                        ResolveCellDirection(Index);
+                }
+        }
+        else
+        {
+                RebuildFlowDirections();
+        }
 
-                        if (NewCost + KINDA_SMALL_NUMBER < IntegrationField[NeighborIndex])
+        if (Settings.bCompactStorage)
+        {
+                float MaxCost = 0.0f;
+                for (const float Cost : IntegrationField)
+                {
+                        if (Cost < InvalidCost)
                         {
-                                IntegrationField[NeighborIndex] = NewCost;
-                                OpenSet.Emplace(NeighborIndex, NewCost);
+                                MaxCost = FMath::Max(MaxCost, Cost);
                         }
                 }
+
+                BeginCompactIntegration(MaxCost);
+                CompactIntegrationRange(0, IntegrationField.Num());
+                FinishCompactStorage();
         }
 
-        RebuildFlowDirections();
         return true;
 }
 
-FVector2D FFlowField::GetDirectionForCell(const FIntPoint& Cell) const
+bool FFlowField::BeginBuild(TConstArrayView<FIntPoint> GoalCells)
 {
-        const int32 Index = ToLinearIndex(Cell);
-        if (!DirectionField.IsValidIndex(Index))
+        if (!SetGoalCells(GoalCells))
         {
-                return FVector2D::ZeroVector;
+                return false;
         }
 
-        return DirectionField[Index];
+        RestartResumableBuild();
+        return true;
 }
 
-FIntPoint FFlowField::WorldToCell(const FVector& WorldPosition) const
+void FFlowField::RestartResumableBuild()
 {
-        const FVector Local = WorldPosition - Settings.Origin;
-        const int32 X = FMath::FloorToInt(Local.X / Settings.CellSize);
-        const int32 Y = FMath::FloorToInt(Local.Y / Settings.CellSize);
-        return FIntPoint(X, Y);
-}
+        const int32 CellCount = Settings.GridSize.X * Settings.GridSize.Y;
 
-FVector FFlowField::CellToWorld(const FIntPoint& Cell) const
-{
-        return Settings.Origin + FVector((Cell.X + 0.5f) * Settings.CellSize, (Cell.Y + 0.5f) * Settings.CellSize, 0.0f);
-}
+        // The reset itself is a phase of the build, so only the allocation happens here.
+        bBoundedBuild = false;
+        TouchedCells.Reset();
+        bSparseFields = false;
+        IntegrationField.SetNumUninitialized(CellCount);
+        if (Settings.bCompactStorage)
+        {
+                CompactDirections.SetNumUninitialized(CellCount);
+                CompactIntegration.Empty();
+        }
+        else
+        {
+                DirectionField.SetNumUninitialized(CellCount);
+        }
 
-FVector FFlowField::GetDirectionForWorldPosition(const FVector& WorldPosition) const
-{
-        return FVector(GetDirectionForCell(WorldToCell(WorldPosition)), 0.0f);
+        StepCosts.Build(Settings);
+        ResumePhase = EResumePhase::Resetting;
+        ResumeCursor = 0;
+        NumWalkableCells = 0;
+        NumSettledCells = 0;
+        SettledCost = -1.0f;
 }
 
-FFlowFieldDebugSnapshot FFlowField::CreateDebugSnapshot() const
+bool FFlowField::Step(float TimeBudgetMs)
 {
-        FFlowFieldDebugSnapshot Snapshot;
-        Snapshot.GridSize = Settings.GridSize;
-        Snapshot.CellSize = Settings.CellSize;
-        Snapshot.Origin = Settings.Origin;
-        Snapshot.IntegrationField = IntegrationField;
-        Snapshot.DirectionField = DirectionField;
-        Snapshot.WalkableField = TraversalWeights;
-        Snapshot.Destination = Destination;
-        return Snapshot;
-}
+        const int32 GridX = Settings.GridSize.X;
+        const int32 GridY = Settings.GridSize.Y;
+        const int32 CellCount = GridX * GridY;
+        const double EndTime = FPlatformTime::Seconds() + FMath::Max(TimeBudgetMs, 0.0f) * 0.001;
 
-int32 FFlowField::ToLinearIndex(const FIntPoint& Cell) const
-{
-        if (!IsCellValid(Cell))
+        // The budget is checked after every chunk, so each call makes some progress even with no budget at all.
+        while (ResumePhase != EResumePhase::None)
         {
-                return INDEX_NONE;
-        }
+                if (ResumePhase == EResumePhase::Resetting)
+                {
+                        const uint8* RESTRICT Weights = GetIntegrationWeights().GetData();
+                        const int32 ChunkEnd = FMath::Min(ResumeCursor + ResumeChunkCells, CellCount);
+                        for (int32 Index = ResumeCursor; Index < ChunkEnd; ++Index)
+                        {
+                                IntegrationField[Index] = InvalidCost;
+                                StoreCellDirection(Index, FVector2D::ZeroVector);
+                                NumWalkableCells += Weights[Index] != 0 ? 1 : 0;
+                        }
 
-        return Cell.Y * Settings.GridSize.X + Cell.X;
-}
+                        ResumeCursor = ChunkEnd;
+                        if (ResumeCursor == CellCount)
+                        {
+                                for (const int32 Index : SourceCells)
+                                {
+                                        IntegrationField[Index] = 0.0f;
+                                }
 
-bool FFlowField::IsCellValid(const FIntPoint& Cell) const
-{
-        return Cell.X >= 0 && Cell.Y >= 0 && Cell.X < Settings.GridSize.X && Cell.Y < Settings.GridSize.Y;
+                                // Fast marching and the tiles cannot pause mid-build, resumable builds use the Dijkstra queues.
+                                bResumeWithBuckets = Settings.IntegrationMethod == EFlowFieldIntegrationMethod::BucketQueue && BucketOpenList.Configure(StepCosts.MinStepCost, StepCosts.MaxStepCost);
+                                if (!bResumeWithBuckets)
+                                {
+                                        HeapOpenList.Reset(GridX + GridY + SourceCells.Num());
+                                }
+
+                                for (const int32 Index : SourceCells)
+                                {
+                                        if (bResumeWithBuckets)
+                                        {
+                                                BucketOpenList.Push(Index, 0.0f);
+                                        }
+                                        else
+                                        {
+                                                HeapOpenList.Push(Index, 0.0f);
+                                        }
+                                }
+
+                                ResumePhase = EResumePhase::Integrating;
+                        }
+                }
+                else if (ResumePhase == EResumePhase::Integrating)
+                {
+                        IntegrationEndTime = EndTime;
+                        const bool bCompleted = bResumeWithBuckets ? Integrate(BucketOpenList, nullptr) : Integrate(HeapOpenList, nullptr);
+                        IntegrationEndTime = 0.0;
+                        if (!bCompleted)
+                        {
+                                return false;
+                        }
+
+                        ResumePhase = EResumePhase::ResolvingDirections;
+                        ResumeCursor = 0;
+                }
+                else if (ResumePhase == EResumePhase::ResolvingDirections)
+                {
+                        const int32 ChunkEnd = FMath::Min(ResumeCursor + FMath::Max(ResumeChunkCells / GridX, 1), GridY);
+                        for (; ResumeCursor < ChunkEnd; ++ResumeCursor)
+                        {
+                                ResolveDirectionRow(ResumeCursor);
+                        }
+
+                        if (ResumeCursor == GridY)
+                        {
+                                ResumeCursor = 0;
+                                if (Settings.bCompactStorage)
+                                {
+                                        // Dijkstra settles cells in cost order, the last one is the most expensive.
+                                        BeginCompactIntegration(FMath::Max(SettledCost, 0.0f));
+                                        ResumePhase = EResumePhase::Compacting;
+                                }
+                                else
+                                {
+                                        ResumePhase = EResumePhase::None;
+                                }
+                        }
+                }
+                else
+                {
+                        const int32 ChunkEnd = FMath::Min(ResumeCursor + ResumeChunkCells, CellCount);
+                        CompactIntegrationRange(ResumeCursor, ChunkEnd);
+                        ResumeCursor = ChunkEnd;
+                        if (ResumeCursor == CellCount)
+                        {
+                                FinishCompactStorage();
+                                ResumePhase = EResumePhase::None;
+                        }
+                }
+
+                if (FPlatformTime::Seconds() >= EndTime)
+                {
+                        break;
+                }
+        }
+
+        return ResumePhase == EResumePhase::None;
 }
 
-void FFlowField::ResetFields()
+float FFlowField::GetBuildProgress() const
 {
-        for (float& Value : IntegrationField)
+        if (ResumePhase == EResumePhase::None)
         {
-                Value = InvalidCost;
+                return 1.0f;
         }
 
-        for (FVector2D& Value : DirectionField)
+        // Every phase is weighted as one pass over the grid; the integration advances with the walkable cells settled.
+        const double CellCount = FMath::Max(Settings.GridSize.X * Settings.GridSize.Y, 1);
+        const double NumPasses = Settings.bCompactStorage ? 4.0 : 3.0;
+        double CellsDone = 0.0;
+        switch (ResumePhase)
         {
-                Value = FVector2D::ZeroVector;
+        case EResumePhase::Resetting:
+                CellsDone = ResumeCursor;
+                break;
+        case EResumePhase::Integrating:
+                CellsDone = CellCount * (1.0 + FMath::Min(static_cast<double>(NumSettledCells) / FMath::Max(NumWalkableCells, 1), 1.0));
+                break;
+        case EResumePhase::ResolvingDirections:
+                CellsDone = CellCount * 2.0 + static_cast<double>(ResumeCursor) * Settings.GridSize.X;
+                break;
+        default:
+                CellsDone = CellCount * 3.0 + ResumeCursor;
+                break;
         }
+
+        return static_cast<float>(CellsDone / (NumPasses * CellCount));
 }
 
-void FFlowField::RebuildFlowDirections()
+FVector2D FFlowField::GetDirectionDuringBuild(int32 Index) const
 {
-        const int32 CellCount = Settings.GridSize.X * Settings.GridSize.Y;
-        if (CellCount == 0)
+        // A settled cell has its final cost, and so have the cheaper neighbours its direction is resolved from.
+        switch (ResumePhase)
         {
-                return;
+        case EResumePhase::Integrating:
+                return IntegrationField[Index] <= SettledCost ? ComputeCellDirection(Index) : FVector2D::ZeroVector;
+        case EResumePhase::ResolvingDirections:
+                return Index / Settings.GridSize.X < ResumeCursor ? GetStoredDirection(Index) : ComputeCellDirection(Index);
+        case EResumePhase::Compacting:
+                return GetStoredDirection(Index);
+        default:
+                return FVector2D::ZeroVector;
         }
+}
 
-        const TArray<FIntPoint>& Offsets = GetNeighborOffsets(Settings.bAllowDiagonal);
+template <typename QueueType>
+bool FFlowField::Integrate(QueueType& OpenList, const std::atomic<bool>* bCancelRequested, TArray<int32>* ChangedCells)
+{
+        const int32 GridX = Settings.GridSize.X;
+        const int32 GridY = Settings.GridSize.Y;
+        const int32 NumOffsets = Settings.bAllowDiagonal ? FlowFieldIntegration::NumNeighborOffsets : FlowFieldIntegration::NumCardinalOffsets;
+
+        float* RESTRICT Integration = IntegrationField.GetData();
+        const uint8* RESTRICT Weights = GetIntegrationWeights().GetData();
 
-        for (int32 Index = 0; Index < CellCount; ++Index)
+        const bool bTimeSliced = IntegrationEndTime > 0.0;
+        const uint32 CheckInterval = bTimeSliced ? TimeSliceCheckInterval : CancelCheckInterval;
+        uint32 PopsUntilCheck = CheckInterval;
+        int32 NumSettled = 0;
+        float LastSettledCost = SettledCost;
+
+        FFlowFieldOpenCell Current;
+        while (OpenList.Pop(Current))
         {
-                if (IntegrationField[Index] >= InvalidCost)
+                if ((bCancelRequested || bTimeSliced) && --PopsUntilCheck == 0)
+                {
+                        if (bCancelRequested && bCancelRequested->load(std::memory_order_relaxed))
+                        {
+                                return false;
+                        }
+
+                        if (bTimeSliced && FPlatformTime::Seconds() >= IntegrationEndTime)
+                        {
+                                // Queue the cell again so the next slice resumes exactly where this one stopped.
+                                OpenList.Push(Current.Index, Current.Cost);
+                                NumSettledCells += NumSettled;
+                                SettledCost = Current.Cost;
+                                return false;
+                        }
+
+                        PopsUntilCheck = CheckInterval;
+                }
+
+                const float RecordedCost = Integration[Current.Index];
+                if (Current.Cost > RecordedCost)
                 {
-                        DirectionField[Index] = FVector2D::ZeroVector;
                         continue;
                 }
 
-                const FIntPoint Cell(Index % Settings.GridSize.X, Index / Settings.GridSize.X);
-                float BestCost = IntegrationField[Index];
-                FVector2D BestDirection = FVector2D::ZeroVector;
-                FVector2D SmoothedDirection = FVector2D::ZeroVector;
-                float AccumulatedWeight = 0.0f;
+                ++NumSettled;
+                LastSettledCost = RecordedCost;
+
+                const int32 CurrentX = Current.Index % GridX;
+                const int32 CurrentY = Current.Index / GridX;
 
-                for (const FIntPoint& Offset : Offsets)
+                for (int32 OffsetIndex = 0; OffsetIndex < NumOffsets; ++OffsetIndex)
                 {
-                        const FIntPoint Neighbor = Cell + Offset;
-                        const int32 NeighborIndex = ToLinearIndex(Neighbor);
-                        if (NeighborIndex == INDEX_NONE)
+                        const FIntPoint& Offset = NeighborOffsets[OffsetIndex];
+                        const int32 NeighborX = CurrentX + Offset.X;
+                        const int32 NeighborY = CurrentY + Offset.Y;
+                        if (NeighborX < 0 || NeighborY < 0 || NeighborX >= GridX || NeighborY >= GridY)
                         {
                                 continue;
                         }
 
-                        const float NeighborCost = IntegrationField[NeighborIndex];
-                        if (NeighborCost < BestCost)
+                        const int32 NeighborIndex = NeighborY * GridX + NeighborX;
+                        const uint8 Weight = Weights[NeighborIndex];
+                        if (Weight == 0)
                         {
-                                BestCost = NeighborCost;
-                                BestDirection = FVector2D(static_cast<float>(Offset.X), static_cast<float>(Offset.Y));
+                                continue;
                         }
 
-                        if (NeighborCost < InvalidCost)
+                        const float TraversalCost = OffsetIndex < FlowFieldIntegration::NumCardinalOffsets ? StepCosts.Cardinal[Weight] : StepCosts.Diagonal[Weight];
+                        const float NewCost = RecordedCost + TraversalCost;
+
+                        // Exact comparison: every cell ends at the minimum over its neighbours of (neighbour + step), a unique
+                        // fixpoint that MarkCellsDirty can reproduce bit for bit without replaying the whole build.
+                        if (NewCost < Integration[NeighborIndex])
                         {
-                                const float CostDelta = IntegrationField[Index] - NeighborCost;
-                                if (CostDelta > 0.0f)
+                                Integration[NeighborIndex] = NewCost;
+                                OpenList.Push(NeighborIndex, NewCost);
+
+                                if (ChangedCells)
                                 {
-                                        const FVector2D OffsetVector(static_cast<float>(Offset.X), static_cast<float>(Offset.Y));
-                                        SmoothedDirection += OffsetVector * CostDelta;
-                                        AccumulatedWeight += CostDelta;
+                                        ChangedCells->Add(NeighborIndex);
                                 }
                         }
                 }
+        }
+
+        NumSettledCells += NumSettled;
+        SettledCost = LastSettledCost;
+        return true;
+}
+
+template <typename QueueType>
+bool FFlowField::IntegrateBounded(QueueType& OpenList, const std::atomic<bool>* bCancelRequested)
+{
+        const int32 GridX = Settings.GridSize.X;
+        const int32 NumOffsets = Settings.bAllowDiagonal ? FlowFieldIntegration::NumNeighborOffsets : FlowFieldIntegration::NumCardinalOffsets;
+        const FIntRect Region = BoundedRegion;
+        const float MaxCost = BoundedMaxCost;
+
+        float* RESTRICT Integration = IntegrationField.GetData();
+        const uint8* RESTRICT Weights = GetIntegrationWeights().GetData();
+
+        if (QueryMarks.Num() != IntegrationField.Num())
+        {
+                QueryMarks.Init(false, IntegrationField.Num());
+        }
 
-                if (Settings.bSmoothDirections && AccumulatedWeight > 0.0f)
+        // Blocked query cells are never settled, waiting for them would flood the whole region.
+        int32 NumPendingQueries = 0;
+        for (const int32 Index : BoundedQueryCells)
+        {
+                if (Weights[Index] != 0)
                 {
-                        DirectionField[Index] = SmoothedDirection.GetSafeNormal();
+                        QueryMarks[Index] = true;
+                        ++NumPendingQueries;
                 }
-                else if (!BestDirection.IsNearlyZero())
+        }
+
+        uint32 PopsUntilCancelCheck = CancelCheckInterval;
+        bool bCompleted = true;
+
+        FFlowFieldOpenCell Current;
+        while (OpenList.Pop(Current))
+        {
+                if (bCancelRequested && --PopsUntilCancelCheck == 0)
                 {
-                        DirectionField[Index] = BestDirection.GetSafeNormal();
+                        if (bCancelRequested->load(std::memory_order_relaxed))
+                        {
+                                bCompleted = false;
+                                break;
+                        }
+
+                        PopsUntilCancelCheck = CancelCheckInterval;
                 }
-                else
+
+                const float RecordedCost = Integration[Current.Index];
+                if (Current.Cost > RecordedCost)
                 {
-                        DirectionField[Index] = FVector2D::ZeroVector;
+                        continue;
                 }
+
+                // Every cell a query cell leads through is cheaper, so it is settled already.
+                if (QueryMarks[Current.Index])
+                {
+                        QueryMarks[Current.Index] = false;
+                        if (--NumPendingQueries == 0)
+                        {
+                                break;
+                        }
+                }
+
+                const int32 CurrentX = Current.Index % GridX;
+                const int32 CurrentY = Current.Index / GridX;
+
+                for (int32 OffsetIndex = 0; OffsetIndex < NumOffsets; ++OffsetIndex)
+                {
+                        const FIntPoint& Offset = NeighborOffsets[OffsetIndex];
+                        const int32 NeighborX = CurrentX + Offset.X;
+                        const int32 NeighborY = CurrentY + Offset.Y;
+                        if (NeighborX < Region.Min.X || NeighborY < Region.Min.Y || NeighborX >= Region.Max.X || NeighborY >= Region.Max.Y)
+                        {
+                                continue;
+                        }
+
+                        const int32 NeighborIndex = NeighborY * GridX + NeighborX;
+                        const uint8 Weight = Weights[NeighborIndex];
+                        if (Weight == 0)
+                        {
+                                continue;
+                        }
+
+                        const float TraversalCost = OffsetIndex < FlowFieldIntegration::NumCardinalOffsets ? StepCosts.Cardinal[Weight] : StepCosts.Diagonal[Weight];
+                        const float NewCost = RecordedCost + TraversalCost;
+                        if (NewCost < Integration[NeighborIndex] && NewCost <= MaxCost)
+                        {
+                                if (Integration[NeighborIndex] == InvalidCost)
+                                {
+                                        TouchedCells.Add(NeighborIndex);
+                                }
+
+                                Integration[NeighborIndex] = NewCost;
+                                OpenList.Push(NeighborIndex, NewCost);
+                        }
+                }
+        }
+
+        // Queries the bounds kept out of reach are still marked.
+        for (const int32 Index : BoundedQueryCells)
+        {
+                QueryMarks[Index] = false;
+        }
+
+        return bCompleted;
+}
+
+bool FFlowField::IntegrateFastMarching(const std::atomic<bool>* bCancelRequested)
+{
+        const int32 GridX = Settings.GridSize.X;
+        const int32 GridY = Settings.GridSize.Y;
+
+        float* RESTRICT Integration = IntegrationField.GetData();
+        const uint8* RESTRICT Weights = GetIntegrationWeights().GetData();
+
+        AcceptedCells.Init(false, GridX * GridY);
+
+        // Only accepted costs feed the upwind update, so every cell is solved from final values.
+        auto GetAcceptedCost = [this, Integration, GridX, GridY](int32 CellX, int32 CellY)
+        {
+                if (CellX < 0 || CellY < 0 || CellX >= GridX || CellY >= GridY)
+                {
+                        return InvalidCost;
+                }
+
+                const int32 Index = CellY * GridX + CellX;
+                return AcceptedCells[Index] ? Integration[Index] : InvalidCost;
+        };
+
+        uint32 PopsUntilCancelCheck = CancelCheckInterval;
+
+        FFlowFieldOpenCell Current;
+        while (HeapOpenList.Pop(Current))
+        {
+                if (bCancelRequested && --PopsUntilCancelCheck == 0)
+                {
+                        if (bCancelRequested->load(std::memory_order_relaxed))
+                        {
+                                return false;
+                        }
+
+                        PopsUntilCancelCheck = CancelCheckInterval;
+                }
+
+                if (AcceptedCells[Current.Index] || Current.Cost > Integration[Current.Index])
+                {
+                        continue;
+                }
+
+                AcceptedCells[Current.Index] = true;
+
+                const int32 CurrentX = Current.Index % GridX;
+                const int32 CurrentY = Current.Index / GridX;
+                for (int32 OffsetIndex = 0; OffsetIndex < FlowFieldIntegration::NumCardinalOffsets; ++OffsetIndex)
+                {
+                        const int32 NeighborX = CurrentX + NeighborOffsets[OffsetIndex].X;
+                        const int32 NeighborY = CurrentY + NeighborOffsets[OffsetIndex].Y;
+                        if (NeighborX < 0 || NeighborY < 0 || NeighborX >= GridX || NeighborY >= GridY)
+                        {
+                                continue;
+                        }
+
+                        const int32 NeighborIndex = NeighborY * GridX + NeighborX;
+                        const uint8 Weight = Weights[NeighborIndex];
+                        if (Weight == 0 || AcceptedCells[NeighborIndex])
+                        {
+                                continue;
+                        }
+
+                        // Upwind solve of |grad T| = F with unit spacing, using the cheaper accepted neighbour along each axis.
+                        const float Speed = StepCosts.Cardinal[Weight];
+                        float CostA = FMath::Min(GetAcceptedCost(NeighborX - 1, NeighborY), GetAcceptedCost(NeighborX + 1, NeighborY));
+                        float CostB = FMath::Min(GetAcceptedCost(NeighborX, NeighborY - 1), GetAcceptedCost(NeighborX, NeighborY + 1));
+                        if (CostA > CostB)
+                        {
+                                Swap(CostA, CostB);
+                        }
+
+                        const float Difference = CostB - CostA;
+                        const float NewCost = CostB >= InvalidCost || Difference >= Speed
+                                ? CostA + Speed
+                                : 0.5f * (CostA + CostB + FMath::Sqrt(2.0f * Speed * Speed - Difference * Difference));
+
+                        if (NewCost < Integration[NeighborIndex])
+                        {
+                                Integration[NeighborIndex] = NewCost;
+                                HeapOpenList.Push(NeighborIndex, NewCost);
+                        }
+                }
+        }
+
+        return true;
+}
+
+bool FFlowField::IsSourceCell(int32 Index) const
+{
+        return Algo::BinarySearch(SourceCells, Index) != INDEX_NONE;
+}
+
+bool FFlowField::IntegrateTiles(const std::atomic<bool>* bCancelRequested)
+{
+        const int32 GridX = Settings.GridSize.X;
+        const int32 GridY = Settings.GridSize.Y;
+        const int32 TilesX = FMath::DivideAndRoundUp(GridX, IntegrationTileSize);
+        const int32 TilesY = FMath::DivideAndRoundUp(GridY, IntegrationTileSize);
+        const int32 NumTiles = TilesX * TilesY;
+
+        TileVisitSteps.Init(0, NumTiles);
+        TileChangeSteps.Init(0, NumTiles);
+
+        // Source cells count as a border change of their tile, which activates the tile itself and lets the
+        // neighbouring tiles pull the sources sitting on the border.
+        for (const int32 Index : SourceCells)
+        {
+                TileChangeSteps[(Index / GridX / IntegrationTileSize) * TilesX + (Index % GridX) / IntegrationTileSize] = 1;
+        }
+
+        auto IsTileActive = [this, TilesX, TilesY](int32 TileX, int32 TileY)
+        {
+                const int32 VisitStep = TileVisitSteps[TileY * TilesX + TileX];
+                for (int32 NeighborY = FMath::Max(TileY - 1, 0); NeighborY <= FMath::Min(TileY + 1, TilesY - 1); ++NeighborY)
+                {
+                        for (int32 NeighborX = FMath::Max(TileX - 1, 0); NeighborX <= FMath::Min(TileX + 1, TilesX - 1); ++NeighborX)
+                        {
+                                if (TileChangeSteps[NeighborY * TilesX + NeighborX] > VisitStep)
+                                {
+                                        return true;
+                                }
+                        }
+                }
+
+                return false;
+        };
+
+        // Tiles are coloured in a 2x2 pattern. Tiles of one colour never touch, not even diagonally, so they only read
+        // the borders of tiles that are idle during the phase and can be integrated concurrently.
+        int32 Step = 0;
+        while (true)
+        {
+                bool bAnyTileActive = false;
+                for (int32 Color = 0; Color < 4; ++Color)
+                {
+                        if (bCancelRequested && bCancelRequested->load(std::memory_order_relaxed))
+                        {
+                                return false;
+                        }
+
+                        ActiveTiles.Reset();
+                        for (int32 TileY = Color / 2; TileY < TilesY; TileY += 2)
+                        {
+                                for (int32 TileX = Color % 2; TileX < TilesX; TileX += 2)
+                                {
+                                        if (IsTileActive(TileX, TileY))
+                                        {
+                                                ActiveTiles.Add(TileY * TilesX + TileX);
+                                        }
+                                }
+                        }
+
+                        if (ActiveTiles.Num() == 0)
+                        {
+                                continue;
+                        }
+
+                        bAnyTileActive = true;
+                        ++Step;
+
+                        ParallelForWithTaskContext(TileOpenLists, ActiveTiles.Num(), [this, Step](FFlowFieldBinaryHeap& OpenList, int32 ActiveIndex)
+                        {
+                                IntegrateTile(ActiveTiles[ActiveIndex], Step, OpenList);
+                        });
+                }
+
+                if (!bAnyTileActive)
+                {
+                        break;
+                }
+        }
+
+        return true;
+}
+
+void FFlowField::IntegrateTile(int32 TileIndex, int32 Step, FFlowFieldBinaryHeap& OpenList)
+{
+        const int32 GridX = Settings.GridSize.X;
+        const int32 GridY = Settings.GridSize.Y;
+        const int32 TilesX = FMath::DivideAndRoundUp(GridX, IntegrationTileSize);
+        const int32 NumOffsets = Settings.bAllowDiagonal ? FlowFieldIntegration::NumNeighborOffsets : FlowFieldIntegration::NumCardinalOffsets;
+
+        const int32 MinX = (TileIndex % TilesX) * IntegrationTileSize;
+        const int32 MinY = (TileIndex / TilesX) * IntegrationTileSize;
+        const int32 MaxX = FMath::Min(MinX + IntegrationTileSize, GridX);
+        const int32 MaxY = FMath::Min(MinY + IntegrationTileSize, GridY);
+
+        float* RESTRICT Integration = IntegrationField.GetData();
+        const uint8* RESTRICT Weights = GetIntegrationWeights().GetData();
+        OpenList.Reset(0);
+
+        auto IsInsideTile = [MinX, MinY, MaxX, MaxY](int32 CellX, int32 CellY)
+        {
+                return CellX >= MinX && CellY >= MinY && CellX < MaxX && CellY < MaxY;
+        };
+
+        auto IsTileBorder = [MinX, MinY, MaxX, MaxY](int32 CellX, int32 CellY)
+        {
+                return CellX == MinX || CellY == MinY || CellX == MaxX - 1 || CellY == MaxY - 1;
+        };
+
+        const bool bFirstVisit = TileVisitSteps[TileIndex] == 0;
+        TileVisitSteps[TileIndex] = Step;
+        bool bBorderChanged = false;
+
+        if (bFirstVisit)
+        {
+                // SourceCells is sorted, so the sources of each tile row form a contiguous run.
+                for (int32 CellY = MinY; CellY < MaxY; ++CellY)
+                {
+                        const int32 RowEnd = CellY * GridX + MaxX;
+                        for (int32 SourceIndex = Algo::LowerBound(SourceCells, CellY * GridX + MinX); SourceIndex < SourceCells.Num() && SourceCells[SourceIndex] < RowEnd; ++SourceIndex)
+                        {
+                                OpenList.Push(SourceCells[SourceIndex], 0.0f);
+                        }
+                }
+        }
+
+        // Inflow from the cells around the tile, using the exact relaxation of the serial integration.
+        auto PullBorderCell = [&](int32 CellX, int32 CellY)
+        {
+                const int32 Index = CellY * GridX + CellX;
+                const uint8 Weight = Weights[Index];
+                if (Weight == 0)
+                {
+                        return;
+                }
+
+                float BestCost = Integration[Index];
+                for (int32 OffsetIndex = 0; OffsetIndex < NumOffsets; ++OffsetIndex)
+                {
+                        const int32 SourceX = CellX - NeighborOffsets[OffsetIndex].X;
+                        const int32 SourceY = CellY - NeighborOffsets[OffsetIndex].Y;
+                        if (SourceX < 0 || SourceY < 0 || SourceX >= GridX || SourceY >= GridY || IsInsideTile(SourceX, SourceY))
+                        {
+                                continue;
+                        }
+
+                        const float SourceCost = Integration[SourceY * GridX + SourceX];
+                        if (SourceCost < InvalidCost)
+                        {
+                                const float TraversalCost = OffsetIndex < FlowFieldIntegration::NumCardinalOffsets ? StepCosts.Cardinal[Weight] : StepCosts.Diagonal[Weight];
+                                BestCost = FMath::Min(BestCost, SourceCost + TraversalCost);
+                        }
+                }
+
+                if (BestCost < Integration[Index])
+                {
+                        Integration[Index] = BestCost;
+                        OpenList.Push(Index, BestCost);
+                        bBorderChanged = true;
+                }
+        };
+
+        for (int32 CellX = MinX; CellX < MaxX; ++CellX)
+        {
+                PullBorderCell(CellX, MinY);
+                if (MaxY - 1 > MinY)
+                {
+                        PullBorderCell(CellX, MaxY - 1);
+                }
+        }
+
+        for (int32 CellY = MinY + 1; CellY < MaxY - 1; ++CellY)
+        {
+                PullBorderCell(MinX, CellY);
+                if (MaxX - 1 > MinX)
+                {
+                        PullBorderCell(MaxX - 1, CellY);
+                }
+        }
+
+        FFlowFieldOpenCell Current;
+        while (OpenList.Pop(Current))
+        {
+                const float RecordedCost = Integration[Current.Index];
+                if (Current.Cost > RecordedCost)
+                {
+                        continue;
+                }
+
+                const int32 CurrentX = Current.Index % GridX;
+                const int32 CurrentY = Current.Index / GridX;
+                for (int32 OffsetIndex = 0; OffsetIndex < NumOffsets; ++OffsetIndex)
+                {
+                        const int32 NeighborX = CurrentX + NeighborOffsets[OffsetIndex].X;
+                        const int32 NeighborY = CurrentY + NeighborOffsets[OffsetIndex].Y;
+                        if (!IsInsideTile(NeighborX, NeighborY))
+                        {
+                                continue;
+                        }
+
+                        const int32 NeighborIndex = NeighborY * GridX + NeighborX;
+                        const uint8 Weight = Weights[NeighborIndex];
+                        if (Weight == 0)
+                        {
+                                continue;
+                        }
+
+                        const float TraversalCost = OffsetIndex < FlowFieldIntegration::NumCardinalOffsets ? StepCosts.Cardinal[Weight] : StepCosts.Diagonal[Weight];
+                        const float NewCost = RecordedCost + TraversalCost;
+                        if (NewCost < Integration[NeighborIndex])
+                        {
+                                Integration[NeighborIndex] = NewCost;
+                                OpenList.Push(NeighborIndex, NewCost);
+                                bBorderChanged |= IsTileBorder(NeighborX, NeighborY);
+                        }
+                }
+        }
+
+        if (bBorderChanged)
+        {
+                TileChangeSteps[TileIndex] = Step;
+        }
+}
+
+bool FFlowField::CanRepairInPlace() const
+{
+        // Quantised and fast marching costs cannot tell which cells derive from the dirty ones, so those fields are rebuilt.
+        // So are bounded fields, whose partial integration is no fixpoint and which are cheap to redo anyway.
+        return !bBoundedBuild && !Settings.bCompactStorage && Settings.IntegrationMethod != EFlowFieldIntegrationMethod::FastMarching;
+}
+
+bool FFlowField::MarkCellsDirty(TConstArrayView<FIntRect> DirtyRegions)
+{
+        const int32 GridX = Settings.GridSize.X;
+        const int32 GridY = Settings.GridSize.Y;
+        const int32 CellCount = GridX * GridY;
+        if (SourceCells.Num() == 0 || (IntegrationField.Num() != CellCount && CompactIntegration.Num() != CellCount))
+        {
+                return false;
+        }
+
+        // Blocked goals stop being sources and are invalidated like any other dirty cell; unblocked ones are seeded again.
+        const uint8* RESTRICT Weights = GetIntegrationWeights().GetData();
+        SourceCells = GoalIndices;
+        SourceCells.RemoveAll([Weights](int32 Index) { return Weights[Index] == 0; });
+        if (SourceCells.Num() == 0)
+        {
+                EmptyFields();
+                Destination = FIntPoint(-1, -1);
+                return false;
+        }
+
+        Destination = FIntPoint(SourceCells[0] % GridX, SourceCells[0] / GridX);
+
+        // The settled part of a running resumable build may depend on the old weights.
+        if (IsBuildInProgress())
+        {
+                RestartResumableBuild();
+                return true;
+        }
+
+        if (!CanRepairInPlace())
+        {
+                return BuildFromSources(nullptr);
+        }
+
+        StepCosts.Build(Settings);
+
+        float* RESTRICT Integration = IntegrationField.GetData();
+
+        RepairMarks.Init(false, CellCount);
+        RepairCells.Reset();
+        RepairChangedCells.Reset();
+
+        for (const FIntRect& DirtyRegion : DirtyRegions)
+        {
+                FIntRect Region = DirtyRegion;
+                Region.Clip(FIntRect(FIntPoint::ZeroValue, Settings.GridSize));
+                for (int32 CellY = Region.Min.Y; CellY < Region.Max.Y; ++CellY)
+                {
+                        for (int32 CellX = Region.Min.X; CellX < Region.Max.X; ++CellX)
+                        {
+                                const int32 Index = CellY * GridX + CellX;
+                                if (!RepairMarks[Index] && !IsSourceCell(Index))
+                                {
+                                        RepairMarks[Index] = true;
+                                        RepairCells.Add(Index);
+                                }
+                        }
+                }
+        }
+
+        const int32 NumOffsets = Settings.bAllowDiagonal ? FlowFieldIntegration::NumNeighborOffsets : FlowFieldIntegration::NumCardinalOffsets;
+
+        // Costs can only rise for the dirty cells and the cells whose cost was derived from them, directly or not.
+        // A neighbour is derived from a cell when its recorded cost equals the cell's cost plus the step into it; the
+        // closure over that relation is collected while every cost still holds its previous value.
+        for (int32 CellIndex = 0; CellIndex < RepairCells.Num(); ++CellIndex)
+        {
+                const int32 Index = RepairCells[CellIndex];
+                const float Cost = Integration[Index];
+                if (Cost >= InvalidCost)
+                {
+                        continue;
+                }
+
+                const int32 CellX = Index % GridX;
+                const int32 CellY = Index / GridX;
+                for (int32 OffsetIndex = 0; OffsetIndex < NumOffsets; ++OffsetIndex)
+                {
+                        const int32 NeighborX = CellX + NeighborOffsets[OffsetIndex].X;
+                        const int32 NeighborY = CellY + NeighborOffsets[OffsetIndex].Y;
+                        if (NeighborX < 0 || NeighborY < 0 || NeighborX >= GridX || NeighborY >= GridY)
+                        {
+                                continue;
+                        }
+
+                        const int32 NeighborIndex = NeighborY * GridX + NeighborX;
+                        const uint8 Weight = Weights[NeighborIndex];
+                        if (Weight == 0 || RepairMarks[NeighborIndex] || IsSourceCell(NeighborIndex))
+                        {
+                                continue;
+                        }
+
+                        const float TraversalCost = OffsetIndex < FlowFieldIntegration::NumCardinalOffsets ? StepCosts.Cardinal[Weight] : StepCosts.Diagonal[Weight];
+                        if (Integration[NeighborIndex] == Cost + TraversalCost)
+                        {
+                                RepairMarks[NeighborIndex] = true;
+                                RepairCells.Add(NeighborIndex);
+                        }
+                }
+        }
+
+        for (const int32 Index : RepairCells)
+        {
+                Integration[Index] = InvalidCost;
+        }
+
+        // Seed every invalidated cell from its intact neighbours, then let Dijkstra settle the invalidated cells and
+        // propagate any cost that dropped below its previous value (cheaper or unblocked cells).
+        HeapOpenList.Reset(RepairCells.Num());
+        for (const int32 Index : RepairCells)
+        {
+                const uint8 Weight = Weights[Index];
+                if (Weight == 0)
+                {
+                        continue;
+                }
+
+                const int32 CellX = Index % GridX;
+                const int32 CellY = Index / GridX;
+                float BestCost = InvalidCost;
+                for (int32 OffsetIndex = 0; OffsetIndex < NumOffsets; ++OffsetIndex)
+                {
+                        const int32 NeighborX = CellX - NeighborOffsets[OffsetIndex].X;
+                        const int32 NeighborY = CellY - NeighborOffsets[OffsetIndex].Y;
+                        if (NeighborX < 0 || NeighborY < 0 || NeighborX >= GridX || NeighborY >= GridY)
+                        {
+                                continue;
+                        }
+
+                        const float NeighborCost = Integration[NeighborY * GridX + NeighborX];
+                        if (NeighborCost < InvalidCost)
+                        {
+                                const float TraversalCost = OffsetIndex < FlowFieldIntegration::NumCardinalOffsets ? StepCosts.Cardinal[Weight] : StepCosts.Diagonal[Weight];
+                                BestCost = FMath::Min(BestCost, NeighborCost + TraversalCost);
+                        }
+                }
+
+                if (BestCost < InvalidCost)
+                {
+                        Integration[Index] = BestCost;
+                        HeapOpenList.Push(Index, BestCost);
+                }
+        }
+
+        for (const int32 Index : SourceCells)
+        {
+                if (Integration[Index] != 0.0f)
+                {
+                        Integration[Index] = 0.0f;
+                        HeapOpenList.Push(Index, 0.0f);
+                        RepairChangedCells.Add(Index);
+                }
+        }
+
+        // Seeds span arbitrary costs, which the bucket queue cannot order, so repairs always use the heap.
+        Integrate(HeapOpenList, nullptr, &RepairChangedCells);
+
+        // A direction depends on the cell and its neighbours, so refresh every touched cell and its surroundings.
+        RepairMarks.Init(false, CellCount);
+        auto MarkDirectionDirty = [this, GridX, GridY](int32 Index)
+        {
+                const int32 CellX = Index % GridX;
+                const int32 CellY = Index / GridX;
+                for (int32 NeighborY = FMath::Max(CellY - 1, 0); NeighborY <= FMath::Min(CellY + 1, GridY - 1); ++NeighborY)
+                {
+                        for (int32 NeighborX = FMath::Max(CellX - 1, 0); NeighborX <= FMath::Min(CellX + 1, GridX - 1); ++NeighborX)
+                        {
+                                RepairMarks[NeighborY * GridX + NeighborX] = true;
+                        }
+                }
+        };
+
+        for (const int32 Index : RepairCells)
+        {
+                MarkDirectionDirty(Index);
+        }
+
+        for (const int32 Index : RepairChangedCells)
+        {
+                MarkDirectionDirty(Index);
+        }
+
+        for (TConstSetBitIterator<> It(RepairMarks); It; ++It)
+        {
+                ResolveCellDirection(It.GetIndex());
+        }
+
+        return true;
+}
+
+bool FFlowField::UpdateWeightsInRegion(const FIntRect& Region, TConstArrayView<uint8> RegionWeights)
+{
+        const bool bInsideGrid = Region.Min.X >= 0 && Region.Min.Y >= 0 && Region.Max.X <= Settings.GridSize.X && Region.Max.Y <= Settings.GridSize.Y;
+        if (!ensureMsgf(bInsideGrid && RegionWeights.Num() == Region.Area(), TEXT("Traversal weight region does not match grid dimensions")))
+        {
+                return false;
+        }
+
+        // Weights shared with other fields are copied before writing, a private buffer is written in place.
+        TSharedPtr<TArray<uint8>> NewWeights = TraversalWeights.IsUnique() ? ConstCastSharedPtr<TArray<uint8>>(TraversalWeights) : MakeShared<TArray<uint8>>(*TraversalWeights);
+        const int32 RegionWidth = Region.Width();
+        for (int32 Row = 0; Row < Region.Height(); ++Row)
+        {
+                FMemory::Memcpy(NewWeights->GetData() + (Region.Min.Y + Row) * Settings.GridSize.X + Region.Min.X, RegionWeights.GetData() + Row * RegionWidth, RegionWidth);
+        }
+
+        TraversalWeights = NewWeights;
+
+        // Clearance changes reach MaxClearance cells past the region, so the repair has to cover them as well.
+        FIntRect DirtyRegion = Region;
+        if (Clearance.IsValid())
+        {
+                TSharedPtr<FFlowFieldClearance> NewClearance = Clearance.IsUnique() ? ConstCastSharedPtr<FFlowFieldClearance>(Clearance) : MakeShared<FFlowFieldClearance>(*Clearance);
+                DirtyRegion = NewClearance->UpdateRegion(*NewWeights, Region);
+                Clearance = NewClearance;
+        }
+
+        return MarkCellsDirty(DirtyRegion);
+}
+
+FVector2D FFlowField::GetDirectionForCell(const FIntPoint& Cell) const
+{
+        const int32 Index = ToLinearIndex(Cell);
+        if (IsBuildInProgress())
+        {
+                return Index != INDEX_NONE ? GetDirectionDuringBuild(Index) : FVector2D::ZeroVector;
+        }
+
+        if (Settings.bCompactStorage)
+        {
+                return CompactDirections.IsValidIndex(Index) ? GetDirectionDecodeTable()[CompactDirections[Index]] : FVector2D::ZeroVector;
+        }
+
+        if (!DirectionField.IsValidIndex(Index))
+        {
+                return FVector2D::ZeroVector;
+        }
+
+        return DirectionField[Index];
+}
+
+FIntPoint FFlowField::WorldToCell(const FVector& WorldPosition) const
+{
+        const FVector Local = WorldPosition - Settings.Origin;
+        const int32 X = FMath::FloorToInt(Local.X / Settings.CellSize);
+        const int32 Y = FMath::FloorToInt(Local.Y / Settings.CellSize);
+        return FIntPoint(X, Y);
+}
+
+FVector FFlowField::CellToWorld(const FIntPoint& Cell) const
+{
+        return Settings.Origin + FVector((Cell.X + 0.5f) * Settings.CellSize, (Cell.Y + 0.5f) * Settings.CellSize, 0.0f);
+}
+
+FVector FFlowField::GetDirectionForWorldPosition(const FVector& WorldPosition) const
+{
+        return FVector(GetDirectionForCell(WorldToCell(WorldPosition)), 0.0f);
+}
+
+void FFlowField::SampleDirections(TConstArrayView<FVector> WorldPositions, TArrayView<FVector> OutDirections) const
+{
+        if (!ensureMsgf(OutDirections.Num() >= WorldPositions.Num(), TEXT("Flow field sample output is smaller than the input")))
+        {
+                return;
+        }
+
+        const int32 GridX = Settings.GridSize.X;
+        if (IsBuildInProgress())
+        {
+                FlowFieldIntegration::SampleDirectionsBilinear(Settings.Origin, Settings.CellSize, Settings.GridSize, WorldPositions, OutDirections, [this, GridX](int32 X, int32 Y)
+                {
+                        return GetDirectionDuringBuild(Y * GridX + X);
+                });
+        }
+        else if (Settings.bCompactStorage && CompactDirections.Num() == GridX * Settings.GridSize.Y)
+        {
+                const uint8* Codes = CompactDirections.GetData();
+                const FVector2D* DecodeTable = GetDirectionDecodeTable();
+                FlowFieldIntegration::SampleDirectionsBilinear(Settings.Origin, Settings.CellSize, Settings.GridSize, WorldPositions, OutDirections, [Codes, DecodeTable, GridX](int32 X, int32 Y)
+                {
+                        return DecodeTable[Codes[Y * GridX + X]];
+                });
+        }
+        else if (!Settings.bCompactStorage && DirectionField.Num() == GridX * Settings.GridSize.Y)
+        {
+                const FVector2D* Directions = DirectionField.GetData();
+                FlowFieldIntegration::SampleDirectionsBilinear(Settings.Origin, Settings.CellSize, Settings.GridSize, WorldPositions, OutDirections, [Directions, GridX](int32 X, int32 Y)
+                {
+                        return Directions[Y * GridX + X];
+                });
+        }
+        else
+        {
+                for (int32 Index = 0; Index < WorldPositions.Num(); ++Index)
+                {
+                        OutDirections[Index] = FVector::ZeroVector;
+                }
+        }
+}
+
+float FFlowField::GetIntegrationCost(int32 Index) const
+{
+        if (Settings.bCompactStorage && !IsBuildInProgress())
+        {
+                if (!CompactIntegration.IsValidIndex(Index))
+                {
+                        return InvalidCost;
+                }
+
+                const uint16 Code = CompactIntegration[Index];
+                return Code == UnreachedIntegrationCode ? InvalidCost : Code * CompactIntegrationStep;
+        }
+
+        return IntegrationField.IsValidIndex(Index) ? IntegrationField[Index] : InvalidCost;
+}
+
+FFlowFieldDebugSnapshot::FFlowFieldDebugSnapshot(const TSharedPtr<const FFlowField>& InField)
+        : Field(InField)
+{
+        if (Field.IsValid())
+        {
+                const FFlowFieldSettings& FieldSettings = Field->GetSettings();
+                GridSize = FieldSettings.GridSize;
+                CellSize = FieldSettings.CellSize;
+                Origin = FieldSettings.Origin;
+                Destination = Field->GetDestination();
+        }
+}
+
+FVector2D FFlowFieldDebugSnapshot::GetDirection(int32 Index) const
+{
+        return Field.IsValid() && GridSize.X > 0 ? Field->GetDirectionForCell(FIntPoint(Index % GridSize.X, Index / GridSize.X)) : FVector2D::ZeroVector;
+}
+
+float FFlowFieldDebugSnapshot::GetIntegrationCost(int32 Index) const
+{
+        return Field.IsValid() ? Field->GetIntegrationCost(Index) : InvalidCost;
+}
+
+bool FFlowFieldDebugSnapshot::IsWalkable(int32 Index) const
+{
+        return Field.IsValid() && GridSize.X > 0 && Field->IsWalkable(FIntPoint(Index % GridSize.X, Index / GridSize.X));
+}
+
+SIZE_T FFlowField::GetAllocatedSize() const
+{
+        SIZE_T TileOpenListsSize = TileOpenLists.GetAllocatedSize();
+        for (const FFlowFieldBinaryHeap& OpenList : TileOpenLists)
+        {
+                TileOpenListsSize += OpenList.GetAllocatedSize();
+        }
+
+        return IntegrationField.GetAllocatedSize() + DirectionField.GetAllocatedSize() + AcceptedCells.GetAllocatedSize()
+                + TileVisitSteps.GetAllocatedSize() + TileChangeSteps.GetAllocatedSize() + ActiveTiles.GetAllocatedSize() + TileOpenListsSize
+                + CompactDirections.GetAllocatedSize() + CompactIntegration.GetAllocatedSize()
+                + HeapOpenList.GetAllocatedSize() + BucketOpenList.GetAllocatedSize()
+                + TouchedCells.GetAllocatedSize() + BoundedQueryCells.GetAllocatedSize() + QueryMarks.GetAllocatedSize();
+}
+
+int32 FFlowField::ToLinearIndex(const FIntPoint& Cell) const
+{
+        if (!IsCellValid(Cell))
+        {
+                return INDEX_NONE;
+        }
+
+        return Cell.Y * Settings.GridSize.X + Cell.X;
+}
+
+bool FFlowField::IsCellValid(const FIntPoint& Cell) const
+{
+        return Cell.X >= 0 && Cell.Y >= 0 && Cell.X < Settings.GridSize.X && Cell.Y < Settings.GridSize.Y;
+}
+
+void FFlowField::ResetFields()
+{
+        const int32 CellCount = Settings.GridSize.X * Settings.GridSize.Y;
+
+        // Compact fields release their float buffer after each build, so only full precision fields take the sparse path.
+        if (bSparseFields && IntegrationField.Num() == CellCount && DirectionField.Num() == CellCount)
+        {
+                for (const int32 Index : TouchedCells)
+                {
+                        IntegrationField[Index] = InvalidCost;
+                        DirectionField[Index] = FVector2D::ZeroVector;
+                }
+        }
+        else if (Settings.bCompactStorage)
+        {
+                IntegrationField.Init(InvalidCost, CellCount);
+                CompactDirections.Init(0, CellCount);
+                CompactIntegration.Empty();
+        }
+        else
+        {
+                IntegrationField.Init(InvalidCost, CellCount);
+                DirectionField.Init(FVector2D::ZeroVector, CellCount);
+        }
+
+        TouchedCells.Reset();
+        bSparseFields = false;
+        ResumePhase = EResumePhase::None;
+}
+
+void FFlowField::EmptyFields()
+{
+        IntegrationField.Empty();
+        DirectionField.Empty();
+        CompactDirections.Empty();
+        CompactIntegration.Empty();
+        CompactIntegrationStep = 0.0f;
+        TouchedCells.Empty();
+        bSparseFields = false;
+        ResumePhase = EResumePhase::None;
+}
+
+void FFlowField::BeginCompactIntegration(float MaxCost)
+{
+        CompactIntegrationStep = MaxCost > 0.0f ? MaxCost / (UnreachedIntegrationCode - 1) : 1.0f;
+        CompactIntegration.SetNumUninitialized(IntegrationField.Num());
+}
+
+void FFlowField::CompactIntegrationRange(int32 FirstIndex, int32 EndIndex)
+{
+        const float InvStep = 1.0f / CompactIntegrationStep;
+        for (int32 Index = FirstIndex; Index < EndIndex; ++Index)
+        {
+                const float Cost = IntegrationField[Index];
+                CompactIntegration[Index] = Cost < InvalidCost
+                        ? static_cast<uint16>(FMath::Min(FMath::RoundToInt32(Cost * InvStep), UnreachedIntegrationCode - 1))
+                        : UnreachedIntegrationCode;
+        }
+}
+
+void FFlowField::FinishCompactStorage()
+{
+        IntegrationField.Empty();
+
+        // Compact fields favour memory over rebuild speed, the open lists can be as large as the field itself.
+        HeapOpenList = FFlowFieldBinaryHeap();
+        BucketOpenList = FFlowFieldBucketQueue();
+        AcceptedCells.Empty();
+        TileOpenLists.Empty();
+}
+
+void FFlowField::RebuildFlowDirections()
+{
+        // Rows write disjoint cells, so they are resolved concurrently.
+        const int32 NumCells = Settings.GridSize.X * Settings.GridSize.Y;
+        ParallelFor(Settings.GridSize.Y, [this](int32 Row) { ResolveDirectionRow(Row); }, NumCells < ParallelDirectionMinCells ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+}
+
+void FFlowField::ResolveDirectionRow(int32 Row)
+{
+        const int32 GridX = Settings.GridSize.X;
+        const int32 RowStart = Row * GridX;
+        if (Row == 0 || Row == Settings.GridSize.Y - 1 || GridX < 3)
+        {
+                for (int32 Index = RowStart; Index < RowStart + GridX; ++Index)
+                {
+                        ResolveCellDirection(Index);
+                }
+
+                return;
+        }
+
+        // Only the first and last cells of an interior row have neighbours outside the grid.
+        ResolveCellDirection(RowStart);
+        ResolveCellDirection(RowStart + GridX - 1);
+
+        float DirectionX[DirectionChunkSize];
+        float DirectionY[DirectionChunkSize];
+        for (int32 ChunkStart = RowStart + 1; ChunkStart < RowStart + GridX - 1; ChunkStart += DirectionChunkSize)
+        {
+                const int32 NumChunkCells = FMath::Min(DirectionChunkSize, RowStart + GridX - 1 - ChunkStart);
+                FlowFieldIntegration::ResolveInteriorDirections(IntegrationField.GetData() + ChunkStart, GridX, NumChunkCells, Settings.bAllowDiagonal, Settings.bSmoothDirections, DirectionX, DirectionY);
+
+                for (int32 Cell = 0; Cell < NumChunkCells; ++Cell)
+                {
+                        StoreCellDirection(ChunkStart + Cell, FVector2D(DirectionX[Cell], DirectionY[Cell]));
+                }
+        }
+}
+
+void FFlowField::ResolveCellDirection(int32 Index)
+{
+        StoreCellDirection(Index, ComputeCellDirection(Index));
+}
+
+FVector2D FFlowField::ComputeCellDirection(int32 Index) const
+{
+        if (IntegrationField[Index] >= InvalidCost)
+        {
+                return FVector2D::ZeroVector;
+        }
+
+        const int32 NumOffsets = Settings.bAllowDiagonal ? FlowFieldIntegration::NumNeighborOffsets : FlowFieldIntegration::NumCardinalOffsets;
+        float NeighborCosts[FlowFieldIntegration::NumNeighborOffsets];
+
+        const FIntPoint Cell(Index % Settings.GridSize.X, Index / Settings.GridSize.X);
+        for (int32 OffsetIndex = 0; OffsetIndex < NumOffsets; ++OffsetIndex)
+        {
+                const int32 NeighborIndex = ToLinearIndex(Cell + NeighborOffsets[OffsetIndex]);
+                NeighborCosts[OffsetIndex] = NeighborIndex != INDEX_NONE ? IntegrationField[NeighborIndex] : InvalidCost;
+        }
+
+        return FlowFieldIntegration::ResolveDirection(IntegrationField[Index], NeighborCosts, NumOffsets, Settings.bSmoothDirections);
+}
+
+FVector2D FFlowField::GetStoredDirection(int32 Index) const
+{
+        return Settings.bCompactStorage ? GetDirectionDecodeTable()[CompactDirections[Index]] : DirectionField[Index];
+}
+
+void FFlowField::StoreCellDirection(int32 Index, const FVector2D& Direction)
+{
+        if (Settings.bCompactStorage)
+        {
+                CompactDirections[Index] = EncodeDirection(Direction);
+        }
+        else
+        {
+                DirectionField[Index] = Direction;
         }
 }
@@ -2,6 +2,38 @@
 
 #include "CoreMinimal.h"
 
+#include "FlowFieldIntegration.h"
+
+#include <atomic>
+
+#include "FlowField.generated.h"
+
+class FFlowFieldClearance;
+
+/** Open list implementation used to integrate the flow field. */
+UENUM(BlueprintType)
+enum class EFlowFieldIntegrationMethod : uint8
+{
+        /** Dijkstra driven by a binary heap. Works with any cost configuration. */
+        BinaryHeap,
+
+        /** Dial bucket queue exploiting the quantised uint8 weights. Falls back to the binary heap when the step cost range is too wide. */
+        BucketQueue,
+
+        /**
+         * Fast marching solve of the eikonal equation on the cardinal stencil. Costs approximate any angle geodesic
+         * distances instead of 8-connected path lengths, which removes the 45 degree banding. The diagonal settings are
+         * ignored, and MarkCellsDirty rebuilds instead of repairing. Hierarchical fields keep using Dijkstra.
+         */
+        FastMarching,
+
+        /**
+         * Dijkstra split into square tiles integrated concurrently. Tiles exchange their border costs until no tile changes,
+         * converging to exactly the same integration field as the serial methods; build time scales with the cores.
+         */
+        ParallelTiles
+};
+
 /**
  * Settings used to build a flow field.
  */
@@ -45,14 +77,63 @@ struct PLUGINSDEVELOPMENT_API FFlowFieldSettings
 
         /** When true, the flow field will smooth the generated directions. */
         bool bSmoothDirections = true;
+
+        /** Integration used by Build. The heap and the bucket queue produce identical integration fields. */
+        EFlowFieldIntegrationMethod IntegrationMethod = EFlowFieldIntegrationMethod::BucketQueue;
+
+        /**
+         * Stores built fields as one byte per cell direction code and a uint16 quantised integration value, 3 bytes per
+         * cell instead of 20. The float integration buffer only lives for the duration of a build, and MarkCellsDirty
+         * falls back to a full rebuild since it needs the exact costs.
+         */
+        bool bCompactStorage = false;
+
+        /**
+         * Clearance, in cells, the agents following the field need (see FFlowFieldClearance). Cells narrower than this are
+         * treated as blocked, using the weights of the matching size class of the shared clearance layer. 0 and 1 treat
+         * agents as points and ignore the layer. Hierarchical fields ignore it.
+         */
+        int32 MinClearance = 0;
+};
+
+/** Limits of a bounded build, see FFlowField::BuildBounded. */
+struct PLUGINSDEVELOPMENT_API FFlowFieldBuildBounds
+{
+        /**
+         * Cells the field will be sampled at, e.g. the cells of the agents about to move. The integration stops as soon as
+         * every walkable one is settled. Empty to only stop on the other bounds.
+         */
+        TArray<FIntPoint> QueryCells;
+
+        /** Cells costing more than this are left unreached. */
+        float MaxCost = TNumericLimits<float>::Max();
+
+        /**
+         * Keeps the integration, paths included, inside the bounding rectangle of the goals grown by this many cells.
+         * 0 disables the bound.
+         */
+        int32 MaxRadius = 0;
 };
 
-/** Debug snapshot of a flow field that can be inspected or visualised. */
+class FFlowField;
+
+/**
+ * Debug view of a flow field that can be inspected or visualised. It shares the buffers of the field instead of copying them,
+ * so taking one is free, and it keeps the field alive while it is held. Repairs applied in place to the field show through.
+ */
 struct PLUGINSDEVELOPMENT_API FFlowFieldDebugSnapshot
 {
-        TArray<float> IntegrationField;
-        TArray<FVector2D> DirectionField;
-        TArray<uint8> WalkableField;
+        FFlowFieldDebugSnapshot() = default;
+        explicit FFlowFieldDebugSnapshot(const TSharedPtr<const FFlowField>& InField);
+
+        bool IsValid() const { return Field.IsValid(); }
+
+        /** Per cell accessors, Index being the row-major index of the cell. */
+        FVector2D GetDirection(int32 Index) const;
+        float GetIntegrationCost(int32 Index) const;
+        bool IsWalkable(int32 Index) const;
+
+        TSharedPtr<const FFlowField> Field;
         FIntPoint GridSize = FIntPoint::ZeroValue;
         float CellSize = 100.f;
         FVector Origin = FVector::ZeroVector;
@@ -75,16 +156,99 @@ public:
          */
         void SetTraversalWeights(const TArray<uint8>& InWeights);
 
+        /** Same as SetTraversalWeights but shares the supplied buffer instead of copying it. Copies of the field share it as well. */
+        void SetSharedTraversalWeights(const TSharedPtr<const TArray<uint8>>& InWeights);
+
+        /** Returns the traversal weights buffer, shared with every field it was handed to. */
+        const TSharedPtr<const TArray<uint8>>& GetSharedTraversalWeights() const { return TraversalWeights; }
+
+        /**
+         * Shares a clearance layer built from the current traversal weights, letting fields of every size class reuse the
+         * same base data. Builds only use it when Settings.MinClearance is above 1.
+         */
+        void SetSharedClearance(const TSharedPtr<const FFlowFieldClearance>& InClearance);
+        const TSharedPtr<const FFlowFieldClearance>& GetSharedClearance() const { return Clearance; }
+
+        /** Changes the size class built by the next Build without touching the other settings or the shared data. */
+        void SetMinClearance(int32 InMinClearance) { Settings.MinClearance = InMinClearance; }
+
         /** Returns the current settings. */
         const FFlowFieldSettings& GetSettings() const { return Settings; }
 
-        /** Returns true if the given cell is walkable. */
+        /** First goal cell of the last build, (-1, -1) when nothing is built. */
+        const FIntPoint& GetDestination() const { return Destination; }
+
+        /** Returns true if the given cell is walkable for the size class of the field. */
         bool IsWalkable(const FIntPoint& Cell) const;
 
-        /** Builds the flow field given the destination cell. Returns false if the destination is invalid or blocked. */
-        bool Build(const FIntPoint& DestinationCell);
+        /**
+         * Builds the flow field given the destination cell. Returns false if the destination is invalid or blocked.
+         * Safe to call from a worker thread on a field nobody else samples. When bCancelRequested is raised during the
+         * build, integration stops early and Build returns false, leaving the field partially built.
+         */
+        bool Build(const FIntPoint& DestinationCell, const std::atomic<bool>* bCancelRequested = nullptr);
+
+        /**
+         * Same as Build with several goal cells integrated at once, e.g. a formation footprint or every cell around a
+         * building: each cell leads to its closest goal, for the cost of a single build. Invalid and blocked goals are
+         * skipped; returns false if none is left.
+         */
+        bool BuildToCells(TConstArrayView<FIntPoint> GoalCells, const std::atomic<bool>* bCancelRequested = nullptr);
+
+        /**
+         * Same as BuildToCells but only integrates the region the bounds allow, so a short move costs its own area instead
+         * of the whole grid. Cells left unreached have no direction. The next build resets only the cells this one
+         * reached. Bounded builds always integrate with Dijkstra, the bucket queue when IntegrationMethod selects it and
+         * the binary heap otherwise, and MarkCellsDirty redoes them with the same bounds.
+         */
+        bool BuildBounded(TConstArrayView<FIntPoint> GoalCells, const FFlowFieldBuildBounds& Bounds, const std::atomic<bool>* bCancelRequested = nullptr);
+
+        /**
+         * Starts a resumable build towards the goal cells, advanced by Step a time slice at a time so no call costs more
+         * than its budget whatever the grid size. Until it completes, sampling returns the directions of the cells already
+         * settled and zero elsewhere. Like bounded builds, resumable builds integrate with Dijkstra. Any other build
+         * replaces it, and MarkCellsDirty restarts it. Returns false if no goal cell is walkable.
+         */
+        bool BeginBuild(TConstArrayView<FIntPoint> GoalCells);
+
+        /** Advances the build started by BeginBuild for about TimeBudgetMs. Returns true once the field is complete. */
+        bool Step(float TimeBudgetMs);
+
+        /** Returns true while a build started by BeginBuild has not completed. */
+        bool IsBuildInProgress() const { return ResumePhase != EResumePhase::None; }
 
-        /** Returns the direction (normalised) for the supplied cell. */
+        /** Fraction of the running resumable build done so far, 1 when none is running. */
+        float GetBuildProgress() const;
+
+        /** BuildToCells with every cell overlapping WorldBounds in XY. */
+        bool BuildToArea(const FBox& WorldBounds, const std::atomic<bool>* bCancelRequested = nullptr);
+
+        /** Cells overlapping WorldBounds in XY, clipped to the grid. */
+        FIntRect WorldBoundsToCellRect(const FBox& WorldBounds) const;
+
+        /**
+         * Repairs the integration and direction fields after the traversal weights inside the supplied regions changed
+         * through SetTraversalWeights or SetSharedTraversalWeights. Weights outside the regions must be unchanged since the
+         * last Build or repair. Only the cells whose cost depends on the regions are re-integrated, and the result is
+         * identical to a from-scratch Build. Goals that became blocked stop attracting agents until they are walkable
+         * again; returns false, leaving the field empty, if every goal became blocked or nothing was built yet.
+         */
+        bool MarkCellsDirty(TConstArrayView<FIntRect> DirtyRegions);
+        bool MarkCellsDirty(const FIntRect& DirtyRegion) { return MarkCellsDirty(MakeArrayView(&DirtyRegion, 1)); }
+
+        /**
+         * Whether MarkCellsDirty repairs the field in place. Compact, fast marching and bounded fields are rebuilt by it
+         * instead, on the calling thread, so owners of such fields rather rebuild them off the game thread.
+         */
+        bool CanRepairInPlace() const;
+
+        /**
+         * Writes RegionWeights (row-major over Region) into the traversal weights and repairs the field. Region must lie
+         * inside the grid. Weights and clearance shared with other fields are copied first, private ones are written in place.
+         */
+        bool UpdateWeightsInRegion(const FIntRect& Region, TConstArrayView<uint8> RegionWeights);
+
+        /** Returns the direction (normalised) for the supplied cell. Compact fields decode it from its direction code. */
         FVector2D GetDirectionForCell(const FIntPoint& Cell) const;
 
         /** Converts a world position into a cell coordinate. */
@@ -96,19 +260,166 @@ public:
         /** Samples the flow field direction for a given world position. */
         FVector GetDirectionForWorldPosition(const FVector& WorldPosition) const;
 
-        /** Creates a debug snapshot that can be visualised or logged. */
-        FFlowFieldDebugSnapshot CreateDebugSnapshot() const;
+        /**
+         * Samples the field at every position with bilinear interpolation, so directions no longer snap at cell borders.
+         * OutDirections must hold at least as many entries as WorldPositions.
+         */
+        void SampleDirections(TConstArrayView<FVector> WorldPositions, TArrayView<FVector> OutDirections) const;
+
+        /** Integration cost of the cell at the row-major Index, TNumericLimits<float>::Max() when it was not reached. */
+        float GetIntegrationCost(int32 Index) const;
+
+        /** Approximate memory owned by this field, excluding the shared traversal weights. */
+        SIZE_T GetAllocatedSize() const;
 
 private:
+        /** Phases of a resumable build. ResumeCursor walks the cells, or the rows, of the current phase. */
+        enum class EResumePhase : uint8
+        {
+                None,
+                Resetting,
+                Integrating,
+                ResolvingDirections,
+                Compacting
+        };
+
         int32 ToLinearIndex(const FIntPoint& Cell) const;
         bool IsCellValid(const FIntPoint& Cell) const;
         void ResetFields();
+        void EmptyFields();
+
+        /** Stores the valid goal cells and their walkable subset. Returns false, leaving the previous goals, if none is walkable. */
+        bool SetGoalCells(TConstArrayView<FIntPoint> GoalCells);
+
+        /** Integrates from the cells of SourceCells and resolves the directions. */
+        bool BuildFromSources(const std::atomic<bool>* bCancelRequested);
+        bool IsSourceCell(int32 Index) const;
+
+        /** Allocates the fields and restarts the resumable build from the current SourceCells. */
+        void RestartResumableBuild();
+
+        /** Direction of a cell while a resumable build runs, zero until it is settled. */
+        FVector2D GetDirectionDuringBuild(int32 Index) const;
+
+        /** Traversal weights of the size class of the field, the base weights unless a clearance class applies. */
+        const TArray<uint8>& GetIntegrationWeights() const;
         void RebuildFlowDirections();
+        void ResolveDirectionRow(int32 Row);
+
+        /** Scalar direction resolve with bounds checked neighbours, used for border cells and repairs. */
+        void ResolveCellDirection(int32 Index);
+        FVector2D ComputeCellDirection(int32 Index) const;
+        void StoreCellDirection(int32 Index, const FVector2D& Direction);
+        FVector2D GetStoredDirection(int32 Index) const;
+
+        /**
+         * Quantises the float integration buffer into CompactIntegration: Begin sizes it for costs up to MaxCost, Range
+         * encodes a span of cells, and Finish releases the float buffer and the open lists.
+         */
+        void BeginCompactIntegration(float MaxCost);
+        void CompactIntegrationRange(int32 FirstIndex, int32 EndIndex);
+        void FinishCompactStorage();
+
+        /**
+         * Runs Dijkstra from the already seeded open list until it is exhausted. Returns false if cancelled, or once
+         * IntegrationEndTime is passed with the open list left ready to resume.
+         * When ChangedCells is supplied, every cell whose cost is lowered is appended to it.
+         */
+        template <typename QueueType>
+        bool Integrate(QueueType& OpenList, const std::atomic<bool>* bCancelRequested, TArray<int32>* ChangedCells = nullptr);
+
+        /**
+         * Dijkstra from the already seeded open list, restricted to the bounds of the last BuildBounded and stopped once its
+         * query cells are settled. Every cell reached is appended to TouchedCells. Returns false if cancelled.
+         */
+        template <typename QueueType>
+        bool IntegrateBounded(QueueType& OpenList, const std::atomic<bool>* bCancelRequested);
+
+        /** Fast marching from the already seeded heap. Returns false if cancelled. */
+        bool IntegrateFastMarching(const std::atomic<bool>* bCancelRequested);
+
+        /** Tile parallel Dijkstra from the source cells. Returns false if cancelled. */
+        bool IntegrateTiles(const std::atomic<bool>* bCancelRequested);
+
+        /** Pulls the costs of the cells around the tile into its border and settles the tile. Called concurrently for tiles that do not touch. */
+        void IntegrateTile(int32 TileIndex, int32 Step, FFlowFieldBinaryHeap& OpenList);
 
         FFlowFieldSettings Settings;
+
+        /** Allocated by the first Build so fields that are only used to hold settings and weights stay cheap. */
         TArray<float> IntegrationField;
         TArray<FVector2D> DirectionField;
-        TArray<uint8> TraversalWeights;
+        TSharedPtr<const TArray<uint8>> TraversalWeights;
+        TSharedPtr<const FFlowFieldClearance> Clearance;
+
+        /**
+         * Compact storage, one array per component. A direction code of 0 means no direction, otherwise it encodes one of
+         * NumDirectionCodes evenly spaced angles. Integration codes scale by CompactIntegrationStep; MAX_uint16 is unreached.
+         */
+        TArray<uint8> CompactDirections;
+        TArray<uint16> CompactIntegration;
+        float CompactIntegrationStep = 0.0f;
+
+        /**
+         * Goal cells of the last build as sorted linear indices, and the walkable ones the integration starts from.
+         * Destination is the first source.
+         */
+        TArray<int32> GoalIndices;
+        TArray<int32> SourceCells;
         FIntPoint Destination = FIntPoint(-1, -1);
+
+        /** Bounds of the last build when it was a BuildBounded, query cells as linear indices inside BoundedRegion. */
+        bool bBoundedBuild = false;
+        FIntRect BoundedRegion;
+        float BoundedMaxCost = TNumericLimits<float>::Max();
+        TArray<int32> BoundedQueryCells;
+
+        /**
+         * Cells reached by the last bounded build. While bSparseFields is set every other cell still holds its reset
+         * values, so ResetFields only has to visit these.
+         */
+        TArray<int32> TouchedCells;
+        bool bSparseFields = false;
+
+        /** Query cells not settled yet, all clear between builds. */
+        TBitArray<> QueryMarks;
+
+        /** Resumable build state, see BeginBuild. */
+        EResumePhase ResumePhase = EResumePhase::None;
+        int32 ResumeCursor = 0;
+        bool bResumeWithBuckets = false;
+
+        /** Walkable cells counted by the reset phase and cells settled by Integrate, for GetBuildProgress. */
+        int32 NumWalkableCells = 0;
+        int32 NumSettledCells = 0;
+
+        /** Cost of the last cell Integrate settled: while a resumable build is paused, cells up to it are final. */
+        float SettledCost = -1.0f;
+
+        /** When positive, Integrate pauses once FPlatformTime::Seconds passes it. */
+        double IntegrationEndTime = 0.0;
+
+        /** Integration scratch kept between builds to avoid reallocating the open lists. */
+        FFlowFieldStepCostTable StepCosts;
+        FFlowFieldBinaryHeap HeapOpenList;
+        FFlowFieldBucketQueue BucketOpenList;
+
+        /** Cells whose fast marching cost is final. */
+        TBitArray<> AcceptedCells;
+
+        /**
+         * Tile integration scratch, one open list per worker. Each tile records the phase step it was last integrated in
+         * and the last step its border costs dropped; a tile needs another pass while a neighbouring tile changed after
+         * it was integrated.
+         */
+        TArray<int32> TileVisitSteps;
+        TArray<int32> TileChangeSteps;
+        TArray<int32> ActiveTiles;
+        TArray<FFlowFieldBinaryHeap> TileOpenLists;
+
+        /** Repair scratch, see MarkCellsDirty. */
+        TBitArray<> RepairMarks;
+        TArray<int32> RepairCells;
+        TArray<int32> RepairChangedCells;
 };
 
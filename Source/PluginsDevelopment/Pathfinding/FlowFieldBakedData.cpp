@@ -0,0 +1,31 @@
+#include "FlowFieldBakedData.h"
+
+void UFlowFieldBakedData::Serialize(FArchive& Ar)
+{
+        Super::Serialize(Ar);
+        Weights.BulkSerialize(Ar);
+}
+
+bool UFlowFieldBakedData::IsCompatible(const FIntPoint& InGridSize, uint32 InSourceHash) const
+{
+        return FormatVersion == CurrentFormatVersion
+                && GridSize == InGridSize
+                && SourceHash == InSourceHash
+                && Weights.Num() == InGridSize.X * InGridSize.Y;
+}
+
+void UFlowFieldBakedData::StoreWeights(const FIntPoint& InGridSize, float InCellSize, const FVector& InOrigin, const FBox& InTerrainBounds, uint32 InSourceHash, uint32 InLayerWeightHash, const TArray<uint8>& InWeights)
+{
+        Modify();
+
+        FormatVersion = CurrentFormatVersion;
+        SourceHash = InSourceHash;
+        LayerWeightHash = InLayerWeightHash;
+        GridSize = InGridSize;
+        CellSize = InCellSize;
+        Origin = InOrigin;
+        TerrainBounds = InTerrainBounds;
+        Weights = InWeights;
+
+        MarkPackageDirty();
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+
+#include "FlowFieldBakedData.generated.h"
+
+/**
+ * Traversal weights baked offline by AFlowFieldManager::BakeTraversalWeightsToAsset.
+ * The weights are loaded with the asset instead of being traced on every BeginPlay. SourceHash fingerprints the grid,
+ * the bake settings and the colliding geometry, so a manager falls back to tracing once the level no longer matches.
+ * LayerWeightHash does the same for the painted landscape layers, which can only be read and repainted in the editor.
+ */
+UCLASS(BlueprintType)
+class PLUGINSDEVELOPMENT_API UFlowFieldBakedData : public UDataAsset
+{
+        GENERATED_BODY()
+
+public:
+        /** Bumped whenever the serialized layout or the meaning of the weights changes. */
+        static constexpr int32 CurrentFormatVersion = 2;
+
+        virtual void Serialize(FArchive& Ar) override;
+
+        /** Returns true if the baked weights were produced by the current format for the supplied grid and hash. */
+        bool IsCompatible(const FIntPoint& InGridSize, uint32 InSourceHash) const;
+
+        /** Replaces the baked weights. Marks the asset dirty so the editor saves it. */
+        void StoreWeights(const FIntPoint& InGridSize, float InCellSize, const FVector& InOrigin, const FBox& InTerrainBounds, uint32 InSourceHash, uint32 InLayerWeightHash, const TArray<uint8>& InWeights);
+
+        /** Weights in the FFlowField::SetTraversalWeights layout. */
+        const TArray<uint8>& GetWeights() const { return Weights; }
+
+        UPROPERTY(VisibleAnywhere, Category = "Flow Field")
+        int32 FormatVersion = 0;
+
+        UPROPERTY(VisibleAnywhere, Category = "Flow Field")
+        uint32 SourceHash = 0;
+
+        /** FFlowFieldTerrainSampler::HashLayerWeights of the layer costs at bake time, 0 when baked from traces only. */
+        UPROPERTY(VisibleAnywhere, Category = "Flow Field")
+        uint32 LayerWeightHash = 0;
+
+        UPROPERTY(VisibleAnywhere, Category = "Flow Field")
+        FIntPoint GridSize = FIntPoint::ZeroValue;
+
+        UPROPERTY(VisibleAnywhere, Category = "Flow Field")
+        float CellSize = 0.0f;
+
+        UPROPERTY(VisibleAnywhere, Category = "Flow Field")
+        FVector Origin = FVector::ZeroVector;
+
+        /** Terrain bounds detected when baking, kept for inspection. */
+        UPROPERTY(VisibleAnywhere, Category = "Flow Field")
+        FBox TerrainBounds = FBox(ForceInit);
+
+private:
+        /** Bulk serialized in Serialize rather than as a tagged property, one byte per cell. */
+        TArray<uint8> Weights;
+};
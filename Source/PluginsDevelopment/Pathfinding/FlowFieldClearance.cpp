@@ -0,0 +1,189 @@
+#include "FlowFieldClearance.h"
+
+int32 FFlowFieldClearance::GetClearanceForRadius(float AgentRadius, float CellSize)
+{
+        // The free square of clearance N reaches N - 0.5 cells from the centre of the cell.
+        const float RadiusInCells = CellSize > 0.0f ? AgentRadius / CellSize : 0.0f;
+        return FMath::Clamp(FMath::CeilToInt32(RadiusInCells + 0.5f), 1, MaxSupportedClearance);
+}
+
+void FFlowFieldClearance::Build(const TArray<uint8>& Weights, const FIntPoint& InGridSize, int32 InMaxClearance)
+{
+        GridSize = InGridSize;
+        MaxClearance = FMath::Clamp(InMaxClearance, 1, MaxSupportedClearance);
+
+        const int32 NumCells = GridSize.X * GridSize.Y;
+        if (!ensureMsgf(Weights.Num() == NumCells, TEXT("Traversal weight array does not match grid dimensions")))
+        {
+                Clearance.Reset();
+                ClassWeights.Reset();
+                return;
+        }
+
+        Clearance.SetNumUninitialized(NumCells);
+        ClassWeights.SetNum(MaxClearance - 1);
+        for (TArray<uint8>& Class : ClassWeights)
+        {
+                Class.SetNumUninitialized(NumCells);
+        }
+
+        const FIntRect Grid(FIntPoint::ZeroValue, GridSize);
+        ComputeWindow(Weights, Grid, Grid);
+        ComputeClassWeights(Weights, Grid);
+}
+
+FIntRect FFlowFieldClearance::UpdateRegion(const TArray<uint8>& Weights, const FIntRect& Region)
+{
+        const FIntRect Grid(FIntPoint::ZeroValue, GridSize);
+        if (!ensureMsgf(Weights.Num() == Clearance.Num(), TEXT("Traversal weight array does not match the clearance layer")))
+        {
+                return Grid;
+        }
+
+        // A capped clearance only depends on the cells within MaxClearance, so the cells within MaxClearance of the region
+        // can change and are exact when the transform runs over twice that margin.
+        FIntRect OutputRect = Region;
+        OutputRect.InflateRect(MaxClearance);
+        OutputRect.Clip(Grid);
+
+        FIntRect Window = Region;
+        Window.InflateRect(2 * MaxClearance);
+        Window.Clip(Grid);
+
+        if (OutputRect.IsEmpty())
+        {
+                return OutputRect;
+        }
+
+        ComputeWindow(Weights, Window, OutputRect);
+        ComputeClassWeights(Weights, OutputRect);
+        return OutputRect;
+}
+
+const TArray<uint8>* FFlowFieldClearance::GetClassWeights(int32 MinClearance) const
+{
+        if (MinClearance <= 1 || ClassWeights.Num() == 0)
+        {
+                return nullptr;
+        }
+
+        return &ClassWeights[FMath::Min(MinClearance, MaxClearance) - 2];
+}
+
+SIZE_T FFlowFieldClearance::GetAllocatedSize() const
+{
+        SIZE_T Size = Clearance.GetAllocatedSize() + ClassWeights.GetAllocatedSize();
+        for (const TArray<uint8>& Class : ClassWeights)
+        {
+                Size += Class.GetAllocatedSize();
+        }
+
+        return Size;
+}
+
+void FFlowFieldClearance::ComputeWindow(const TArray<uint8>& Weights, const FIntRect& Window, const FIntRect& OutputRect)
+{
+        const int32 WindowX = Window.Width();
+        const int32 WindowY = Window.Height();
+
+        TArray<uint8> Distances;
+        Distances.SetNumUninitialized(WindowX * WindowY);
+
+        // Unit cost chamfer: two raster passes yield the exact chessboard distance on a rectangle. Cells on the grid
+        // border are next to the outside of the grid, cells outside the window are simply not seen.
+        for (int32 LocalY = 0; LocalY < WindowY; ++LocalY)
+        {
+                const int32 CellY = Window.Min.Y + LocalY;
+                for (int32 LocalX = 0; LocalX < WindowX; ++LocalX)
+                {
+                        const int32 CellX = Window.Min.X + LocalX;
+                        uint8& Distance = Distances[LocalY * WindowX + LocalX];
+                        if (Weights[CellY * GridSize.X + CellX] == 0)
+                        {
+                                Distance = 0;
+                                continue;
+                        }
+
+                        const bool bOnGridBorder = CellX == 0 || CellY == 0 || CellX == GridSize.X - 1 || CellY == GridSize.Y - 1;
+                        int32 Best = bOnGridBorder ? 1 : MaxClearance;
+                        if (LocalX > 0)
+                        {
+                                Best = FMath::Min(Best, Distances[LocalY * WindowX + LocalX - 1] + 1);
+                        }
+
+                        if (LocalY > 0)
+                        {
+                                const uint8* PreviousRow = &Distances[(LocalY - 1) * WindowX];
+                                Best = FMath::Min(Best, PreviousRow[LocalX] + 1);
+                                if (LocalX > 0)
+                                {
+                                        Best = FMath::Min(Best, PreviousRow[LocalX - 1] + 1);
+                                }
+
+                                if (LocalX < WindowX - 1)
+                                {
+                                        Best = FMath::Min(Best, PreviousRow[LocalX + 1] + 1);
+                                }
+                        }
+
+                        Distance = static_cast<uint8>(Best);
+                }
+        }
+
+        for (int32 LocalY = WindowY - 1; LocalY >= 0; --LocalY)
+        {
+                for (int32 LocalX = WindowX - 1; LocalX >= 0; --LocalX)
+                {
+                        uint8& Distance = Distances[LocalY * WindowX + LocalX];
+                        int32 Best = Distance;
+                        if (Best <= 1)
+                        {
+                                continue;
+                        }
+
+                        if (LocalX < WindowX - 1)
+                        {
+                                Best = FMath::Min(Best, Distances[LocalY * WindowX + LocalX + 1] + 1);
+                        }
+
+                        if (LocalY < WindowY - 1)
+                        {
+                                const uint8* NextRow = &Distances[(LocalY + 1) * WindowX];
+                                Best = FMath::Min(Best, NextRow[LocalX] + 1);
+                                if (LocalX > 0)
+                                {
+                                        Best = FMath::Min(Best, NextRow[LocalX - 1] + 1);
+                                }
+
+                                if (LocalX < WindowX - 1)
+                                {
+                                        Best = FMath::Min(Best, NextRow[LocalX + 1] + 1);
+                                }
+                        }
+
+                        Distance = static_cast<uint8>(Best);
+                }
+        }
+
+        for (int32 CellY = OutputRect.Min.Y; CellY < OutputRect.Max.Y; ++CellY)
+        {
+                const uint8* Source = &Distances[(CellY - Window.Min.Y) * WindowX + (OutputRect.Min.X - Window.Min.X)];
+                FMemory::Memcpy(&Clearance[CellY * GridSize.X + OutputRect.Min.X], Source, OutputRect.Width());
+        }
+}
+
+void FFlowFieldClearance::ComputeClassWeights(const TArray<uint8>& Weights, const FIntRect& Rect)
+{
+        for (int32 ClassIndex = 0; ClassIndex < ClassWeights.Num(); ++ClassIndex)
+        {
+                const uint8 MinClearance = static_cast<uint8>(ClassIndex + 2);
+                uint8* RESTRICT Class = ClassWeights[ClassIndex].GetData();
+                for (int32 CellY = Rect.Min.Y; CellY < Rect.Max.Y; ++CellY)
+                {
+                        for (int32 Index = CellY * GridSize.X + Rect.Min.X; Index < CellY * GridSize.X + Rect.Max.X; ++Index)
+                        {
+                                Class[Index] = Clearance[Index] >= MinClearance ? Weights[Index] : 0;
+                        }
+                }
+        }
+}
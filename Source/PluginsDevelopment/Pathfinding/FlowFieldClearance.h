@@ -0,0 +1,54 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Distance transform of a traversal weight grid used to route agents wider than a cell.
+ * The clearance of a walkable cell is its chessboard distance to the closest blocked cell or to the outside of the grid,
+ * so a cell of clearance N is the centre of a free square of 2N - 1 cells; blocked cells have a clearance of 0.
+ * Values are capped at MaxClearance, which keeps every cell dependent on its MaxClearance neighbourhood only and lets
+ * UpdateRegion recompute a window around the changed cells instead of the whole grid.
+ *
+ * For every size class from 2 to MaxClearance the layer also keeps the traversal weights with the cells narrower than the
+ * class blocked. The layer is immutable once shared: fields of the same class integrate the same buffer.
+ */
+class PLUGINSDEVELOPMENT_API FFlowFieldClearance
+{
+public:
+        /** Largest clearance the uint8 storage can represent. */
+        static constexpr int32 MaxSupportedClearance = 255;
+
+        /** Smallest clearance class fitting an agent of the supplied radius, 1 for agents no wider than a cell. */
+        static int32 GetClearanceForRadius(float AgentRadius, float CellSize);
+
+        /** Computes the clearance of every cell from Weights, a row-major GridSize grid, and the weights of every size class. */
+        void Build(const TArray<uint8>& Weights, const FIntPoint& GridSize, int32 InMaxClearance);
+
+        /**
+         * Recomputes the layer after the weights inside Region changed; Weights must be the full updated grid.
+         * Returns the cells whose clearance or class weights may have changed, Region grown by MaxClearance.
+         */
+        FIntRect UpdateRegion(const TArray<uint8>& Weights, const FIntRect& Region);
+
+        const FIntPoint& GetGridSize() const { return GridSize; }
+        int32 GetMaxClearance() const { return MaxClearance; }
+        uint8 GetClearance(int32 Index) const { return Clearance[Index]; }
+        const TArray<uint8>& GetClearanceField() const { return Clearance; }
+
+        /** Weights of the size class, or nullptr when MinClearance is 1 or less. Classes above MaxClearance use the largest class. */
+        const TArray<uint8>* GetClassWeights(int32 MinClearance) const;
+
+        SIZE_T GetAllocatedSize() const;
+
+private:
+        /** Two-pass chamfer over Window; only the cells of OutputRect are guaranteed exact and written back. */
+        void ComputeWindow(const TArray<uint8>& Weights, const FIntRect& Window, const FIntRect& OutputRect);
+        void ComputeClassWeights(const TArray<uint8>& Weights, const FIntRect& Rect);
+
+        FIntPoint GridSize = FIntPoint::ZeroValue;
+        int32 MaxClearance = 1;
+        TArray<uint8> Clearance;
+
+        /** Weights of class MinClearance at index MinClearance - 2. */
+        TArray<TArray<uint8>> ClassWeights;
+};
@@ -0,0 +1,409 @@
+#include "FlowFieldCrowdManager.h"
+
+#include "FlowFieldManager.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+
+namespace
+{
+        /** Agents integrated per parallel task. */
+        constexpr int32 CrowdAgentsPerTask = 1024;
+
+        /** Updates run before measuring, so the goal fields are built and the arrays allocated. */
+        constexpr int32 BenchmarkWarmUpUpdates = 4;
+
+        FAutoConsoleCommandWithWorld CrowdBenchmarkCommand(
+                TEXT("FlowField.CrowdBenchmark"),
+                TEXT("Runs the benchmark of the flow field crowds of the world, or of a temporary crowd if the world has none."),
+                FConsoleCommandWithWorldDelegate::CreateStatic([](UWorld* World)
+                {
+                        if (!World)
+                        {
+                                return;
+                        }
+
+                        bool bFoundCrowd = false;
+                        for (TActorIterator<AFlowFieldCrowdManager> It(World); It; ++It)
+                        {
+                                It->RunBenchmark();
+                                bFoundCrowd = true;
+                        }
+
+                        if (!bFoundCrowd)
+                        {
+                                if (AFlowFieldCrowdManager* Crowd = World->SpawnActor<AFlowFieldCrowdManager>())
+                                {
+                                        Crowd->RunBenchmark();
+                                        Crowd->Destroy();
+                                }
+                        }
+                }));
+}
+
+AFlowFieldCrowdManager::AFlowFieldCrowdManager()
+{
+        PrimaryActorTick.bCanEverTick = true;
+
+        AgentInstances = CreateDefaultSubobject<UInstancedStaticMeshComponent>(TEXT("AgentInstances"));
+        AgentInstances->SetMobility(EComponentMobility::Movable);
+        AgentInstances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+        AgentInstances->SetCanEverAffectNavigation(false);
+        AgentInstances->SetCastShadow(false);
+        RootComponent = AgentInstances;
+}
+
+void AFlowFieldCrowdManager::BeginPlay()
+{
+        Super::BeginPlay();
+
+        if (InitialAgentCount > 0)
+        {
+                SpawnAgents(InitialAgentCount);
+        }
+}
+
+void AFlowFieldCrowdManager::Tick(float DeltaSeconds)
+{
+        Super::Tick(DeltaSeconds);
+
+        if (Positions.IsEmpty())
+        {
+                return;
+        }
+
+        UpdateCrowd(DeltaSeconds);
+        if (bRenderAgents)
+        {
+                UpdateInstances();
+        }
+}
+
+void AFlowFieldCrowdManager::SpawnAgents(int32 Count)
+{
+        ClearAgents();
+
+        if (!FlowFieldManager && bAutoFindManager)
+        {
+                FlowFieldManager = ResolveFlowFieldManager();
+        }
+
+        if (!FlowFieldManager || !AcquireGoals())
+        {
+                UE_LOG(LogTemp, Warning, TEXT("FlowFieldCrowdManager %s could not find a FlowFieldManager with walkable cells."), *GetName());
+                return;
+        }
+
+        Positions.Reserve(Count);
+        Velocities.Reserve(Count);
+        AgentGoals.Reserve(Count);
+        for (int32 Index = 0; Index < Count; ++Index)
+        {
+                FVector Position;
+                if (!FindRandomWalkablePosition(Position))
+                {
+                        break;
+                }
+
+                Positions.Add(Position);
+                Velocities.Add(FVector::ZeroVector);
+                AgentGoals.Add(GoalStream.RandRange(0, Goals.Num() - 1));
+        }
+
+        NeedsNewGoal.SetNumZeroed(Positions.Num());
+        NeedsRespawn.SetNumZeroed(Positions.Num());
+
+        if (bRenderAgents)
+        {
+                UpdateInstances();
+        }
+}
+
+void AFlowFieldCrowdManager::ClearAgents()
+{
+        Positions.Reset();
+        Velocities.Reset();
+        AgentGoals.Reset();
+        NeedsNewGoal.Reset();
+        NeedsRespawn.Reset();
+        InstanceTransforms.Reset();
+        AgentInstances->ClearInstances();
+}
+
+void AFlowFieldCrowdManager::UpdateCrowd(float DeltaSeconds)
+{
+        const double StartTime = FPlatformTime::Seconds();
+        const int32 NumAgents = Positions.Num();
+        if (NumAgents == 0 || !FlowFieldManager || Goals.IsEmpty())
+        {
+                LastUpdateMilliseconds = 0.0f;
+                return;
+        }
+
+        SortAgentsByGoal();
+
+        // One batch per goal: the manager resolves the cached field once for all of its agents.
+        for (int32 GoalIndex = 0; GoalIndex < Goals.Num(); ++GoalIndex)
+        {
+                const int32 First = GoalOffsets[GoalIndex];
+                const int32 Count = GoalOffsets[GoalIndex + 1] - First;
+                if (Count > 0)
+                {
+                        FlowFieldManager->SampleDirectionsForHandle(Goals[GoalIndex].Handle, TConstArrayView<FVector>(SortedPositions.GetData() + First, Count), TArrayView<FVector>(SortedDirections.GetData() + First, Count));
+                }
+        }
+
+        const float Blend = FMath::Min(1.0f, SteeringResponse * DeltaSeconds);
+        const float AcceptanceRadiusSquared = FMath::Square(AcceptanceRadius);
+        const int32 NumTasks = FMath::DivideAndRoundUp(NumAgents, CrowdAgentsPerTask);
+        const AFlowFieldManager* Manager = FlowFieldManager;
+        ParallelFor(NumTasks, [this, Manager, NumAgents, DeltaSeconds, Blend, AcceptanceRadiusSquared](int32 TaskIndex)
+        {
+                const auto IsWalkableAt = [Manager](const FVector& Location) { return Manager->IsWalkable(Manager->WorldToCell(Location)); };
+
+                const int32 End = FMath::Min((TaskIndex + 1) * CrowdAgentsPerTask, NumAgents);
+                for (int32 SortedIndex = TaskIndex * CrowdAgentsPerTask; SortedIndex < End; ++SortedIndex)
+                {
+                        const int32 Agent = SortedAgents[SortedIndex];
+                        const FVector& Direction = SortedDirections[SortedIndex];
+
+                        FVector& Velocity = Velocities[Agent];
+                        Velocity += (Direction * MaxSpeed - Velocity) * Blend;
+
+                        // Agents never step onto a blocked cell or off the grid: they slide along the free axis, or stop.
+                        FVector& Position = Positions[Agent];
+                        const FVector Step = Velocity * DeltaSeconds;
+                        if (IsWalkableAt(Position + Step))
+                        {
+                                Position += Step;
+                        }
+                        else if (IsWalkableAt(Position + FVector(Step.X, 0.0f, 0.0f)))
+                        {
+                                Position.X += Step.X;
+                                Velocity.Y = 0.0f;
+                        }
+                        else if (IsWalkableAt(Position + FVector(0.0f, Step.Y, 0.0f)))
+                        {
+                                Position.Y += Step.Y;
+                                Velocity.X = 0.0f;
+                        }
+                        else
+                        {
+                                Velocity = FVector::ZeroVector;
+                        }
+
+                        NeedsRespawn[Agent] = !IsWalkableAt(Position);
+
+                        // Fields give no direction on their destination, nor where the destination cannot be reached.
+                        const FVector& GoalLocation = Goals[AgentGoals[Agent]].Location;
+                        NeedsNewGoal[Agent] = Direction.IsNearlyZero() || FVector::DistSquared2D(Position, GoalLocation) <= AcceptanceRadiusSquared;
+                }
+        }, NumTasks <= 1 ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+
+        // The random stream is not thread safe, stranded agents are moved back onto the grid here.
+        for (int32 Agent = 0; Agent < NumAgents; ++Agent)
+        {
+                if (NeedsRespawn[Agent] && FindRandomWalkablePosition(Positions[Agent]))
+                {
+                        Velocities[Agent] = FVector::ZeroVector;
+                }
+        }
+
+        if (Goals.Num() > 1)
+        {
+                for (int32 Agent = 0; Agent < NumAgents; ++Agent)
+                {
+                        if (NeedsNewGoal[Agent])
+                        {
+                                // Offset from the current goal so the agent always leaves.
+                                AgentGoals[Agent] = (AgentGoals[Agent] + GoalStream.RandRange(1, Goals.Num() - 1)) % Goals.Num();
+                        }
+                }
+        }
+
+        LastUpdateMilliseconds = static_cast<float>((FPlatformTime::Seconds() - StartTime) * 1000.0);
+}
+
+void AFlowFieldCrowdManager::UpdateInstances()
+{
+        if (AgentInstances->GetStaticMesh() != AgentMesh)
+        {
+                AgentInstances->SetStaticMesh(AgentMesh);
+        }
+
+        const int32 NumAgents = Positions.Num();
+        InstanceTransforms.SetNumUninitialized(NumAgents);
+
+        const int32 NumTasks = FMath::DivideAndRoundUp(NumAgents, CrowdAgentsPerTask);
+        ParallelFor(NumTasks, [this, NumAgents](int32 TaskIndex)
+        {
+                const int32 End = FMath::Min((TaskIndex + 1) * CrowdAgentsPerTask, NumAgents);
+                for (int32 Agent = TaskIndex * CrowdAgentsPerTask; Agent < End; ++Agent)
+                {
+                        const FVector& Velocity = Velocities[Agent];
+                        const FQuat Rotation(FVector::UpVector, FMath::Atan2(Velocity.Y, Velocity.X));
+                        InstanceTransforms[Agent] = FTransform(Rotation, Positions[Agent], AgentScale);
+                }
+        }, NumTasks <= 1 ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+
+        if (AgentInstances->GetInstanceCount() != NumAgents)
+        {
+                AgentInstances->ClearInstances();
+                AgentInstances->AddInstances(InstanceTransforms, false, true, false);
+        }
+        else if (NumAgents > 0)
+        {
+                AgentInstances->BatchUpdateInstancesTransforms(0, InstanceTransforms, true, true, true);
+        }
+}
+
+void AFlowFieldCrowdManager::RunBenchmark()
+{
+        const int32 PreviousAgentCount = Positions.Num();
+
+        for (const int32 Count : BenchmarkAgentCounts)
+        {
+                SpawnAgents(Count);
+                if (Positions.IsEmpty())
+                {
+                        return;
+                }
+
+                for (int32 Update = 0; Update < BenchmarkWarmUpUpdates; ++Update)
+                {
+                        UpdateCrowd(BenchmarkDeltaSeconds);
+                }
+
+                double SimulationSeconds = 0.0;
+                double MaxSimulationSeconds = 0.0;
+                double RenderSeconds = 0.0;
+                for (int32 Update = 0; Update < BenchmarkUpdates; ++Update)
+                {
+                        const double StartTime = FPlatformTime::Seconds();
+                        UpdateCrowd(BenchmarkDeltaSeconds);
+                        const double SimulationEndTime = FPlatformTime::Seconds();
+                        if (bRenderAgents)
+                        {
+                                UpdateInstances();
+                        }
+
+                        SimulationSeconds += SimulationEndTime - StartTime;
+                        MaxSimulationSeconds = FMath::Max(MaxSimulationSeconds, SimulationEndTime - StartTime);
+                        RenderSeconds += FPlatformTime::Seconds() - SimulationEndTime;
+                }
+
+                UE_LOG(LogTemp, Display, TEXT("Flow field crowd benchmark: %d agents, %d goals, %.3f ms per update (max %.3f ms), %.3f ms per instance upload."),
+                        Positions.Num(), Goals.Num(),
+                        SimulationSeconds * 1000.0 / BenchmarkUpdates, MaxSimulationSeconds * 1000.0,
+                        RenderSeconds * 1000.0 / BenchmarkUpdates);
+        }
+
+        if (PreviousAgentCount > 0)
+        {
+                SpawnAgents(PreviousAgentCount);
+        }
+        else
+        {
+                ClearAgents();
+        }
+}
+
+AFlowFieldManager* AFlowFieldCrowdManager::ResolveFlowFieldManager()
+{
+        if (!GetWorld())
+        {
+                return nullptr;
+        }
+
+        for (TActorIterator<AFlowFieldManager> It(GetWorld()); It; ++It)
+        {
+                if (AFlowFieldManager* Manager = *It)
+                {
+                        return Manager;
+                }
+        }
+
+        return nullptr;
+}
+
+bool AFlowFieldCrowdManager::AcquireGoals()
+{
+        Goals.Reset();
+
+        const int32 MaxAttempts = FMath::Max(1, NumGoals) * 8;
+        for (int32 Attempt = 0; Attempt < MaxAttempts && Goals.Num() < NumGoals; ++Attempt)
+        {
+                FVector Location;
+                if (!FindRandomWalkablePosition(Location))
+                {
+                        break;
+                }
+
+                const FFlowFieldHandle Handle = FlowFieldManager->AcquireFlowFieldToWorldLocation(Location);
+                if (Handle.IsValid())
+                {
+                        FCrowdGoal& Goal = Goals.AddDefaulted_GetRef();
+                        Goal.Handle = Handle;
+                        Goal.Location = FlowFieldManager->CellToWorld(Handle.Destination);
+                }
+        }
+
+        return Goals.Num() > 0;
+}
+
+bool AFlowFieldCrowdManager::FindRandomWalkablePosition(FVector& OutPosition) const
+{
+        const FFlowFieldSettings& Settings = FlowFieldManager->GetSettings();
+        if (Settings.GridSize.X <= 0 || Settings.GridSize.Y <= 0)
+        {
+                return false;
+        }
+
+        constexpr int32 MaxAttempts = 32;
+        const float HalfCell = Settings.CellSize * 0.5f;
+        for (int32 Attempt = 0; Attempt < MaxAttempts; ++Attempt)
+        {
+                const FIntPoint Cell(GoalStream.RandRange(0, Settings.GridSize.X - 1), GoalStream.RandRange(0, Settings.GridSize.Y - 1));
+                if (FlowFieldManager->IsWalkable(Cell))
+                {
+                        OutPosition = FlowFieldManager->CellToWorld(Cell) + FVector(GoalStream.FRandRange(-HalfCell, HalfCell), GoalStream.FRandRange(-HalfCell, HalfCell), 0.0f);
+                        return true;
+                }
+        }
+
+        return false;
+}
+
+void AFlowFieldCrowdManager::SortAgentsByGoal()
+{
+        const int32 NumAgents = Positions.Num();
+        const int32 NumGoalsInUse = Goals.Num();
+
+        // Counting sort, the number of goals is small and the agents keep their relative order.
+        GoalOffsets.Reset();
+        GoalOffsets.SetNumZeroed(NumGoalsInUse + 1);
+        for (const int32 Goal : AgentGoals)
+        {
+                ++GoalOffsets[Goal + 1];
+        }
+
+        for (int32 GoalIndex = 0; GoalIndex < NumGoalsInUse; ++GoalIndex)
+        {
+                GoalOffsets[GoalIndex + 1] += GoalOffsets[GoalIndex];
+        }
+
+        TArray<int32, TInlineAllocator<16>> Cursors(GoalOffsets.GetData(), NumGoalsInUse);
+        SortedAgents.SetNumUninitialized(NumAgents);
+        SortedPositions.SetNumUninitialized(NumAgents);
+        SortedDirections.SetNumUninitialized(NumAgents);
+        for (int32 Agent = 0; Agent < NumAgents; ++Agent)
+        {
+                const int32 SortedIndex = Cursors[AgentGoals[Agent]]++;
+                SortedAgents[SortedIndex] = Agent;
+                SortedPositions[SortedIndex] = Positions[Agent];
+        }
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+
+#include "FlowFieldManager.h"
+
+#include "FlowFieldCrowdManager.generated.h"
+
+class UInstancedStaticMeshComponent;
+class UStaticMesh;
+
+/**
+ * Simulates a crowd of lightweight agents following the flow fields of an AFlowFieldManager.
+ * Agents are plain arrays instead of actors: every update samples the fields in one batch per goal, integrates the agents in
+ * parallel and uploads their transforms to a single instanced static mesh.
+ */
+UCLASS()
+class PLUGINSDEVELOPMENT_API AFlowFieldCrowdManager : public AActor
+{
+        GENERATED_BODY()
+
+public:
+        AFlowFieldCrowdManager();
+
+        virtual void Tick(float DeltaSeconds) override;
+
+        /** Replaces the crowd with Count agents spread over random walkable cells. */
+        UFUNCTION(BlueprintCallable, Category = "Crowd")
+        void SpawnAgents(int32 Count);
+
+        /** Removes every agent. */
+        UFUNCTION(BlueprintCallable, Category = "Crowd")
+        void ClearAgents();
+
+        /** Advances the whole crowd by DeltaSeconds without rendering it. */
+        void UpdateCrowd(float DeltaSeconds);
+
+        /** Uploads the agent transforms to the instanced mesh. */
+        void UpdateInstances();
+
+        /**
+         * Runs BenchmarkUpdates crowd updates for every entry of BenchmarkAgentCounts and logs the time per update of the
+         * simulation and of the instance upload. Also available as the FlowField.CrowdBenchmark console command.
+         */
+        UFUNCTION(CallInEditor, Category = "Crowd|Benchmark")
+        void RunBenchmark();
+
+        int32 GetNumAgents() const { return Positions.Num(); }
+
+        /** Duration of the last UpdateCrowd in milliseconds. */
+        UFUNCTION(BlueprintPure, Category = "Crowd")
+        float GetLastUpdateMilliseconds() const { return LastUpdateMilliseconds; }
+
+protected:
+        virtual void BeginPlay() override;
+
+private:
+        /** Attempts to find a flow field manager in the current world. */
+        AFlowFieldManager* ResolveFlowFieldManager();
+
+        /** Acquires the fields of NumGoals random walkable destinations. Returns false if none could be built. */
+        bool AcquireGoals();
+
+        /** Random walkable position of the grid, jittered inside its cell. */
+        bool FindRandomWalkablePosition(FVector& OutPosition) const;
+
+        /** Groups the agents by goal so each goal is sampled in a single batch. */
+        void SortAgentsByGoal();
+
+private:
+        UPROPERTY(VisibleAnywhere, Category = "Crowd")
+        TObjectPtr<UInstancedStaticMeshComponent> AgentInstances;
+
+        /** Flow field manager providing the fields the agents follow. */
+        UPROPERTY(EditInstanceOnly, Category = "Flow Field")
+        TObjectPtr<AFlowFieldManager> FlowFieldManager = nullptr;
+
+        /** Whether the crowd should automatically look for a manager if none is assigned. */
+        UPROPERTY(EditAnywhere, Category = "Flow Field")
+        bool bAutoFindManager = true;
+
+        /** Agents spawned on BeginPlay. */
+        UPROPERTY(EditAnywhere, Category = "Crowd", meta = (ClampMin = "0"))
+        int32 InitialAgentCount = 1000;
+
+        /** Destinations shared by the crowd; each one is a single cached field whatever the number of agents. */
+        UPROPERTY(EditAnywhere, Category = "Crowd", meta = (ClampMin = "1"))
+        int32 NumGoals = 8;
+
+        UPROPERTY(EditAnywhere, Category = "Crowd", meta = (ClampMin = "0.0"))
+        float MaxSpeed = 400.0f;
+
+        /** Rate at which the velocity converges to the field direction, per second. */
+        UPROPERTY(EditAnywhere, Category = "Crowd", meta = (ClampMin = "0.0"))
+        float SteeringResponse = 8.0f;
+
+        /** Distance to its goal at which an agent picks a new goal. */
+        UPROPERTY(EditAnywhere, Category = "Crowd", meta = (ClampMin = "0.0"))
+        float AcceptanceRadius = 150.0f;
+
+        UPROPERTY(EditAnywhere, Category = "Crowd|Rendering")
+        TObjectPtr<UStaticMesh> AgentMesh;
+
+        UPROPERTY(EditAnywhere, Category = "Crowd|Rendering")
+        FVector AgentScale = FVector(0.5f);
+
+        UPROPERTY(EditAnywhere, Category = "Crowd|Rendering")
+        bool bRenderAgents = true;
+
+        UPROPERTY(EditAnywhere, Category = "Crowd|Benchmark")
+        TArray<int32> BenchmarkAgentCounts = { 1000, 10000, 50000 };
+
+        UPROPERTY(EditAnywhere, Category = "Crowd|Benchmark", meta = (ClampMin = "1"))
+        int32 BenchmarkUpdates = 120;
+
+        UPROPERTY(EditAnywhere, Category = "Crowd|Benchmark", meta = (ClampMin = "0.001"))
+        float BenchmarkDeltaSeconds = 1.0f / 60.0f;
+
+private:
+        struct FCrowdGoal
+        {
+                FFlowFieldHandle Handle;
+                FVector Location = FVector::ZeroVector;
+        };
+
+        TArray<FCrowdGoal> Goals;
+
+        /** Agent state, one entry per agent. */
+        TArray<FVector> Positions;
+        TArray<FVector> Velocities;
+        TArray<int32> AgentGoals;
+
+        /** Agents ordered by goal, the agents of goal G are SortedAgents[GoalOffsets[G], GoalOffsets[G + 1]). */
+        TArray<int32> SortedAgents;
+        TArray<int32> GoalOffsets;
+        TArray<FVector> SortedPositions;
+        TArray<FVector> SortedDirections;
+
+        /** Agents that reached their goal or lost their field during the last update. */
+        TArray<uint8> NeedsNewGoal;
+
+        /** Agents left on a blocked cell by the last update, e.g. after the weights changed under them. */
+        TArray<uint8> NeedsRespawn;
+        TArray<FTransform> InstanceTransforms;
+        FRandomStream GoalStream;
+        float LastUpdateMilliseconds = 0.0f;
+};
@@ -0,0 +1,482 @@
+#include "FlowFieldHierarchy.h"
+
+namespace
+{
+        using FlowFieldIntegration::InvalidCost;
+        using FlowFieldIntegration::NeighborOffsets;
+}
+
+FFlowFieldSectorGraph::FFlowFieldSectorGraph(const FFlowFieldSettings& InSettings, int32 InSectorSize, const TSharedPtr<const TArray<uint8>>& InWeights)
+        : Settings(InSettings)
+        , SectorSize(FMath::Max(1, InSectorSize))
+        , TraversalWeights(InWeights)
+{
+        check(TraversalWeights.IsValid());
+        StepCosts.Build(Settings);
+
+        NumSectors.X = FMath::DivideAndRoundUp(FMath::Max(Settings.GridSize.X, 0), SectorSize);
+        NumSectors.Y = FMath::DivideAndRoundUp(FMath::Max(Settings.GridSize.Y, 0), SectorSize);
+
+        Sectors.Reserve(NumSectors.X * NumSectors.Y);
+        for (int32 SectorY = 0; SectorY < NumSectors.Y; ++SectorY)
+        {
+                for (int32 SectorX = 0; SectorX < NumSectors.X; ++SectorX)
+                {
+                        FSector& Sector = Sectors.AddDefaulted_GetRef();
+                        Sector.Bounds.Min = FIntPoint(SectorX * SectorSize, SectorY * SectorSize);
+                        Sector.Bounds.Max = FIntPoint::ComponentMin(Sector.Bounds.Min + FIntPoint(SectorSize, SectorSize), Settings.GridSize);
+                }
+        }
+
+        for (int32 SectorY = 0; SectorY < NumSectors.Y; ++SectorY)
+        {
+                for (int32 SectorX = 0; SectorX < NumSectors.X; ++SectorX)
+                {
+                        const int32 SectorIndex = SectorY * NumSectors.X + SectorX;
+                        const FIntRect& Bounds = Sectors[SectorIndex].Bounds;
+
+                        if (SectorX + 1 < NumSectors.X)
+                        {
+                                AddPortalsAlongEdge(SectorIndex, SectorIndex + 1, FIntPoint(Bounds.Max.X - 1, Bounds.Min.Y), FIntPoint(0, 1), FIntPoint(1, 0), Bounds.Height());
+                        }
+
+                        if (SectorY + 1 < NumSectors.Y)
+                        {
+                                AddPortalsAlongEdge(SectorIndex, SectorIndex + NumSectors.X, FIntPoint(Bounds.Min.X, Bounds.Max.Y - 1), FIntPoint(1, 0), FIntPoint(0, 1), Bounds.Width());
+                        }
+                }
+        }
+}
+
+bool FFlowFieldSectorGraph::IsWalkable(const FIntPoint& Cell) const
+{
+        return IsCellValid(Cell) && (*TraversalWeights)[ToLinearIndex(Cell)] > 0;
+}
+
+SIZE_T FFlowFieldSectorGraph::GetAllocatedSize() const
+{
+        SIZE_T Size = TraversalWeights->GetAllocatedSize() + Portals.GetAllocatedSize() + Sectors.GetAllocatedSize();
+        for (const FPortal& Portal : Portals)
+        {
+                Size += Portal.WindowCosts[0].GetAllocatedSize() + Portal.WindowCosts[1].GetAllocatedSize();
+        }
+
+        for (const FSector& Sector : Sectors)
+        {
+                Size += Sector.Nodes.GetAllocatedSize() + Sector.NodeDistances.GetAllocatedSize();
+        }
+
+        return Size;
+}
+
+bool FFlowFieldSectorGraph::IsCellValid(const FIntPoint& Cell) const
+{
+        return Cell.X >= 0 && Cell.Y >= 0 && Cell.X < Settings.GridSize.X && Cell.Y < Settings.GridSize.Y;
+}
+
+int32 FFlowFieldSectorGraph::GetSectorIndex(const FIntPoint& Cell) const
+{
+        return (Cell.Y / SectorSize) * NumSectors.X + (Cell.X / SectorSize);
+}
+
+void FFlowFieldSectorGraph::AddPortalsAlongEdge(int32 SectorA, int32 SectorB, const FIntPoint& FirstCellA, const FIntPoint& EdgeStep, const FIntPoint& CrossStep, int32 EdgeLength)
+{
+        int32 RunStart = INDEX_NONE;
+        for (int32 Offset = 0; Offset <= EdgeLength; ++Offset)
+        {
+                const FIntPoint CellA = FirstCellA + EdgeStep * Offset;
+                const bool bOpen = Offset < EdgeLength && IsWalkable(CellA) && IsWalkable(CellA + CrossStep);
+
+                if (bOpen && RunStart == INDEX_NONE)
+                {
+                        RunStart = Offset;
+                }
+                else if (!bOpen && RunStart != INDEX_NONE)
+                {
+                        FPortal& Portal = Portals.AddDefaulted_GetRef();
+                        Portal.Sectors[0] = SectorA;
+                        Portal.Sectors[1] = SectorB;
+                        Portal.Step = EdgeStep;
+                        Portal.Length = Offset - RunStart;
+                        Portal.Start[0] = FirstCellA + EdgeStep * RunStart;
+                        Portal.Start[1] = Portal.Start[0] + CrossStep;
+                        Portal.Center[0] = Portal.Start[0] + EdgeStep * (Portal.Length / 2);
+                        Portal.Center[1] = Portal.Center[0] + CrossStep;
+
+                        const int32 PortalIndex = Portals.Num() - 1;
+                        Sectors[SectorA].Nodes.Add(MakeNode(PortalIndex, 0));
+                        Sectors[SectorB].Nodes.Add(MakeNode(PortalIndex, 1));
+                        RunStart = INDEX_NONE;
+                }
+        }
+}
+
+void FFlowFieldSectorGraph::IntegrateRegion(const FIntRect& Region, const FIntRect& Walkable, TConstArrayView<FFlowFieldOpenCell> Seeds, TArray<float>& OutCosts, FFlowFieldBinaryHeap& OpenList) const
+{
+        const int32 GridX = Settings.GridSize.X;
+        const int32 RegionWidth = Region.Width();
+        const int32 NumOffsets = Settings.bAllowDiagonal ? FlowFieldIntegration::NumNeighborOffsets : FlowFieldIntegration::NumCardinalOffsets;
+
+        OutCosts.Init(InvalidCost, Region.Area());
+        OpenList.Reset(RegionWidth + Region.Height());
+
+        for (const FFlowFieldOpenCell& Seed : Seeds)
+        {
+                const int32 LocalIndex = (Seed.Index / GridX - Region.Min.Y) * RegionWidth + (Seed.Index % GridX - Region.Min.X);
+                if (Seed.Cost < OutCosts[LocalIndex])
+                {
+                        OutCosts[LocalIndex] = Seed.Cost;
+                        OpenList.Push(LocalIndex, Seed.Cost);
+                }
+        }
+
+        FFlowFieldOpenCell Current;
+        while (OpenList.Pop(Current))
+        {
+                const float RecordedCost = OutCosts[Current.Index];
+                if (Current.Cost > RecordedCost + KINDA_SMALL_NUMBER)
+                {
+                        continue;
+                }
+
+                const int32 CurrentX = Region.Min.X + Current.Index % RegionWidth;
+                const int32 CurrentY = Region.Min.Y + Current.Index / RegionWidth;
+
+                for (int32 OffsetIndex = 0; OffsetIndex < NumOffsets; ++OffsetIndex)
+                {
+                        const int32 NeighborX = CurrentX + NeighborOffsets[OffsetIndex].X;
+                        const int32 NeighborY = CurrentY + NeighborOffsets[OffsetIndex].Y;
+                        if (NeighborX < Walkable.Min.X || NeighborY < Walkable.Min.Y || NeighborX >= Walkable.Max.X || NeighborY >= Walkable.Max.Y)
+                        {
+                                continue;
+                        }
+
+                        const uint8 Weight = (*TraversalWeights)[NeighborY * GridX + NeighborX];
+                        if (Weight == 0)
+                        {
+                                continue;
+                        }
+
+                        const float TraversalCost = OffsetIndex < FlowFieldIntegration::NumCardinalOffsets ? StepCosts.Cardinal[Weight] : StepCosts.Diagonal[Weight];
+                        const float NewCost = RecordedCost + TraversalCost;
+                        const int32 NeighborLocal = (NeighborY - Region.Min.Y) * RegionWidth + (NeighborX - Region.Min.X);
+
+                        if (NewCost + KINDA_SMALL_NUMBER < OutCosts[NeighborLocal])
+                        {
+                                OutCosts[NeighborLocal] = NewCost;
+                                OpenList.Push(NeighborLocal, NewCost);
+                        }
+                }
+        }
+}
+
+void FFlowFieldSectorGraph::EnsureNodeDistances(const FSector& Sector, FFlowFieldBinaryHeap& OpenList) const
+{
+        if (Sector.bHasNodeDistances)
+        {
+                return;
+        }
+
+        const int32 NumNodes = Sector.Nodes.Num();
+        const int32 SectorWidth = Sector.Bounds.Width();
+        Sector.NodeDistances.SetNumUninitialized(NumNodes * NumNodes);
+
+        TArray<float> LocalCosts;
+        for (int32 From = 0; From < NumNodes; ++From)
+        {
+                const FIntPoint& FromCell = Portals[GetNodePortal(Sector.Nodes[From])].Center[GetNodeSide(Sector.Nodes[From])];
+                const FFlowFieldOpenCell Seed(ToLinearIndex(FromCell), 0.0f);
+                IntegrateRegion(Sector.Bounds, Sector.Bounds, MakeArrayView(&Seed, 1), LocalCosts, OpenList);
+
+                for (int32 To = 0; To < NumNodes; ++To)
+                {
+                        const FIntPoint Local = Portals[GetNodePortal(Sector.Nodes[To])].Center[GetNodeSide(Sector.Nodes[To])] - Sector.Bounds.Min;
+                        Sector.NodeDistances[From * NumNodes + To] = LocalCosts[Local.Y * SectorWidth + Local.X];
+                }
+
+                // Keep the spread along the window so neighbouring sectors seed every portal cell consistently.
+                const FPortal& Portal = Portals[GetNodePortal(Sector.Nodes[From])];
+                const int32 Side = GetNodeSide(Sector.Nodes[From]);
+                Portal.WindowCosts[Side].SetNumUninitialized(Portal.Length);
+                for (int32 Offset = 0; Offset < Portal.Length; ++Offset)
+                {
+                        const FIntPoint Local = Portal.Start[Side] + Portal.Step * Offset - Sector.Bounds.Min;
+                        Portal.WindowCosts[Side][Offset] = LocalCosts[Local.Y * SectorWidth + Local.X];
+                }
+        }
+
+        Sector.bHasNodeDistances = true;
+}
+
+FHierarchicalFlowField::FHierarchicalFlowField(const FFlowFieldSettings& InSettings, int32 InSectorSize)
+{
+        ApplySettings(InSettings, InSectorSize);
+}
+
+void FHierarchicalFlowField::ApplySettings(const FFlowFieldSettings& InSettings, int32 InSectorSize)
+{
+        const int32 ExpectedCells = InSettings.GridSize.X * InSettings.GridSize.Y;
+        TSharedRef<TArray<uint8>> DefaultWeights = MakeShared<TArray<uint8>>();
+        DefaultWeights->Init(255, ExpectedCells);
+
+        Graph = MakeShared<FFlowFieldSectorGraph>(InSettings, InSectorSize, DefaultWeights);
+        ResetSearch();
+}
+
+void FHierarchicalFlowField::SetTraversalWeights(const TArray<uint8>& InWeights)
+{
+        SetSharedTraversalWeights(MakeShared<TArray<uint8>>(InWeights));
+}
+
+void FHierarchicalFlowField::SetSharedTraversalWeights(const TSharedPtr<const TArray<uint8>>& InWeights)
+{
+        const FFlowFieldSettings& Settings = Graph->GetSettings();
+        const int32 ExpectedCells = Settings.GridSize.X * Settings.GridSize.Y;
+        if (ensureMsgf(InWeights.IsValid() && InWeights->Num() == ExpectedCells, TEXT("Traversal weight array does not match grid dimensions")))
+        {
+                Graph = MakeShared<FFlowFieldSectorGraph>(Settings, Graph->GetSectorSize(), InWeights);
+                ResetSearch();
+        }
+}
+
+bool FHierarchicalFlowField::Build(const FIntPoint& DestinationCell)
+{
+        if (!IsWalkable(DestinationCell))
+        {
+                return false;
+        }
+
+        ResetSearch();
+
+        const int32 NumNodes = Graph->Portals.Num() * 2;
+        NodeCosts.Init(InvalidCost, NumNodes);
+        SettledNodes.Init(false, NumNodes);
+        CoarseOpenList.Reset(Graph->Portals.Num());
+
+        Destination = DestinationCell;
+        bHasDestination = true;
+
+        // Seed the coarse search with the cost from the destination to every portal of its own sector.
+        const FSector& DestinationSector = Graph->Sectors[Graph->GetSectorIndex(DestinationCell)];
+        const FFlowFieldOpenCell Seed(Graph->ToLinearIndex(DestinationCell), 0.0f);
+
+        TArray<float> LocalCosts;
+        Graph->IntegrateRegion(DestinationSector.Bounds, DestinationSector.Bounds, MakeArrayView(&Seed, 1), LocalCosts, LocalOpenList);
+
+        for (const int32 Node : DestinationSector.Nodes)
+        {
+                const FIntPoint Local = Graph->GetNodeCell(Node) - DestinationSector.Bounds.Min;
+                const float Cost = LocalCosts[Local.Y * DestinationSector.Bounds.Width() + Local.X];
+                if (Cost < InvalidCost)
+                {
+                        NodeCosts[Node] = Cost;
+                        CoarseOpenList.Push(Node, Cost);
+                }
+        }
+
+        return true;
+}
+
+FVector2D FHierarchicalFlowField::GetDirectionForCell(const FIntPoint& Cell) const
+{
+        if (!bHasDestination || !Graph->IsCellValid(Cell))
+        {
+                return FVector2D::ZeroVector;
+        }
+
+        const int32 SectorIndex = Graph->GetSectorIndex(Cell);
+        const TArray<FVector2D>* Directions = SectorDirections.Find(SectorIndex);
+        if (!Directions)
+        {
+                IntegrateSector(SectorIndex);
+                Directions = SectorDirections.Find(SectorIndex);
+        }
+
+        const FIntRect& Bounds = Graph->Sectors[SectorIndex].Bounds;
+        const FIntPoint Local = Cell - Bounds.Min;
+        return (*Directions)[Local.Y * Bounds.Width() + Local.X];
+}
+
+FIntPoint FHierarchicalFlowField::WorldToCell(const FVector& WorldPosition) const
+{
+        const FFlowFieldSettings& Settings = Graph->GetSettings();
+        const FVector Local = WorldPosition - Settings.Origin;
+        const int32 X = FMath::FloorToInt(Local.X / Settings.CellSize);
+        const int32 Y = FMath::FloorToInt(Local.Y / Settings.CellSize);
+        return FIntPoint(X, Y);
+}
+
+FVector FHierarchicalFlowField::CellToWorld(const FIntPoint& Cell) const
+{
+        const FFlowFieldSettings& Settings = Graph->GetSettings();
+        return Settings.Origin + FVector((Cell.X + 0.5f) * Settings.CellSize, (Cell.Y + 0.5f) * Settings.CellSize, 0.0f);
+}
+
+FVector FHierarchicalFlowField::GetDirectionForWorldPosition(const FVector& WorldPosition) const
+{
+        return FVector(GetDirectionForCell(WorldToCell(WorldPosition)), 0.0f);
+}
+
+void FHierarchicalFlowField::SampleDirections(TConstArrayView<FVector> WorldPositions, TArrayView<FVector> OutDirections) const
+{
+        if (!ensureMsgf(OutDirections.Num() >= WorldPositions.Num(), TEXT("Flow field sample output is smaller than the input")))
+        {
+                return;
+        }
+
+        const FFlowFieldSettings& Settings = Graph->GetSettings();
+        FlowFieldIntegration::SampleDirectionsBilinear(Settings.Origin, Settings.CellSize, Settings.GridSize, WorldPositions, OutDirections, [this](int32 X, int32 Y)
+        {
+                return GetDirectionForCell(FIntPoint(X, Y));
+        });
+}
+
+SIZE_T FHierarchicalFlowField::GetAllocatedSize() const
+{
+        SIZE_T Size = SectorDirections.GetAllocatedSize() + NodeCosts.GetAllocatedSize() + SettledNodes.GetAllocatedSize();
+        for (const TPair<int32, TArray<FVector2D>>& Pair : SectorDirections)
+        {
+                Size += Pair.Value.GetAllocatedSize();
+        }
+
+        return Size;
+}
+
+void FHierarchicalFlowField::ResetSearch()
+{
+        SectorDirections.Reset();
+        NodeCosts.Reset();
+        SettledNodes.Empty();
+        CoarseOpenList.Reset(0);
+        Destination = FIntPoint(-1, -1);
+        bHasDestination = false;
+}
+
+void FHierarchicalFlowField::AdvanceCoarseSearch(const int32 SectorIndex) const
+{
+        // A sector can be integrated once its own portal nodes and the nodes facing them are final.
+        auto IsSectorSettled = [this, SectorIndex]()
+        {
+                for (const int32 Node : Graph->Sectors[SectorIndex].Nodes)
+                {
+                        if (!SettledNodes[Node] || !SettledNodes[Node ^ 1])
+                        {
+                                return false;
+                        }
+                }
+
+                return true;
+        };
+
+        const TArray<uint8>& TraversalWeights = *Graph->TraversalWeights;
+        const FFlowFieldStepCostTable& StepCosts = Graph->StepCosts;
+
+        FFlowFieldOpenCell Current;
+        while (!IsSectorSettled() && CoarseOpenList.Pop(Current))
+        {
+                const int32 Node = Current.Index;
+                if (SettledNodes[Node] || Current.Cost > NodeCosts[Node] + KINDA_SMALL_NUMBER)
+                {
+                        continue;
+                }
+
+                SettledNodes[Node] = true;
+
+                auto Relax = [this](int32 TargetNode, float NewCost)
+                {
+                        if (!SettledNodes[TargetNode] && NewCost + KINDA_SMALL_NUMBER < NodeCosts[TargetNode])
+                        {
+                                NodeCosts[TargetNode] = NewCost;
+                                CoarseOpenList.Push(TargetNode, NewCost);
+                        }
+                };
+
+                // Crossing the portal enters the cell facing this one.
+                const FPortal& Portal = Graph->Portals[FFlowFieldSectorGraph::GetNodePortal(Node)];
+                Relax(Node ^ 1, Current.Cost + StepCosts.Cardinal[TraversalWeights[Graph->ToLinearIndex(Graph->GetNodeCell(Node ^ 1))]]);
+
+                // Moving through the sector reaches every other portal of that sector.
+                const FSector& Sector = Graph->Sectors[Portal.Sectors[FFlowFieldSectorGraph::GetNodeSide(Node)]];
+                Graph->EnsureNodeDistances(Sector, LocalOpenList);
+
+                const int32 NumNodes = Sector.Nodes.Num();
+                const int32 From = Sector.Nodes.Find(Node);
+                for (int32 To = 0; To < NumNodes; ++To)
+                {
+                        const float Distance = Sector.NodeDistances[From * NumNodes + To];
+                        if (To != From && Distance < InvalidCost)
+                        {
+                                Relax(Sector.Nodes[To], Current.Cost + Distance);
+                        }
+                }
+        }
+}
+
+void FHierarchicalFlowField::IntegrateSector(int32 SectorIndex) const
+{
+        AdvanceCoarseSearch(SectorIndex);
+
+        const FFlowFieldSettings& Settings = Graph->GetSettings();
+        const FSector& Sector = Graph->Sectors[SectorIndex];
+        FIntRect Region = Sector.Bounds;
+        Region.InflateRect(1);
+        Region.Clip(FIntRect(FIntPoint::ZeroValue, Settings.GridSize));
+
+        // Seed the halo cells behind each portal with the cost of the node facing the sector.
+        TArray<FFlowFieldOpenCell> Seeds;
+        if (Sector.Bounds.Contains(Destination))
+        {
+                Seeds.Emplace(Graph->ToLinearIndex(Destination), 0.0f);
+        }
+
+        for (const int32 Node : Sector.Nodes)
+        {
+                const float FacingCost = NodeCosts[Node ^ 1];
+                if (FacingCost >= InvalidCost)
+                {
+                        continue;
+                }
+
+                const FPortal& Portal = Graph->Portals[FFlowFieldSectorGraph::GetNodePortal(Node)];
+                const int32 FacingSide = FFlowFieldSectorGraph::GetNodeSide(Node) ^ 1;
+                const TArray<float>& WindowCosts = Portal.WindowCosts[FacingSide];
+                for (int32 Offset = 0; Offset < Portal.Length; ++Offset)
+                {
+                        const float WindowCost = WindowCosts.IsValidIndex(Offset) ? WindowCosts[Offset] : 0.0f;
+                        Seeds.Emplace(Graph->ToLinearIndex(Portal.Start[FacingSide] + Portal.Step * Offset), FacingCost + WindowCost);
+                }
+        }
+
+        TArray<float> LocalCosts;
+        Graph->IntegrateRegion(Region, Sector.Bounds, Seeds, LocalCosts, LocalOpenList);
+
+        const int32 RegionWidth = Region.Width();
+        const int32 NumOffsets = Settings.bAllowDiagonal ? FlowFieldIntegration::NumNeighborOffsets : FlowFieldIntegration::NumCardinalOffsets;
+        float NeighborCosts[FlowFieldIntegration::NumNeighborOffsets];
+
+        TArray<FVector2D>& Directions = SectorDirections.Add(SectorIndex);
+        Directions.SetNumUninitialized(Sector.Bounds.Area());
+        for (int32 CellY = Sector.Bounds.Min.Y; CellY < Sector.Bounds.Max.Y; ++CellY)
+        {
+                for (int32 CellX = Sector.Bounds.Min.X; CellX < Sector.Bounds.Max.X; ++CellX)
+                {
+                        const int32 DirectionIndex = (CellY - Sector.Bounds.Min.Y) * Sector.Bounds.Width() + (CellX - Sector.Bounds.Min.X);
+                        const float CellCost = LocalCosts[(CellY - Region.Min.Y) * RegionWidth + (CellX - Region.Min.X)];
+                        if (CellCost >= InvalidCost)
+                        {
+                                Directions[DirectionIndex] = FVector2D::ZeroVector;
+                                continue;
+                        }
+
+                        for (int32 OffsetIndex = 0; OffsetIndex < NumOffsets; ++OffsetIndex)
+                        {
+                                const FIntPoint Neighbor(CellX + NeighborOffsets[OffsetIndex].X, CellY + NeighborOffsets[OffsetIndex].Y);
+                                NeighborCosts[OffsetIndex] = Region.Contains(Neighbor)
+                                        ? LocalCosts[(Neighbor.Y - Region.Min.Y) * RegionWidth + (Neighbor.X - Region.Min.X)]
+                                        : InvalidCost;
+                        }
+
+                        Directions[DirectionIndex] = FlowFieldIntegration::ResolveDirection(CellCost, NeighborCosts, NumOffsets, Settings.bSmoothDirections);
+                }
+        }
+}
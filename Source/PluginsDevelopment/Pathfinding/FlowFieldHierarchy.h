@@ -0,0 +1,163 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "FlowField.h"
+#include "FlowFieldIntegration.h"
+
+/**
+ * Sector and portal topology built over one set of traversal weights.
+ * Shared by every hierarchical field built over the same weights so caching fields for several destinations does not
+ * duplicate the weights, the portals or the intra-sector portal distances.
+ */
+class PLUGINSDEVELOPMENT_API FFlowFieldSectorGraph
+{
+public:
+        FFlowFieldSectorGraph(const FFlowFieldSettings& InSettings, int32 InSectorSize, const TSharedPtr<const TArray<uint8>>& InWeights);
+
+        /** Returns the settings the graph was built with. */
+        const FFlowFieldSettings& GetSettings() const { return Settings; }
+
+        /** Returns the number of cells along each side of a sector. */
+        int32 GetSectorSize() const { return SectorSize; }
+
+        /** Number of portals in the coarse graph. */
+        int32 GetNumPortals() const { return Portals.Num(); }
+
+        /** Returns true if the given cell is inside the grid and walkable. */
+        bool IsWalkable(const FIntPoint& Cell) const;
+
+        /** Approximate memory used by the graph, including the shared weights. */
+        SIZE_T GetAllocatedSize() const;
+
+private:
+        friend class FHierarchicalFlowField;
+
+        /** Window of walkable cell pairs shared by two adjacent sectors. Each portal contributes one coarse node per side. */
+        struct FPortal
+        {
+                int32 Sectors[2] = { INDEX_NONE, INDEX_NONE };
+                FIntPoint Start[2];
+                FIntPoint Center[2];
+                FIntPoint Step = FIntPoint(0, 1);
+                int32 Length = 0;
+
+                /** Cost from the centre to every window cell on each side, filled with the owning sector's node distances. */
+                mutable TArray<float> WindowCosts[2];
+        };
+
+        struct FSector
+        {
+                FIntRect Bounds;
+
+                /** Coarse nodes (Portal * 2 + Side) lying inside this sector. */
+                TArray<int32> Nodes;
+
+                /** Cost from Nodes[From] to Nodes[To], stored row-major. Filled the first time a coarse search expands the sector. */
+                mutable TArray<float> NodeDistances;
+                mutable bool bHasNodeDistances = false;
+        };
+
+        static int32 MakeNode(int32 PortalIndex, int32 Side) { return PortalIndex * 2 + Side; }
+        static int32 GetNodePortal(int32 Node) { return Node / 2; }
+        static int32 GetNodeSide(int32 Node) { return Node & 1; }
+
+        bool IsCellValid(const FIntPoint& Cell) const;
+        int32 ToLinearIndex(const FIntPoint& Cell) const { return Cell.Y * Settings.GridSize.X + Cell.X; }
+        int32 GetSectorIndex(const FIntPoint& Cell) const;
+        const FIntPoint& GetNodeCell(int32 Node) const { return Portals[GetNodePortal(Node)].Center[GetNodeSide(Node)]; }
+
+        void AddPortalsAlongEdge(int32 SectorA, int32 SectorB, const FIntPoint& FirstCellA, const FIntPoint& EdgeStep, const FIntPoint& CrossStep, int32 EdgeLength);
+
+        /**
+         * Local Dijkstra restricted to Region. Seeds may lie outside Walkable but cells are only relaxed inside it.
+         * OutCosts is laid out row-major over Region.
+         */
+        void IntegrateRegion(const FIntRect& Region, const FIntRect& Walkable, TConstArrayView<FFlowFieldOpenCell> Seeds, TArray<float>& OutCosts, FFlowFieldBinaryHeap& OpenList) const;
+
+        void EnsureNodeDistances(const FSector& Sector, FFlowFieldBinaryHeap& OpenList) const;
+
+        FFlowFieldSettings Settings;
+        int32 SectorSize = 32;
+        FIntPoint NumSectors = FIntPoint::ZeroValue;
+        TSharedPtr<const TArray<uint8>> TraversalWeights;
+        FFlowFieldStepCostTable StepCosts;
+        TArray<FPortal> Portals;
+        TArray<FSector> Sectors;
+};
+
+/**
+ * Flow field split into fixed size sectors connected by a portal graph.
+ * Build only seeds a coarse search over the portals; the coarse search and the per sector integration both
+ * advance lazily the first time a sector is sampled, so a build only touches the sectors agents actually walk through.
+ * Copies share the sector graph and only duplicate the per destination state.
+ */
+class PLUGINSDEVELOPMENT_API FHierarchicalFlowField
+{
+public:
+        explicit FHierarchicalFlowField(const FFlowFieldSettings& InSettings = FFlowFieldSettings(), int32 InSectorSize = 32);
+
+        /** Updates the settings and sector size, resetting the weights and any built sector. */
+        void ApplySettings(const FFlowFieldSettings& InSettings, int32 InSectorSize);
+
+        /** Sets the traversal weights (same convention as FFlowField::SetTraversalWeights) and rebuilds the portal graph. */
+        void SetTraversalWeights(const TArray<uint8>& InWeights);
+
+        /** Same as SetTraversalWeights but shares the supplied buffer instead of copying it. */
+        void SetSharedTraversalWeights(const TSharedPtr<const TArray<uint8>>& InWeights);
+
+        /** Returns the current settings. */
+        const FFlowFieldSettings& GetSettings() const { return Graph->GetSettings(); }
+
+        /** Returns the number of cells along each side of a sector. */
+        int32 GetSectorSize() const { return Graph->GetSectorSize(); }
+
+        /** Returns true if the given cell is walkable. */
+        bool IsWalkable(const FIntPoint& Cell) const { return Graph->IsWalkable(Cell); }
+
+        /** Starts a new coarse search towards the destination cell. Returns false if the destination is invalid or blocked. */
+        bool Build(const FIntPoint& DestinationCell);
+
+        /** Returns the direction (normalised) for the supplied cell, integrating its sector on first use. */
+        FVector2D GetDirectionForCell(const FIntPoint& Cell) const;
+
+        /** Converts a world position into a cell coordinate. */
+        FIntPoint WorldToCell(const FVector& WorldPosition) const;
+
+        /** Converts a cell coordinate into a world position at the cell centre. */
+        FVector CellToWorld(const FIntPoint& Cell) const;
+
+        /** Samples the flow field direction for a given world position. */
+        FVector GetDirectionForWorldPosition(const FVector& WorldPosition) const;
+
+        /** Bilinear batch sampling, see FFlowField::SampleDirections. Integrates the sampled sectors on first use. */
+        void SampleDirections(TConstArrayView<FVector> WorldPositions, TArrayView<FVector> OutDirections) const;
+
+        /** Number of sectors integrated since the last build. */
+        int32 GetNumBuiltSectors() const { return SectorDirections.Num(); }
+
+        /** Number of portals in the coarse graph. */
+        int32 GetNumPortals() const { return Graph->GetNumPortals(); }
+
+        /** Approximate memory owned by this field for its destination, excluding the shared sector graph. */
+        SIZE_T GetAllocatedSize() const;
+
+private:
+        using FPortal = FFlowFieldSectorGraph::FPortal;
+        using FSector = FFlowFieldSectorGraph::FSector;
+
+        void ResetSearch();
+        void AdvanceCoarseSearch(int32 SectorIndex) const;
+        void IntegrateSector(int32 SectorIndex) const;
+
+        TSharedPtr<const FFlowFieldSectorGraph> Graph;
+        FIntPoint Destination = FIntPoint(-1, -1);
+        bool bHasDestination = false;
+
+        /** Lazily evaluated state. Sampling is logically const, so the caches are mutable. */
+        mutable TMap<int32, TArray<FVector2D>> SectorDirections;
+        mutable TArray<float> NodeCosts;
+        mutable TBitArray<> SettledNodes;
+        mutable FFlowFieldBinaryHeap CoarseOpenList;
+        mutable FFlowFieldBinaryHeap LocalOpenList;
+};
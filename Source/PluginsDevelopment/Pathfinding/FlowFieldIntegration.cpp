@@ -0,0 +1,354 @@
+#include "FlowFieldIntegration.h"
+#include "FlowField.h"
+
+namespace
+{
+        bool IsCheaper(const FFlowFieldOpenCell& A, const FFlowFieldOpenCell& B)
+        {
+                return A.Cost < B.Cost;
+        }
+
+        bool IsMoreExpensive(const FFlowFieldOpenCell& A, const FFlowFieldOpenCell& B)
+        {
+                return A.Cost > B.Cost;
+        }
+
+        /** Unit vector of every neighbour offset, in NeighborOffsets order. */
+        constexpr float DiagonalComponent = 0.70710678118654752f;
+        constexpr float UnitOffsetX[FlowFieldIntegration::NumNeighborOffsets] = { 1.0f, -1.0f, 0.0f, 0.0f, DiagonalComponent, DiagonalComponent, -DiagonalComponent, -DiagonalComponent };
+        constexpr float UnitOffsetY[FlowFieldIntegration::NumNeighborOffsets] = { 0.0f, 0.0f, 1.0f, -1.0f, DiagonalComponent, -DiagonalComponent, DiagonalComponent, -DiagonalComponent };
+
+        /**
+         * Scalar direction resolve. Everything is computed in float with one operation per statement so the vector kernel
+         * can reproduce it exactly; offsets are unit steps, so weighting them by a cost delta reduces to adding or
+         * subtracting the delta.
+         */
+        void ResolveDirectionComponents(float CellCost, const float* NeighborCosts, int32 NumNeighbors, bool bSmoothDirections, float& OutX, float& OutY)
+        {
+                using FlowFieldIntegration::NeighborOffsets;
+
+                float BestCost = CellCost;
+                int32 BestOffset = INDEX_NONE;
+                float SmoothedX = 0.0f;
+                float SmoothedY = 0.0f;
+
+                for (int32 OffsetIndex = 0; OffsetIndex < NumNeighbors; ++OffsetIndex)
+                {
+                        const float NeighborCost = NeighborCosts[OffsetIndex];
+                        if (NeighborCost < BestCost)
+                        {
+                                BestCost = NeighborCost;
+                                BestOffset = OffsetIndex;
+                        }
+
+                        const float CostDelta = CellCost - NeighborCost;
+                        if (CostDelta > 0.0f)
+                        {
+                                const FIntPoint& Offset = NeighborOffsets[OffsetIndex];
+                                if (Offset.X != 0)
+                                {
+                                        SmoothedX = Offset.X > 0 ? SmoothedX + CostDelta : SmoothedX - CostDelta;
+                                }
+
+                                if (Offset.Y != 0)
+                                {
+                                        SmoothedY = Offset.Y > 0 ? SmoothedY + CostDelta : SmoothedY - CostDelta;
+                                }
+                        }
+                }
+
+                OutX = 0.0f;
+                OutY = 0.0f;
+                if (BestOffset == INDEX_NONE)
+                {
+                        return;
+                }
+
+                if (!bSmoothDirections)
+                {
+                        OutX = UnitOffsetX[BestOffset];
+                        OutY = UnitOffsetY[BestOffset];
+                        return;
+                }
+
+                const float SquaredX = SmoothedX * SmoothedX;
+                const float SquaredY = SmoothedY * SmoothedY;
+                const float SquaredSize = SquaredX + SquaredY;
+                if (SquaredSize > UE_SMALL_NUMBER)
+                {
+                        const float Scale = 1.0f / FMath::Sqrt(SquaredSize);
+                        OutX = SmoothedX * Scale;
+                        OutY = SmoothedY * Scale;
+                }
+        }
+}
+
+const FIntPoint FlowFieldIntegration::NeighborOffsets[NumNeighborOffsets] = {
+        FIntPoint(1, 0),
+        FIntPoint(-1, 0),
+        FIntPoint(0, 1),
+        FIntPoint(0, -1),
+        FIntPoint(1, 1),
+        FIntPoint(1, -1),
+        FIntPoint(-1, 1),
+        FIntPoint(-1, -1)
+};
+
+FVector2D FlowFieldIntegration::ResolveDirection(float CellCost, const float* NeighborCosts, int32 NumNeighbors, bool bSmoothDirections)
+{
+        float DirectionX = 0.0f;
+        float DirectionY = 0.0f;
+        ResolveDirectionComponents(CellCost, NeighborCosts, NumNeighbors, bSmoothDirections, DirectionX, DirectionY);
+        return FVector2D(DirectionX, DirectionY);
+}
+
+void FlowFieldIntegration::ResolveInteriorDirections(const float* Costs, int32 RowStride, int32 NumCells, bool bAllowDiagonal, bool bSmoothDirections, float* OutX, float* OutY)
+{
+        const int32 NumOffsets = bAllowDiagonal ? NumNeighborOffsets : NumCardinalOffsets;
+        int32 NeighborDeltas[NumNeighborOffsets];
+        for (int32 OffsetIndex = 0; OffsetIndex < NumOffsets; ++OffsetIndex)
+        {
+                NeighborDeltas[OffsetIndex] = NeighborOffsets[OffsetIndex].Y * RowStride + NeighborOffsets[OffsetIndex].X;
+        }
+
+        const VectorRegister4Float Zero = VectorZeroFloat();
+        const VectorRegister4Float Invalid = VectorSetFloat1(InvalidCost);
+        const VectorRegister4Float SmallNumber = VectorSetFloat1(UE_SMALL_NUMBER);
+
+        // Mirrors ResolveDirectionComponents lane by lane. Masked out deltas add zero, which leaves the sums unchanged.
+        int32 Cell = 0;
+        for (; Cell + 4 <= NumCells; Cell += 4)
+        {
+                const float* CellCosts = Costs + Cell;
+                const VectorRegister4Float CellCost = VectorLoad(CellCosts);
+
+                VectorRegister4Float BestCost = CellCost;
+                VectorRegister4Float BestX = Zero;
+                VectorRegister4Float BestY = Zero;
+                VectorRegister4Float SmoothedX = Zero;
+                VectorRegister4Float SmoothedY = Zero;
+
+                for (int32 OffsetIndex = 0; OffsetIndex < NumOffsets; ++OffsetIndex)
+                {
+                        const VectorRegister4Float NeighborCost = VectorLoad(CellCosts + NeighborDeltas[OffsetIndex]);
+
+                        const VectorRegister4Float Cheaper = VectorCompareLT(NeighborCost, BestCost);
+                        BestCost = VectorSelect(Cheaper, NeighborCost, BestCost);
+                        BestX = VectorSelect(Cheaper, VectorSetFloat1(UnitOffsetX[OffsetIndex]), BestX);
+                        BestY = VectorSelect(Cheaper, VectorSetFloat1(UnitOffsetY[OffsetIndex]), BestY);
+
+                        const VectorRegister4Float CostDelta = VectorSubtract(CellCost, NeighborCost);
+                        const VectorRegister4Float PositiveDelta = VectorSelect(VectorCompareGT(CostDelta, Zero), CostDelta, Zero);
+
+                        const FIntPoint& Offset = NeighborOffsets[OffsetIndex];
+                        if (Offset.X != 0)
+                        {
+                                SmoothedX = Offset.X > 0 ? VectorAdd(SmoothedX, PositiveDelta) : VectorSubtract(SmoothedX, PositiveDelta);
+                        }
+
+                        if (Offset.Y != 0)
+                        {
+                                SmoothedY = Offset.Y > 0 ? VectorAdd(SmoothedY, PositiveDelta) : VectorSubtract(SmoothedY, PositiveDelta);
+                        }
+                }
+
+                VectorRegister4Float DirectionX = BestX;
+                VectorRegister4Float DirectionY = BestY;
+                if (bSmoothDirections)
+                {
+                        const VectorRegister4Float SquaredSize = VectorAdd(VectorMultiply(SmoothedX, SmoothedX), VectorMultiply(SmoothedY, SmoothedY));
+                        const VectorRegister4Float Scale = VectorDivide(VectorOneFloat(), VectorSqrt(SquaredSize));
+                        const VectorRegister4Float CanNormalize = VectorCompareGT(SquaredSize, SmallNumber);
+                        DirectionX = VectorSelect(CanNormalize, VectorMultiply(SmoothedX, Scale), Zero);
+                        DirectionY = VectorSelect(CanNormalize, VectorMultiply(SmoothedY, Scale), Zero);
+                }
+
+                const VectorRegister4Float HasDirection = VectorBitwiseAnd(VectorCompareLT(CellCost, Invalid), VectorCompareLT(BestCost, CellCost));
+                VectorStore(VectorSelect(HasDirection, DirectionX, Zero), OutX + Cell);
+                VectorStore(VectorSelect(HasDirection, DirectionY, Zero), OutY + Cell);
+        }
+
+        for (; Cell < NumCells; ++Cell)
+        {
+                const float* CellCosts = Costs + Cell;
+                OutX[Cell] = 0.0f;
+                OutY[Cell] = 0.0f;
+                if (CellCosts[0] >= InvalidCost)
+                {
+                        continue;
+                }
+
+                float NeighborCosts[NumNeighborOffsets];
+                for (int32 OffsetIndex = 0; OffsetIndex < NumOffsets; ++OffsetIndex)
+                {
+                        NeighborCosts[OffsetIndex] = CellCosts[NeighborDeltas[OffsetIndex]];
+                }
+
+                ResolveDirectionComponents(CellCosts[0], NeighborCosts, NumOffsets, bSmoothDirections, OutX[Cell], OutY[Cell]);
+        }
+}
+
+void FFlowFieldStepCostTable::Build(const FFlowFieldSettings& Settings)
+{
+        const float CardinalStepCost = Settings.StepCost;
+        const float DiagonalStepCost = Settings.StepCost * Settings.DiagonalCostMultiplier;
+
+        MinStepCost = TNumericLimits<float>::Max();
+        MaxStepCost = 0.0f;
+
+        Cardinal[0] = TNumericLimits<float>::Max();
+        Diagonal[0] = TNumericLimits<float>::Max();
+
+        for (int32 Weight = 1; Weight < 256; ++Weight)
+        {
+                const float NormalisedWeight = static_cast<float>(Weight) / 255.0f;
+                const float SafeWeight = FMath::Max(NormalisedWeight, KINDA_SMALL_NUMBER);
+
+                Cardinal[Weight] = (CardinalStepCost * Settings.CellTraversalWeightMultiplier / SafeWeight) * Settings.HeuristicWeight;
+                Diagonal[Weight] = (DiagonalStepCost * Settings.CellTraversalWeightMultiplier / SafeWeight) * Settings.HeuristicWeight;
+
+                MinStepCost = FMath::Min(MinStepCost, Cardinal[Weight]);
+                MaxStepCost = FMath::Max(MaxStepCost, Cardinal[Weight]);
+
+                if (Settings.bAllowDiagonal)
+                {
+                        MinStepCost = FMath::Min(MinStepCost, Diagonal[Weight]);
+                        MaxStepCost = FMath::Max(MaxStepCost, Diagonal[Weight]);
+                }
+        }
+}
+
+void FFlowFieldBinaryHeap::Reset(int32 ExpectedCells)
+{
+        Heap.Reset(ExpectedCells);
+}
+
+void FFlowFieldBinaryHeap::Push(int32 Index, float Cost)
+{
+        Heap.HeapPush(FFlowFieldOpenCell(Index, Cost), IsCheaper);
+}
+
+bool FFlowFieldBinaryHeap::Pop(FFlowFieldOpenCell& OutCell)
+{
+        if (Heap.Num() == 0)
+        {
+                return false;
+        }
+
+        Heap.HeapPop(OutCell, IsCheaper, EAllowShrinking::No);
+        return true;
+}
+
+bool FFlowFieldBucketQueue::Configure(float MinStepCost, float MaxStepCost)
+{
+        if (!FMath::IsFinite(MinStepCost) || !FMath::IsFinite(MaxStepCost) || MinStepCost <= KINDA_SMALL_NUMBER || MaxStepCost < MinStepCost)
+        {
+                return false;
+        }
+
+        // Live cells span at most one step beyond the current bucket, plus one bucket of slack for rounding.
+        const float BucketSpan = MaxStepCost / MinStepCost;
+        if (BucketSpan >= static_cast<float>(MaxBuckets - 2))
+        {
+                return false;
+        }
+
+        const int32 NumBuckets = FMath::CeilToInt(BucketSpan) + 2;
+        if (Buckets.Num() != NumBuckets)
+        {
+                Buckets.SetNum(NumBuckets);
+        }
+
+        InvBucketWidth = 1.0f / MinStepCost;
+        Reset();
+        return true;
+}
+
+void FFlowFieldBucketQueue::Reset()
+{
+        for (TArray<FFlowFieldOpenCell>& Bucket : Buckets)
+        {
+                Bucket.Reset();
+        }
+
+        CurrentBucketKey = 0;
+        NumQueued = 0;
+        bCurrentBucketSorted = false;
+}
+
+SIZE_T FFlowFieldBucketQueue::GetAllocatedSize() const
+{
+        SIZE_T Size = Buckets.GetAllocatedSize();
+        for (const TArray<FFlowFieldOpenCell>& Bucket : Buckets)
+        {
+                Size += Bucket.GetAllocatedSize();
+        }
+
+        return Size;
+}
+
+int64 FFlowFieldBucketQueue::GetBucketKey(float Cost) const
+{
+        return FMath::Max(CurrentBucketKey, static_cast<int64>(FMath::FloorToDouble(static_cast<double>(Cost) * InvBucketWidth)));
+}
+
+void FFlowFieldBucketQueue::Push(int32 Index, float Cost)
+{
+        check(Buckets.Num() > 0);
+
+        const int64 BucketKey = GetBucketKey(Cost);
+        checkSlow(BucketKey - CurrentBucketKey < Buckets.Num());
+
+        TArray<FFlowFieldOpenCell>& Bucket = GetBucket(BucketKey);
+        if (NumQueued == 0)
+        {
+                CurrentBucketKey = BucketKey;
+                bCurrentBucketSorted = false;
+        }
+
+        if (BucketKey == CurrentBucketKey && bCurrentBucketSorted)
+        {
+                // Rare: rounding placed the cell in the bucket being drained, keep it ordered.
+                int32 InsertIndex = Bucket.Num();
+                while (InsertIndex > 0 && Bucket[InsertIndex - 1].Cost < Cost)
+                {
+                        --InsertIndex;
+                }
+
+                Bucket.Insert(FFlowFieldOpenCell(Index, Cost), InsertIndex);
+        }
+        else
+        {
+                Bucket.Emplace(Index, Cost);
+        }
+
+        ++NumQueued;
+}
+
+bool FFlowFieldBucketQueue::Pop(FFlowFieldOpenCell& OutCell)
+{
+        if (NumQueued == 0)
+        {
+                return false;
+        }
+
+        while (true)
+        {
+                TArray<FFlowFieldOpenCell>& Bucket = GetBucket(CurrentBucketKey);
+                if (Bucket.Num() > 0)
+                {
+                        if (!bCurrentBucketSorted)
+                        {
+                                Bucket.Sort(IsMoreExpensive);
+                                bCurrentBucketSorted = true;
+                        }
+
+                        OutCell = Bucket.Pop(EAllowShrinking::No);
+                        --NumQueued;
+                        return true;
+                }
+
+                ++CurrentBucketKey;
+                bCurrentBucketSorted = false;
+        }
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FFlowFieldSettings;
+
+namespace FlowFieldIntegration
+{
+        /** Sentinel integration value of unreached or blocked cells. */
+        inline constexpr float InvalidCost = TNumericLimits<float>::Max();
+
+        /** Neighbour offsets, the four cardinals first followed by the four diagonals. */
+        inline constexpr int32 NumCardinalOffsets = 4;
+        inline constexpr int32 NumNeighborOffsets = 8;
+        extern PLUGINSDEVELOPMENT_API const FIntPoint NeighborOffsets[NumNeighborOffsets];
+
+        /**
+         * Resolves the flow direction of a reachable cell from its integration value and the values of its neighbours.
+         * NeighborCosts follows NeighborOffsets order and uses InvalidCost for neighbours outside the grid.
+         */
+        PLUGINSDEVELOPMENT_API FVector2D ResolveDirection(float CellCost, const float* NeighborCosts, int32 NumNeighbors, bool bSmoothDirections);
+
+        /**
+         * Resolves the directions of NumCells consecutive cells of a row, four cells per vector instruction.
+         * Every cell must have its eight neighbours inside the grid; Costs points at the first cell and RowStride is the
+         * grid width. Produces bit for bit the values ResolveDirection returns for the same cells.
+         */
+        PLUGINSDEVELOPMENT_API void ResolveInteriorDirections(const float* Costs, int32 RowStride, int32 NumCells, bool bAllowDiagonal, bool bSmoothDirections, float* OutX, float* OutY);
+
+        /**
+         * Samples a direction grid at every world position by blending the four surrounding cell centres, clamped at the
+         * grid border. Cells without a direction simply do not contribute; positions outside the grid get a zero direction.
+         * GetDirection(X, Y) returns the direction stored for a cell inside the grid.
+         */
+        template <typename DirectionGetterType>
+        void SampleDirectionsBilinear(const FVector& Origin, float CellSize, const FIntPoint& GridSize, TConstArrayView<FVector> WorldPositions, TArrayView<FVector> OutDirections, DirectionGetterType&& GetDirection)
+        {
+                const double InvCellSize = 1.0 / CellSize;
+                const int32 LastX = GridSize.X - 1;
+                const int32 LastY = GridSize.Y - 1;
+
+                for (int32 Index = 0; Index < WorldPositions.Num(); ++Index)
+                {
+                        const double CellX = (WorldPositions[Index].X - Origin.X) * InvCellSize;
+                        const double CellY = (WorldPositions[Index].Y - Origin.Y) * InvCellSize;
+                        if (CellX < 0.0 || CellY < 0.0 || CellX >= GridSize.X || CellY >= GridSize.Y)
+                        {
+                                OutDirections[Index] = FVector::ZeroVector;
+                                continue;
+                        }
+
+                        // Interpolate between cell centres, which sit half a cell from the cell corners.
+                        const double SampleX = CellX - 0.5;
+                        const double SampleY = CellY - 0.5;
+                        const int32 X0 = FMath::FloorToInt32(SampleX);
+                        const int32 Y0 = FMath::FloorToInt32(SampleY);
+                        const double FracX = SampleX - X0;
+                        const double FracY = SampleY - Y0;
+
+                        const int32 MinX = FMath::Max(X0, 0);
+                        const int32 MinY = FMath::Max(Y0, 0);
+                        const int32 MaxX = FMath::Min(X0 + 1, LastX);
+                        const int32 MaxY = FMath::Min(Y0 + 1, LastY);
+
+                        const FVector2D Blended = GetDirection(MinX, MinY) * ((1.0 - FracX) * (1.0 - FracY))
+                                + GetDirection(MaxX, MinY) * (FracX * (1.0 - FracY))
+                                + GetDirection(MinX, MaxY) * ((1.0 - FracX) * FracY)
+                                + GetDirection(MaxX, MaxY) * (FracX * FracY);
+
+                        OutDirections[Index] = FVector(Blended.GetSafeNormal(), 0.0);
+                }
+        }
+}
+
+/** Entry stored in the integration open lists. */
+struct FFlowFieldOpenCell
+{
+        FFlowFieldOpenCell() = default;
+        FFlowFieldOpenCell(int32 InIndex, float InCost)
+                : Index(InIndex)
+                , Cost(InCost)
+        {
+        }
+
+        int32 Index = INDEX_NONE;
+        float Cost = TNumericLimits<float>::Max();
+};
+
+/**
+ * Movement cost of entering a cell for every possible uint8 traversal weight.
+ * Values are computed with the exact same float operations the integration used to perform per neighbour,
+ * so looking them up yields bit-identical integration values.
+ */
+struct PLUGINSDEVELOPMENT_API FFlowFieldStepCostTable
+{
+        /** Fills the table from the supplied settings. */
+        void Build(const FFlowFieldSettings& Settings);
+
+        /** Cost of a cardinal step into a cell with the given weight. Weight 0 is blocked and never looked up. */
+        float Cardinal[256];
+
+        /** Cost of a diagonal step into a cell with the given weight. */
+        float Diagonal[256];
+
+        /** Smallest and largest cost of a single step over all walkable weights. */
+        float MinStepCost = 0.0f;
+        float MaxStepCost = 0.0f;
+};
+
+/** Open list backed by a binary heap. Pops cells in non-decreasing cost order for any cost configuration. */
+class PLUGINSDEVELOPMENT_API FFlowFieldBinaryHeap
+{
+public:
+        void Reset(int32 ExpectedCells);
+        void Push(int32 Index, float Cost);
+        bool Pop(FFlowFieldOpenCell& OutCell);
+        bool IsEmpty() const { return Heap.Num() == 0; }
+        int32 Num() const { return Heap.Num(); }
+        SIZE_T GetAllocatedSize() const { return Heap.GetAllocatedSize(); }
+
+private:
+        TArray<FFlowFieldOpenCell> Heap;
+};
+
+/**
+ * Dial style bucket queue. Bucket width equals the cheapest possible step so the lowest non-empty bucket can
+ * always be settled, and the quantised uint8 weights bound the number of live buckets to MaxStepCost / MinStepCost.
+ * The current bucket is sorted when it is entered, which keeps the pop order identical to the binary heap.
+ */
+class PLUGINSDEVELOPMENT_API FFlowFieldBucketQueue
+{
+public:
+        /** Maximum number of circular buckets before the heap is preferred. */
+        static constexpr int32 MaxBuckets = 4096;
+
+        /** Prepares the buckets for the supplied step cost range. Returns false when the range cannot be bucketed. */
+        bool Configure(float MinStepCost, float MaxStepCost);
+
+        void Reset();
+        void Push(int32 Index, float Cost);
+        bool Pop(FFlowFieldOpenCell& OutCell);
+        bool IsEmpty() const { return NumQueued == 0; }
+        int32 Num() const { return NumQueued; }
+        SIZE_T GetAllocatedSize() const;
+
+private:
+        int64 GetBucketKey(float Cost) const;
+        TArray<FFlowFieldOpenCell>& GetBucket(int64 BucketKey) { return Buckets[static_cast<int32>(BucketKey % Buckets.Num())]; }
+
+        /** Each bucket is kept in descending cost order once entered so the cheapest cell is popped from the back. */
+        TArray<TArray<FFlowFieldOpenCell>> Buckets;
+        float InvBucketWidth = 0.0f;
+        int64 CurrentBucketKey = 0;
+        int32 NumQueued = 0;
+        bool bCurrentBucketSorted = false;
+};
@@ -1,21 +1,61 @@
 #include "FlowFieldManager.h"
 
+#include "FlowFieldBakedData.h"
+#include "FlowFieldClearance.h"
+#include "Components/PrimitiveComponent.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Camera/PlayerCameraManager.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/Texture2D.h"
+#include "GameFramework/PlayerController.h"
+#include "Materials/MaterialInstanceDynamic.h"
+#include "UObject/ConstructorHelpers.h"
 #include "DrawDebugHelpers.h"
 #include "CollisionQueryParams.h"
 #include "CollisionShape.h"
 #include "Engine/World.h"
 #include "EngineUtils.h"
+#include "LandscapeHeightfieldCollisionComponent.h"
+#include "LandscapeLayerInfoObject.h"
 #include "LandscapeProxy.h"
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "HAL/PlatformTime.h"
+
+namespace
+{
+    /** Cells evaluated per worker thread between two budget checks of the time-sliced bake. */
+    constexpr int32 TimeSlicedBakeCellsPerWorker = 32;
+
+    void ZeroDirections(int32 NumDirections, TArrayView<FVector> OutDirections)
+    {
+        for (int32 Index = 0; Index < FMath::Min(NumDirections, OutDirections.Num()); ++Index)
+        {
+            OutDirections[Index] = FVector::ZeroVector;
+        }
+    }
+}
 
 AFlowFieldManager::AFlowFieldManager()
 {
     PrimaryActorTick.bCanEverTick = true;
     PrimaryActorTick.bStartWithTickEnabled = true;
+
+    static ConstructorHelpers::FObjectFinder<UStaticMesh> ArrowMesh(TEXT("/Engine/BasicShapes/Cone.Cone"));
+    static ConstructorHelpers::FObjectFinder<UStaticMesh> BlockedCellMesh(TEXT("/Engine/BasicShapes/Cube.Cube"));
+    static ConstructorHelpers::FObjectFinder<UStaticMesh> HeatmapMesh(TEXT("/Engine/BasicShapes/Plane.Plane"));
+    DebugArrowMesh = ArrowMesh.Object;
+    DebugBlockedCellMesh = BlockedCellMesh.Object;
+    DebugHeatmapMesh = HeatmapMesh.Object;
 }
 
 void AFlowFieldManager::Tick(float DeltaSeconds)
 {
     Super::Tick(DeltaSeconds);
+    TickTimeSlicedBake();
+    TickTimeSlicedBuilds();
+    ProcessAsyncBuilds();
     DrawDebug();
 }
 
@@ -23,22 +63,46 @@ void AFlowFieldManager::OnConstruction(const FTransform& Transform)
 {
     Super::OnConstruction(Transform);
     UpdateFlowFieldSettings();
-    UpdateTraversalWeights();
+
+    if (!TryApplyBakedTraversalWeights())
+    {
+        UpdateTraversalWeights();
+    }
 }
 
 void AFlowFieldManager::BeginPlay()
 {
     Super::BeginPlay();
     UpdateFlowFieldSettings();
-    UpdateTraversalWeights();
+
+    if (TryApplyBakedTraversalWeights())
+    {
+        return;
+    }
+
+    if (bTimeSliceTraversalBake)
+    {
+        StartTimeSlicedBake();
+    }
+    else
+    {
+        UpdateTraversalWeights();
+    }
+}
+
+void AFlowFieldManager::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    ClearFieldCache();
+    Super::EndPlay(EndPlayReason);
 }
 
 bool AFlowFieldManager::BuildFlowFieldToCell(const FIntPoint& DestinationCell)
 {
-    if (FlowField.Build(DestinationCell))
+    ActiveHandle = AcquireFlowFieldToCell(DestinationCell);
+    if (ActiveHandle.IsValid())
     {
         bHasBuiltField = true;
-        CachedDestinationWorld = FlowField.CellToWorld(DestinationCell);
+        CachedDestinationWorld = CellToWorld(ActiveHandle.Destination);
         RefreshDebugSnapshot();
         return true;
     }
@@ -51,173 +115,1410 @@ bool AFlowFieldManager::BuildFlowFieldToCell(const FIntPoint& DestinationCell)
 
 bool AFlowFieldManager::BuildFlowFieldToWorldLocation(const FVector& DestinationLocation)
 {
-    const FIntPoint Cell = FlowField.WorldToCell(DestinationLocation);
+    const FIntPoint Cell = WorldToCell(DestinationLocation);
     return BuildFlowFieldToCell(Cell);
 }
 
-FVector AFlowFieldManager::GetDirectionForWorldPosition(const FVector& WorldPosition) const
-{
-    if (!bHasBuiltField)
+FVector AFlowFieldManager::GetDirectionForWorldPosition(const FVector& WorldPosition) const
+{
+    if (!bHasBuiltField)
+    {
+        return FVector::ZeroVector;
+    }
+
+    const FCachedFlowField* Entry = FieldCache.Find(ActiveHandle.Key);
+    return Entry ? Entry->GetDirectionForWorldPosition(WorldPosition) : FVector::ZeroVector;
+}
+
+void AFlowFieldManager::SampleDirections(TConstArrayView<FVector> WorldPositions, TArrayView<FVector> OutDirections) const
+{
+    const FCachedFlowField* Entry = bHasBuiltField ? FieldCache.Find(ActiveHandle.Key) : nullptr;
+    if (Entry)
+    {
+        Entry->SampleDirections(WorldPositions, OutDirections);
+    }
+    else
+    {
+        ZeroDirections(WorldPositions.Num(), OutDirections);
+    }
+}
+
+void AFlowFieldManager::SampleDirectionsForHandle(const FFlowFieldHandle& Handle, TConstArrayView<FVector> WorldPositions, TArrayView<FVector> OutDirections)
+{
+    // Same rules as GetDirectionForHandle, paid once for the whole batch.
+    const FCachedFlowField* PendingEntry = Handle.IsValid() ? FieldCache.Find(Handle.Key) : nullptr;
+    const FCachedFlowField* Entry = nullptr;
+    if (Handle.IsValid() && (!PendingEntry || PendingEntry->IsReady()))
+    {
+        Entry = FindOrBuildCachedField(Handle.Key, Handle.Destination);
+    }
+
+    if (Entry)
+    {
+        Entry->SampleDirections(WorldPositions, OutDirections);
+    }
+    else
+    {
+        ZeroDirections(WorldPositions.Num(), OutDirections);
+    }
+}
+
+FFlowFieldHandle AFlowFieldManager::AcquireFlowFieldToCell(const FIntPoint& DestinationCell, int32 MinClearance)
+{
+    FFlowFieldHandle Handle;
+    const FIntVector Key = MakeCacheKey(DestinationCell, MinClearance);
+    if (const FCachedFlowField* Entry = FindOrBuildCachedField(Key, DestinationCell))
+    {
+        Handle.Key = Key;
+        Handle.Destination = Entry->Destination;
+    }
+
+    return Handle;
+}
+
+FFlowFieldHandle AFlowFieldManager::AcquireFlowFieldToWorldLocation(const FVector& DestinationLocation, int32 MinClearance)
+{
+    return AcquireFlowFieldToCell(WorldToCell(DestinationLocation), MinClearance);
+}
+
+FFlowFieldHandle AFlowFieldManager::AcquireFlowFieldToArea(const FBox& WorldBounds, int32 MinClearance)
+{
+    TArray<FIntPoint> GoalCells;
+    GetAreaGoalCells(WorldBounds, GoalCells);
+    return AcquireFlowFieldToCells(GoalCells, MinClearance);
+}
+
+FFlowFieldHandle AFlowFieldManager::AcquireFlowFieldToCells(TConstArrayView<FIntPoint> GoalCells, int32 MinClearance)
+{
+    if (bUseHierarchicalField || GoalCells.Num() <= 1)
+    {
+        for (const FIntPoint& Cell : GoalCells)
+        {
+            if (IsWalkable(Cell))
+            {
+                return AcquireFlowFieldToCell(Cell, MinClearance);
+            }
+        }
+
+        return FFlowFieldHandle();
+    }
+
+    const FIntVector Key = MakeAreaCacheKey(GoalCells, MinClearance);
+    RegisterAreaGoals(Key, GoalCells);
+
+    FFlowFieldHandle Handle;
+    if (const FCachedFlowField* Entry = FindOrBuildCachedField(Key, GoalCells[0]))
+    {
+        Handle.Key = Key;
+        Handle.Destination = Entry->Destination;
+    }
+    else
+    {
+        AreaGoals.Remove(Key);
+    }
+
+    return Handle;
+}
+
+void AFlowFieldManager::GetAreaGoalCells(const FBox& WorldBounds, TArray<FIntPoint>& OutGoalCells) const
+{
+    const FIntRect Area = WorldBoundsToCellRect(WorldBounds);
+
+    OutGoalCells.Reset(Area.Area());
+    for (int32 CellY = Area.Min.Y; CellY < Area.Max.Y; ++CellY)
+    {
+        for (int32 CellX = Area.Min.X; CellX < Area.Max.X; ++CellX)
+        {
+            OutGoalCells.Add(FIntPoint(CellX, CellY));
+        }
+    }
+}
+
+void AFlowFieldManager::RegisterAreaGoals(const FIntVector& Key, TConstArrayView<FIntPoint> GoalCells)
+{
+    TSharedPtr<const TArray<FIntPoint>>& Goals = AreaGoals.FindOrAdd(Key);
+
+    // A hash collision with another area replaces it; the handles of the old area then follow this one.
+    const bool bSameGoals = Goals.IsValid() && Goals->Num() == GoalCells.Num() && FMemory::Memcmp(Goals->GetData(), GoalCells.GetData(), GoalCells.Num() * sizeof(FIntPoint)) == 0;
+    if (!bSameGoals)
+    {
+        if (FCachedFlowField* Stale = FieldCache.Find(Key))
+        {
+            CancelAsyncBuild(*Stale);
+            FieldCache.Remove(Key);
+        }
+
+        Goals = MakeShared<TArray<FIntPoint>>(GoalCells);
+    }
+}
+
+int32 AFlowFieldManager::AcquireGroupPath(const FBox& GoalBounds, float AgentRadius)
+{
+    FGroupPath Path;
+    Path.GoalBounds = GoalBounds;
+    Path.MinClearance = GetClearanceForAgentRadius(AgentRadius);
+    Path.Handle = RequestFlowFieldToAreaAsync(GoalBounds, Path.MinClearance);
+    if (!Path.Handle.IsValid())
+    {
+        return INDEX_NONE;
+    }
+
+    const int32 PathId = NextGroupPathId++;
+    GroupPaths.Add(PathId, Path);
+    return PathId;
+}
+
+void AFlowFieldManager::SampleGroupPath(int32 PathId, TConstArrayView<FVector> WorldPositions, TArrayView<FVector> OutDirections)
+{
+    FGroupPath* Path = GroupPaths.Find(PathId);
+
+    // Evicted or failed fields are requested again instead of being rebuilt on the game thread.
+    if (Path && (!Path->Handle.IsValid() || !FieldCache.Contains(Path->Handle.Key)))
+    {
+        Path->Handle = RequestFlowFieldToAreaAsync(Path->GoalBounds, Path->MinClearance);
+    }
+
+    if (!Path || !Path->Handle.IsValid())
+    {
+        ZeroDirections(WorldPositions.Num(), OutDirections);
+        return;
+    }
+
+    if (IsFlowFieldReady(Path->Handle))
+    {
+        SampleDirectionsForHandle(Path->Handle, WorldPositions, OutDirections);
+        return;
+    }
+
+    // A zero direction sends followers back to their own paths, so they keep heading for the area meanwhile.
+    for (int32 Index = 0; Index < WorldPositions.Num(); ++Index)
+    {
+        OutDirections[Index] = GetSteeringDirectionForHandle(Path->Handle, WorldPositions[Index]);
+    }
+}
+
+void AFlowFieldManager::ReleaseGroupPath(int32 PathId)
+{
+    GroupPaths.Remove(PathId);
+}
+
+FFlowFieldHandle AFlowFieldManager::RequestFlowFieldToCellAsync(const FIntPoint& DestinationCell, int32 MinClearance)
+{
+    if (bUseHierarchicalField)
+    {
+        return AcquireFlowFieldToCell(DestinationCell, MinClearance);
+    }
+
+    FFlowFieldHandle Handle;
+    const FIntVector Key = MakeCacheKey(DestinationCell, MinClearance);
+    if (!IsWalkableForKey(DestinationCell, Key))
+    {
+        return Handle;
+    }
+
+    FCachedFlowField* Entry = FieldCache.Find(Key);
+    if (!Entry)
+    {
+        Entry = &AddPendingCachedField(Key, DestinationCell);
+    }
+
+    Entry->LastUsed = ++CacheUseCounter;
+    Handle.Key = Key;
+    Handle.Destination = Entry->PendingBuild.IsValid() ? Entry->PendingBuild->Destination : Entry->Destination;
+    return Handle;
+}
+
+FFlowFieldHandle AFlowFieldManager::RequestFlowFieldToAreaAsync(const FBox& WorldBounds, int32 MinClearance)
+{
+    TArray<FIntPoint> GoalCells;
+    GetAreaGoalCells(WorldBounds, GoalCells);
+    return RequestFlowFieldToCellsAsync(GoalCells, MinClearance);
+}
+
+FFlowFieldHandle AFlowFieldManager::RequestFlowFieldToCellsAsync(TConstArrayView<FIntPoint> GoalCells, int32 MinClearance)
+{
+    if (bUseHierarchicalField || GoalCells.Num() <= 1)
+    {
+        for (const FIntPoint& Cell : GoalCells)
+        {
+            if (IsWalkable(Cell))
+            {
+                return RequestFlowFieldToCellAsync(Cell, MinClearance);
+            }
+        }
+
+        return FFlowFieldHandle();
+    }
+
+    // A build without any reachable goal would only fail once it completes, so it is not started at all.
+    FFlowFieldHandle Handle;
+    const FIntVector Key = MakeAreaCacheKey(GoalCells, MinClearance);
+    const FIntPoint* FirstGoal = GoalCells.FindByPredicate([this, &Key](const FIntPoint& Cell) { return IsWalkableForKey(Cell, Key); });
+    if (!FirstGoal)
+    {
+        return Handle;
+    }
+
+    RegisterAreaGoals(Key, GoalCells);
+
+    // The worker writes the destination of an area build, so the handle takes the one of the entry.
+    FCachedFlowField* Entry = FieldCache.Find(Key);
+    if (!Entry)
+    {
+        Entry = &AddPendingCachedField(Key, *FirstGoal);
+    }
+
+    Entry->LastUsed = ++CacheUseCounter;
+    Handle.Key = Key;
+    Handle.Destination = Entry->Destination;
+    return Handle;
+}
+
+bool AFlowFieldManager::IsWalkableForKey(const FIntPoint& Cell, const FIntVector& Key) const
+{
+    return IsWalkable(Cell) && (Key.Z <= 1 || ClearanceLayer->GetClearance(Cell.Y * FlowFieldSettings.GridSize.X + Cell.X) >= Key.Z);
+}
+
+AFlowFieldManager::FCachedFlowField& AFlowFieldManager::AddPendingCachedField(const FIntVector& Key, const FIntPoint& DestinationCell)
+{
+    const SIZE_T NumCells = static_cast<SIZE_T>(FlowFieldSettings.GridSize.X) * FlowFieldSettings.GridSize.Y;
+    const SIZE_T BytesPerCell = FlowFieldSettings.bCompactStorage ? sizeof(uint8) + sizeof(uint16) : sizeof(float) + sizeof(FVector2D);
+    EvictCachedFields(NumCells * BytesPerCell);
+
+    FCachedFlowField& Entry = FieldCache.Add(Key);
+    Entry.Destination = DestinationCell;
+    Entry.MinClearance = Key.Z;
+    if (Key.Y == AreaCacheKeyY)
+    {
+        Entry.GoalCells = AreaGoals.FindRef(Key);
+    }
+
+    StartAsyncBuild(Entry, DestinationCell);
+    return Entry;
+}
+
+bool AFlowFieldManager::IsFlowFieldReady(const FFlowFieldHandle& Handle) const
+{
+    const FCachedFlowField* Entry = FieldCache.Find(Handle.Key);
+    return Entry && Entry->IsReady();
+}
+
+bool AFlowFieldManager::IsFlowFieldBuilding(const FFlowFieldHandle& Handle) const
+{
+    const FCachedFlowField* Entry = FieldCache.Find(Handle.Key);
+    return Entry && Entry->PendingBuild.IsValid();
+}
+
+float AFlowFieldManager::GetFlowFieldBuildProgress(const FFlowFieldHandle& Handle) const
+{
+    const FCachedFlowField* Entry = FieldCache.Find(Handle.Key);
+    if (!Entry)
+    {
+        return 0.0f;
+    }
+
+    if (!Entry->PendingBuild.IsValid())
+    {
+        return Entry->IsReady() ? 1.0f : 0.0f;
+    }
+
+    if (Entry->PendingBuild->bTimeSliced)
+    {
+        return Entry->PendingBuild->Field->GetBuildProgress();
+    }
+
+    return Entry->PendingTask.IsCompleted() ? 1.0f : 0.0f;
+}
+
+FVector AFlowFieldManager::GetDirectionForHandle(const FFlowFieldHandle& Handle, const FVector& WorldPosition)
+{
+    if (!Handle.IsValid())
+    {
+        return FVector::ZeroVector;
+    }
+
+    // Never block on a first build still running on a worker; the caller keeps its previous field meanwhile.
+    const FCachedFlowField* PendingEntry = FieldCache.Find(Handle.Key);
+    if (PendingEntry && !PendingEntry->IsReady())
+    {
+        return FVector::ZeroVector;
+    }
+
+    const FCachedFlowField* Entry = FindOrBuildCachedField(Handle.Key, Handle.Destination);
+    return Entry ? Entry->GetDirectionForWorldPosition(WorldPosition) : FVector::ZeroVector;
+}
+
+FVector AFlowFieldManager::GetSteeringDirectionForHandle(const FFlowFieldHandle& Handle, const FVector& WorldPosition)
+{
+    const FCachedFlowField* PendingEntry = Handle.IsValid() ? FieldCache.Find(Handle.Key) : nullptr;
+    if (!PendingEntry || PendingEntry->IsReady())
+    {
+        return GetDirectionForHandle(Handle, WorldPosition);
+    }
+
+    // Cells a time-sliced build has settled already have their final direction.
+    const TSharedPtr<FAsyncFlowFieldBuild>& Build = PendingEntry->PendingBuild;
+    if (Build.IsValid() && Build->bTimeSliced)
+    {
+        const FVector Direction = Build->Field->GetDirectionForWorldPosition(WorldPosition);
+        if (!Direction.IsNearlyZero())
+        {
+            return Direction;
+        }
+    }
+
+    return (CellToWorld(Handle.Destination) - WorldPosition).GetSafeNormal2D();
+}
+
+FVector AFlowFieldManager::FCachedFlowField::GetDirectionForWorldPosition(const FVector& WorldPosition) const
+{
+    if (HierarchicalField)
+    {
+        return HierarchicalField->GetDirectionForWorldPosition(WorldPosition);
+    }
+
+    return Field ? Field->GetDirectionForWorldPosition(WorldPosition) : FVector::ZeroVector;
+}
+
+void AFlowFieldManager::FCachedFlowField::SampleDirections(TConstArrayView<FVector> WorldPositions, TArrayView<FVector> OutDirections) const
+{
+    if (HierarchicalField)
+    {
+        HierarchicalField->SampleDirections(WorldPositions, OutDirections);
+    }
+    else if (Field)
+    {
+        Field->SampleDirections(WorldPositions, OutDirections);
+    }
+    else
+    {
+        ZeroDirections(WorldPositions.Num(), OutDirections);
+    }
+}
+
+bool AFlowFieldManager::FCachedFlowField::IsPendingBuildComplete() const
+{
+    if (!PendingBuild.IsValid())
+    {
+        return true;
+    }
+
+    return PendingBuild->bTimeSliced ? !PendingBuild->Field->IsBuildInProgress() : PendingTask.IsCompleted();
+}
+
+SIZE_T AFlowFieldManager::FCachedFlowField::GetAllocatedSize() const
+{
+    SIZE_T Size = 0;
+    if (Field)
+    {
+        Size += Field->GetAllocatedSize();
+    }
+
+    if (PendingBuild && PendingBuild->Field)
+    {
+        Size += PendingBuild->Field->GetAllocatedSize();
+    }
+
+    if (HierarchicalField)
+    {
+        Size += HierarchicalField->GetAllocatedSize();
+    }
+
+    return Size;
+}
+
+int32 AFlowFieldManager::GetClearanceForAgentRadius(float AgentRadius) const
+{
+    return FFlowFieldClearance::GetClearanceForRadius(AgentRadius, FlowFieldSettings.CellSize);
+}
+
+int32 AFlowFieldManager::GetClearanceClass(int32 MinClearance) const
+{
+    // Point agents all share class 0, whatever class below 2 they asked for.
+    return ClearanceLayer.IsValid() && MinClearance > 1 ? FMath::Min(MinClearance, ClearanceLayer->GetMaxClearance()) : 0;
+}
+
+FIntVector AFlowFieldManager::MakeCacheKey(const FIntPoint& DestinationCell, int32 MinClearance) const
+{
+    const int32 ClearanceClass = GetClearanceClass(MinClearance);
+
+    const int32 Granularity = FMath::Max(1, CacheDestinationGranularity);
+    if (Granularity == 1 || DestinationCell.X < 0 || DestinationCell.Y < 0)
+    {
+        return FIntVector(DestinationCell.X, DestinationCell.Y, ClearanceClass);
+    }
+
+    return FIntVector(DestinationCell.X / Granularity, DestinationCell.Y / Granularity, ClearanceClass);
+}
+
+FIntVector AFlowFieldManager::MakeAreaCacheKey(TConstArrayView<FIntPoint> GoalCells, int32 MinClearance) const
+{
+    uint32 Hash = GetTypeHash(GoalCells.Num());
+    for (const FIntPoint& Cell : GoalCells)
+    {
+        Hash = HashCombineFast(Hash, GetTypeHash(Cell));
+    }
+
+    return FIntVector(static_cast<int32>(Hash & MAX_int32), AreaCacheKeyY, GetClearanceClass(MinClearance));
+}
+
+AFlowFieldManager::FCachedFlowField* AFlowFieldManager::FindOrBuildCachedField(const FIntVector& Key, const FIntPoint& DestinationCell)
+{
+    if (FCachedFlowField* Entry = FieldCache.Find(Key))
+    {
+        // Only a first build has to be waited for; a rebuild keeps serving the previous field.
+        if (Entry->IsReady() || FinishAsyncBuild(*Entry, true))
+        {
+            Entry->LastUsed = ++CacheUseCounter;
+            return Entry;
+        }
+
+        FieldCache.Remove(Key);
+    }
+
+    // Cached fields are copies of the templates, so they share the traversal weights (and sector graph) instead of duplicating them.
+    FCachedFlowField NewEntry;
+    NewEntry.Destination = DestinationCell;
+    NewEntry.MinClearance = Key.Z;
+    if (Key.Y == AreaCacheKeyY)
+    {
+        // Area handles outliving the grid their goals were expressed in fall back to their destination cell.
+        if (const TSharedPtr<const TArray<FIntPoint>>* Goals = AreaGoals.Find(Key))
+        {
+            NewEntry.GoalCells = *Goals;
+        }
+    }
+
+    if (bUseHierarchicalField)
+    {
+        NewEntry.HierarchicalField = MakeUnique<FHierarchicalFlowField>(HierarchicalField);
+        if (!NewEntry.HierarchicalField->Build(DestinationCell))
+        {
+            return nullptr;
+        }
+    }
+    else
+    {
+        NewEntry.Field = MakeShared<FFlowField>(FlowField);
+        NewEntry.Field->SetMinClearance(NewEntry.MinClearance);
+        const bool bBuilt = NewEntry.GoalCells.IsValid() ? NewEntry.Field->BuildToCells(*NewEntry.GoalCells) : NewEntry.Field->Build(DestinationCell);
+        if (!bBuilt)
+        {
+            return nullptr;
+        }
+
+        NewEntry.Destination = NewEntry.Field->GetDestination();
+    }
+
+    EvictCachedFields(NewEntry.GetAllocatedSize());
+
+    NewEntry.LastUsed = ++CacheUseCounter;
+    return &FieldCache.Add(Key, MoveTemp(NewEntry));
+}
+
+void AFlowFieldManager::StartAsyncBuild(FCachedFlowField& Entry, const FIntPoint& DestinationCell)
+{
+    CancelAsyncBuild(Entry);
+
+    // The task only captures the build, never the manager, so a cancelled or orphaned build simply runs out on its own.
+    TSharedRef<FAsyncFlowFieldBuild> Build = MakeShared<FAsyncFlowFieldBuild>();
+    Build->Destination = DestinationCell;
+    Build->GoalCells = Entry.GoalCells;
+    Build->Field = MakeShared<FFlowField>(FlowField);
+    Build->Field->SetMinClearance(Entry.MinClearance);
+
+    Entry.PendingBuild = Build;
+    if (bTimeSliceFieldBuilds)
+    {
+        // A build that cannot start is published as failed by ProcessAsyncBuilds, like a failed worker build.
+        Build->bTimeSliced = true;
+        Build->bSucceeded = Build->GoalCells.IsValid() ? Build->Field->BeginBuild(*Build->GoalCells) : Build->Field->BeginBuild(MakeArrayView(&DestinationCell, 1));
+        if (Build->bSucceeded)
+        {
+            Build->Destination = Build->Field->GetDestination();
+        }
+
+        return;
+    }
+
+    Entry.PendingTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [Build]()
+    {
+        if (Build->GoalCells.IsValid())
+        {
+            Build->bSucceeded = Build->Field->BuildToCells(*Build->GoalCells, &Build->bCancelled);
+            Build->Destination = Build->Field->GetDestination();
+        }
+        else
+        {
+            Build->bSucceeded = Build->Field->Build(Build->Destination, &Build->bCancelled);
+        }
+    });
+}
+
+void AFlowFieldManager::CancelAsyncBuild(FCachedFlowField& Entry)
+{
+    if (Entry.PendingBuild.IsValid())
+    {
+        Entry.PendingBuild->bCancelled = true;
+        Entry.PendingBuild.Reset();
+        Entry.PendingTask = UE::Tasks::FTask();
+    }
+}
+
+bool AFlowFieldManager::FinishAsyncBuild(FCachedFlowField& Entry, bool bWaitForCompletion)
+{
+    if (!Entry.PendingBuild.IsValid())
+    {
+        return Entry.IsReady();
+    }
+
+    if (!Entry.IsPendingBuildComplete())
+    {
+        if (!bWaitForCompletion)
+        {
+            return true;
+        }
+
+        if (Entry.PendingBuild->bTimeSliced)
+        {
+            Entry.PendingBuild->Field->Step(TNumericLimits<float>::Max());
+        }
+        else
+        {
+            Entry.PendingTask.Wait();
+        }
+    }
+
+    const TSharedPtr<FAsyncFlowFieldBuild> Build = MoveTemp(Entry.PendingBuild);
+    Entry.PendingBuild.Reset();
+    Entry.PendingTask = UE::Tasks::FTask();
+
+    if (!Build->bSucceeded)
+    {
+        // The destination became invalid; serving the previous field would lead agents into a blocked cell.
+        Entry.Field.Reset();
+        return false;
+    }
+
+    // Publishing happens on the game thread, the only place fields are sampled, so the swap is atomic for agents.
+    Entry.Field = Build->Field;
+    Entry.Destination = Build->Destination;
+    return true;
+}
+
+void AFlowFieldManager::ProcessAsyncBuilds()
+{
+    for (auto It = FieldCache.CreateIterator(); It; ++It)
+    {
+        FCachedFlowField& Entry = It.Value();
+        if (!Entry.PendingBuild.IsValid() || !Entry.IsPendingBuildComplete())
+        {
+            continue;
+        }
+
+        const bool bKeepEntry = FinishAsyncBuild(Entry, false);
+        if (It.Key() == ActiveHandle.Key && bHasBuiltField)
+        {
+            if (bKeepEntry)
+            {
+                CachedDestinationWorld = CellToWorld(Entry.Destination);
+                RefreshDebugSnapshot();
+            }
+            else
+            {
+                bHasBuiltField = false;
+                bHasDebugSnapshot = false;
+            }
+        }
+
+        if (!bKeepEntry)
+        {
+            It.RemoveCurrent();
+        }
+    }
+}
+
+void AFlowFieldManager::TickTimeSlicedBuilds()
+{
+    const double EndTime = FPlatformTime::Seconds() + FMath::Max(FieldBuildBudgetMs, 0.1f) * 0.001;
+    for (TPair<FIntVector, FCachedFlowField>& Pair : FieldCache)
+    {
+        const TSharedPtr<FAsyncFlowFieldBuild>& Build = Pair.Value.PendingBuild;
+        if (!Build.IsValid() || !Build->bTimeSliced || !Build->Field->IsBuildInProgress())
+        {
+            continue;
+        }
+
+        const double RemainingMs = (EndTime - FPlatformTime::Seconds()) * 1000.0;
+        if (RemainingMs <= 0.0)
+        {
+            break;
+        }
+
+        Build->Field->Step(static_cast<float>(RemainingMs));
+    }
+}
+
+void AFlowFieldManager::RebuildCachedFieldsAsync()
+{
+    for (TPair<FIntVector, FCachedFlowField>& Pair : FieldCache)
+    {
+        FCachedFlowField& Entry = Pair.Value;
+        const FIntPoint DestinationCell = Entry.PendingBuild.IsValid() ? Entry.PendingBuild->Destination : Entry.Destination;
+        StartAsyncBuild(Entry, DestinationCell);
+    }
+}
+
+void AFlowFieldManager::EvictCachedFields(SIZE_T IncomingBytes)
+{
+    const SIZE_T BudgetBytes = static_cast<SIZE_T>(FMath::Max(MaxCacheMemoryMB, 1.0f) * 1024.0f * 1024.0f);
+
+    SIZE_T UsedBytes = IncomingBytes;
+    for (const TPair<FIntVector, FCachedFlowField>& Pair : FieldCache)
+    {
+        UsedBytes += Pair.Value.GetAllocatedSize();
+    }
+
+    while (UsedBytes > BudgetBytes)
+    {
+        // The active field backs GetDirectionForWorldPosition and the debug view, so it is never evicted.
+        const FIntVector* OldestKey = nullptr;
+        uint64 OldestUse = TNumericLimits<uint64>::Max();
+        for (const TPair<FIntVector, FCachedFlowField>& Pair : FieldCache)
+        {
+            if (Pair.Value.LastUsed < OldestUse && !(bHasBuiltField && Pair.Key == ActiveHandle.Key))
+            {
+                OldestKey = &Pair.Key;
+                OldestUse = Pair.Value.LastUsed;
+            }
+        }
+
+        if (!OldestKey)
+        {
+            break;
+        }
+
+        const FIntVector EvictedKey = *OldestKey;
+        FCachedFlowField& Evicted = FieldCache[EvictedKey];
+        UsedBytes -= Evicted.GetAllocatedSize();
+        CancelAsyncBuild(Evicted);
+        FieldCache.Remove(EvictedKey);
+    }
+}
+
+void AFlowFieldManager::ClearFieldCache()
+{
+    // Handles stay valid; their fields are rebuilt against the new grid the next time they are sampled.
+    for (TPair<FIntVector, FCachedFlowField>& Pair : FieldCache)
+    {
+        CancelAsyncBuild(Pair.Value);
+    }
+
+    FieldCache.Reset();
+    bHasBuiltField = false;
+    bHasDebugSnapshot = false;
+}
+
+void AFlowFieldManager::UpdateFlowFieldSettings()
+{
+    RecalculateTerrainBounds();
+
+    const float ClampedCellSize = FMath::Max(CellSize, KINDA_SMALL_NUMBER);
+    FIntPoint DesiredGridSize = GridSize;
+    DesiredGridSize.X = FMath::Max(1, DesiredGridSize.X);
+    DesiredGridSize.Y = FMath::Max(1, DesiredGridSize.Y);
+
+    FVector DesiredOrigin = GetActorLocation();
+
+    if (bAutoSizeToTerrain && CachedTerrainBounds.IsValid)
+    {
+            const FVector BoundsSize = CachedTerrainBounds.GetSize();
+            DesiredGridSize.X = FMath::Max(1, FMath::CeilToInt(BoundsSize.X / ClampedCellSize));
+            DesiredGridSize.Y = FMath::Max(1, FMath::CeilToInt(BoundsSize.Y / ClampedCellSize));
+            DesiredOrigin = CachedTerrainBounds.Min;
+    }
+    else
+    {
+            const FVector GridHalfExtent = FVector(DesiredGridSize.X * ClampedCellSize * 0.5f, DesiredGridSize.Y * ClampedCellSize * 0.5f, 0.0f);
+            DesiredOrigin = GetActorLocation() - GridHalfExtent;
+    }
+
+    GridSize = DesiredGridSize;
+
+    FlowFieldSettings.GridSize = DesiredGridSize;
+    FlowFieldSettings.CellSize = ClampedCellSize;
+
+    FVector FinalOrigin = DesiredOrigin + AdditionalOriginOffset;
+    FinalOrigin.Z = DesiredOrigin.Z + AdditionalOriginOffset.Z;
+    FlowFieldSettings.Origin = FinalOrigin;
+
+    FlowFieldSettings.bAllowDiagonal = bAllowDiagonal;
+    FlowFieldSettings.DiagonalCostMultiplier = DiagonalCostMultiplier;
+    FlowFieldSettings.StepCost = StepCost;
+    FlowFieldSettings.CellTraversalWeightMultiplier = CellTraversalWeightMultiplier;
+    FlowFieldSettings.HeuristicWeight = HeuristicWeight;
+    FlowFieldSettings.bSmoothDirections = bSmoothDirections;
+    FlowFieldSettings.IntegrationMethod = IntegrationMethod;
+    FlowFieldSettings.bCompactStorage = bCompactFieldStorage;
+
+    if (bUseHierarchicalField)
+    {
+            // Keep the flat field empty so large grids do not allocate full size integration buffers.
+            FlowField.ApplySettings(FFlowFieldSettings());
+            HierarchicalField.ApplySettings(FlowFieldSettings, SectorSize);
+    }
+    else
+    {
+            FlowField.ApplySettings(FlowFieldSettings);
+            HierarchicalField.ApplySettings(FFlowFieldSettings(), SectorSize);
+    }
+
+    // ApplySettings dropped the weights the layer was built from, the next weight update rebuilds it.
+    SharedTraversalWeights.Reset();
+    ClearanceLayer.Reset();
+    CellTerrain.Reset();
+    ClearFieldCache();
+    AreaGoals.Reset();
+
+    // The area keys depend on the grid, group paths acquire their field again on their next sample.
+    for (TPair<int32, FGroupPath>& Pair : GroupPaths)
+    {
+        Pair.Value.Handle = FFlowFieldHandle();
+    }
+}
+
+void AFlowFieldManager::UpdateTraversalWeights()
+{
+    NextBakeCell = INDEX_NONE;
+    PendingBakeWeights.Empty();
+
+    const int32 NumCells = FlowFieldSettings.GridSize.X * FlowFieldSettings.GridSize.Y;
+    if (NumCells <= 0)
+    {
+            TraversalWeights.Reset();
+            ApplyTraversalWeights();
+            return;
+    }
+
+    const uint8 WeightValue = static_cast<uint8>(FMath::Clamp(DefaultTraversalWeight, 0, 255));
+    TraversalWeights.Init(WeightValue, NumCells);
+
+    UWorld* World = GetWorld();
+    if (!World)
+    {
+            ApplyTraversalWeights();
+            return;
+    }
+
+    SampleCellTerrain();
+
+    const FTraversalBakeContext Context = MakeTraversalBakeContext(World);
+    BakeTraversalWeightCells(Context, TraversalWeights, 0, NumCells);
+
+    ApplyTraversalWeights();
+}
+
+void AFlowFieldManager::BakeTraversalWeightCells(const FTraversalBakeContext& Context, TArray<uint8>& OutWeights, int32 FirstCell, int32 NumCells) const
+{
+    const int32 GridX = FlowFieldSettings.GridSize.X;
+    auto BakeCell = [this, &Context, &OutWeights, FirstCell, GridX](int32 Offset)
+    {
+            const int32 Index = FirstCell + Offset;
+            OutWeights[Index] = EvaluateCellTraversalWeight(Context, FIntPoint(Index % GridX, Index / GridX));
+    };
+
+    // Scene queries only read the physics scene, and every cell writes its own entry.
+    ParallelFor(NumCells, BakeCell, bParallelTraversalBake ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread);
+}
+
+void AFlowFieldManager::StartTimeSlicedBake()
+{
+    const int32 NumCells = FlowFieldSettings.GridSize.X * FlowFieldSettings.GridSize.Y;
+    if (NumCells <= 0 || !GetWorld())
+    {
+            UpdateTraversalWeights();
+            return;
+    }
+
+    // Keep the level playable on a fully walkable grid while the real weights are baked.
+    const uint8 WeightValue = static_cast<uint8>(FMath::Clamp(DefaultTraversalWeight, 0, 255));
+    TraversalWeights.Init(WeightValue, NumCells);
+    ApplyTraversalWeights();
+
+    SampleCellTerrain();
+    PendingBakeWeights.Init(WeightValue, NumCells);
+    NextBakeCell = 0;
+}
+
+void AFlowFieldManager::TickTimeSlicedBake()
+{
+    if (NextBakeCell == INDEX_NONE)
+    {
+            return;
+    }
+
+    const int32 NumCells = FlowFieldSettings.GridSize.X * FlowFieldSettings.GridSize.Y;
+    UWorld* World = GetWorld();
+    if (!World || PendingBakeWeights.Num() != NumCells)
+    {
+            UpdateTraversalWeights();
+            return;
+    }
+
+    const FTraversalBakeContext Context = MakeTraversalBakeContext(World);
+    const int32 NumWorkers = bParallelTraversalBake ? FTaskGraphInterface::Get().GetNumWorkerThreads() + 1 : 1;
+    const int32 BatchSize = NumWorkers * TimeSlicedBakeCellsPerWorker;
+    const double EndTime = FPlatformTime::Seconds() + FMath::Max(TraversalBakeBudgetMs, 0.1f) * 0.001;
+
+    do
+    {
+            const int32 NumBatchCells = FMath::Min(BatchSize, NumCells - NextBakeCell);
+            BakeTraversalWeightCells(Context, PendingBakeWeights, NextBakeCell, NumBatchCells);
+            NextBakeCell += NumBatchCells;
+    }
+    while (NextBakeCell < NumCells && FPlatformTime::Seconds() < EndTime);
+
+    if (NextBakeCell >= NumCells)
+    {
+            NextBakeCell = INDEX_NONE;
+            TraversalWeights = MoveTemp(PendingBakeWeights);
+            PendingBakeWeights.Empty();
+            ApplyTraversalWeights();
+    }
+}
+
+void AFlowFieldManager::BakeTraversalWeightsToAsset()
+{
+    if (!ensureMsgf(BakedTraversalData, TEXT("AFlowFieldManager: assign a BakedTraversalData asset before baking.")))
+    {
+            return;
+    }
+
+    UpdateFlowFieldSettings();
+    UpdateTraversalWeights();
+
+    BakedTraversalData->StoreWeights(FlowFieldSettings.GridSize, FlowFieldSettings.CellSize, FlowFieldSettings.Origin, CachedTerrainBounds, ComputeTraversalBakeHash(), ComputeLayerWeightBakeHash(), TraversalWeights);
+}
+
+uint32 AFlowFieldManager::ComputeTraversalBakeHash() const
+{
+    auto HashVector = [](uint32 Hash, const FVector& Vector)
+    {
+            return HashCombineFast(Hash, GetTypeHash(Vector));
+    };
+
+    auto HashTransform = [&HashVector](uint32 Hash, const FTransform& Transform)
+    {
+            Hash = HashVector(Hash, Transform.GetLocation());
+            Hash = HashVector(Hash, Transform.GetRotation().Euler());
+            return HashVector(Hash, Transform.GetScale3D());
+    };
+
+    uint32 Hash = GetTypeHash(FlowFieldSettings.GridSize);
+    Hash = HashCombineFast(Hash, GetTypeHash(FlowFieldSettings.CellSize));
+    Hash = HashVector(Hash, FlowFieldSettings.Origin);
+    Hash = HashVector(Hash, CachedTerrainBounds.Min);
+    Hash = HashVector(Hash, CachedTerrainBounds.Max);
+    Hash = HashCombineFast(Hash, GetTypeHash(bAutoSizeToTerrain));
+    Hash = HashCombineFast(Hash, GetTypeHash(TerrainTraceHeight));
+    Hash = HashCombineFast(Hash, GetTypeHash(TerrainTraceDepth));
+    Hash = HashCombineFast(Hash, GetTypeHash(MaxWalkableSlopeAngle));
+    Hash = HashCombineFast(Hash, GetTypeHash(DefaultTraversalWeight));
+    Hash = HashCombineFast(Hash, GetTypeHash(static_cast<uint8>(TerrainCollisionChannel)));
+    Hash = HashCombineFast(Hash, GetTypeHash(static_cast<uint8>(ObstacleCollisionChannel)));
+    Hash = HashCombineFast(Hash, GetTypeHash(bBakeFromTerrainData));
+
+    if (bBakeFromTerrainData)
+    {
+        for (const FFlowFieldLayerCost& LayerCost : LandscapeLayerCosts)
+        {
+            Hash = HashCombineFast(Hash, GetTypeHash(LayerCost.LayerInfo ? LayerCost.LayerInfo->GetPathName() : FString()));
+            Hash = HashCombineFast(Hash, GetTypeHash(LayerCost.CostMultiplier));
+            Hash = HashCombineFast(Hash, GetTypeHash(LayerCost.bBlocksTraversal));
+        }
+
+        Hash = HashCombineFast(Hash, GetTypeHash(bUseNavAreaCosts));
+        Hash = HashCombineFast(Hash, GetTypeHash(bBlockCellsOutsideNavMesh));
+    }
+
+    const UWorld* World = GetWorld();
+    if (!World)
+    {
+            return Hash;
+    }
+
+    const FBox GridBounds(FlowFieldSettings.Origin - FVector(0.0f, 0.0f, HALF_WORLD_MAX), FlowFieldSettings.Origin + FVector(FlowFieldSettings.GridSize.X * FlowFieldSettings.CellSize, FlowFieldSettings.GridSize.Y * FlowFieldSettings.CellSize, HALF_WORLD_MAX));
+
+    // Summed so the result does not depend on the actor iteration order. Movable primitives are left out: they are
+    // expected to come and go at runtime and are handled through UpdateTraversalWeightsInRegion.
+    uint32 GeometryHash = 0;
+    for (TActorIterator<AActor> It(World); It; ++It)
+    {
+            const AActor* Actor = *It;
+            if (Actor == this)
+            {
+                    continue;
+            }
+
+            Actor->ForEachComponent<UPrimitiveComponent>(false, [&](const UPrimitiveComponent* Component)
+            {
+                    if (Component->Mobility != EComponentMobility::Static || !Component->IsQueryCollisionEnabled())
+                    {
+                            return;
+                    }
+
+                    const bool bAffectsTerrain = Component->GetCollisionResponseToChannel(TerrainCollisionChannel) != ECR_Ignore;
+                    const bool bAffectsObstacles = Component->GetCollisionResponseToChannel(ObstacleCollisionChannel) != ECR_Ignore;
+                    if ((!bAffectsTerrain && !bAffectsObstacles) || !Component->Bounds.GetBox().Intersect(GridBounds))
+                    {
+                            return;
+                    }
+
+                    uint32 ComponentHash = HashVector(GetTypeHash(Component->Bounds.Origin), Component->Bounds.BoxExtent);
+                    ComponentHash = HashTransform(ComponentHash, Component->GetComponentTransform());
+                    ComponentHash = HashCombineFast(ComponentHash, GetTypeHash(bAffectsTerrain) ^ (GetTypeHash(bAffectsObstacles) << 1));
+
+                    // Swapping a mesh or moving a single instance may leave the bounds untouched.
+                    if (const UStaticMeshComponent* MeshComponent = Cast<UStaticMeshComponent>(Component))
+                    {
+                            const UStaticMesh* Mesh = MeshComponent->GetStaticMesh();
+                            ComponentHash = HashCombineFast(ComponentHash, GetTypeHash(Mesh ? Mesh->GetPathName() : FString()));
+                    }
+
+                    if (const UInstancedStaticMeshComponent* InstancedComponent = Cast<UInstancedStaticMeshComponent>(Component))
+                    {
+                            FTransform InstanceTransform;
+                            for (int32 InstanceIndex = 0; InstanceIndex < InstancedComponent->GetInstanceCount(); ++InstanceIndex)
+                            {
+                                    if (InstancedComponent->GetInstanceTransform(InstanceIndex, InstanceTransform))
+                                    {
+                                            ComponentHash = HashTransform(ComponentHash, InstanceTransform);
+                                    }
+                            }
+                    }
+
+                    // The heightfield guid is renewed whenever the landscape heights are edited.
+                    if (const ULandscapeHeightfieldCollisionComponent* HeightfieldComponent = Cast<ULandscapeHeightfieldCollisionComponent>(Component))
+                    {
+                            ComponentHash = HashCombineFast(ComponentHash, GetTypeHash(HeightfieldComponent->HeightfieldGuid));
+                    }
+
+                    GeometryHash += ComponentHash;
+            });
+    }
+
+    return HashCombineFast(Hash, GeometryHash);
+}
+
+uint32 AFlowFieldManager::ComputeLayerWeightBakeHash() const
+{
+    UWorld* World = GetWorld();
+    if (!bBakeFromTerrainData || !World)
+    {
+            return 0;
+    }
+
+    return FFlowFieldTerrainSampler(World, FlowFieldSettings).HashLayerWeights(LandscapeLayerCosts);
+}
+
+bool AFlowFieldManager::TryApplyBakedTraversalWeights()
+{
+    if (!BakedTraversalData || !BakedTraversalData->IsCompatible(FlowFieldSettings.GridSize, ComputeTraversalBakeHash()))
+    {
+            return false;
+    }
+
+#if WITH_EDITOR
+    // Cooked builds can neither read nor repaint the weightmaps, the layers baked in the editor are trusted there.
+    if (BakedTraversalData->LayerWeightHash != ComputeLayerWeightBakeHash())
+    {
+            return false;
+    }
+#endif
+
+    NextBakeCell = INDEX_NONE;
+    PendingBakeWeights.Empty();
+
+    TraversalWeights = BakedTraversalData->GetWeights();
+    ApplyTraversalWeights();
+    return true;
+}
+
+float AFlowFieldManager::GetTraversalBakeProgress() const
+{
+    if (NextBakeCell == INDEX_NONE || PendingBakeWeights.Num() == 0)
+    {
+            return 1.0f;
+    }
+
+    return static_cast<float>(NextBakeCell) / static_cast<float>(PendingBakeWeights.Num());
+}
+
+void AFlowFieldManager::UpdateTraversalWeightsInRegion(const FBox& WorldBounds)
+{
+    const int32 NumCells = FlowFieldSettings.GridSize.X * FlowFieldSettings.GridSize.Y;
+    UWorld* World = GetWorld();
+    if (!World || !WorldBounds.IsValid || TraversalWeights.Num() != NumCells)
+    {
+            UpdateTraversalWeights();
+            return;
+    }
+
+    const FIntRect Region = WorldBoundsToCellRect(WorldBounds);
+    if (Region.IsEmpty())
+    {
+            return;
+    }
+
+    // Weights loaded from BakedTraversalData were never sampled, the region must keep their grading.
+    if (bBakeFromTerrainData && CellTerrain.Num() != NumCells)
+    {
+        SampleCellTerrain();
+    }
+
+    const FTraversalBakeContext Context = MakeTraversalBakeContext(World);
+    for (int32 CellY = Region.Min.Y; CellY < Region.Max.Y; ++CellY)
+    {
+            for (int32 CellX = Region.Min.X; CellX < Region.Max.X; ++CellX)
+            {
+                    const int32 Index = CellY * FlowFieldSettings.GridSize.X + CellX;
+                    TraversalWeights[Index] = EvaluateCellTraversalWeight(Context, FIntPoint(CellX, CellY));
+
+                    // Cells the running bake already passed would otherwise publish their stale value.
+                    if (IsBakingTraversalWeights() && Index < NextBakeCell)
+                    {
+                            PendingBakeWeights[Index] = TraversalWeights[Index];
+                    }
+            }
+    }
+
+    ApplyTraversalWeightsInRegion(Region);
+}
+
+FIntRect AFlowFieldManager::WorldBoundsToCellRect(const FBox& WorldBounds) const
+{
+    if (!WorldBounds.IsValid)
+    {
+        return FIntRect();
+    }
+
+    FIntRect Rect(WorldToCell(WorldBounds.Min), WorldToCell(WorldBounds.Max) + FIntPoint(1, 1));
+    Rect.Clip(FIntRect(FIntPoint::ZeroValue, FlowFieldSettings.GridSize));
+    return Rect;
+}
+
+void AFlowFieldManager::SampleCellTerrain()
+{
+    CellTerrain.Reset();
+
+    const int32 NumCells = FlowFieldSettings.GridSize.X * FlowFieldSettings.GridSize.Y;
+    UWorld* World = GetWorld();
+    if (!bBakeFromTerrainData || NumCells <= 0 || !World)
+    {
+        return;
+    }
+
+    const double StartTime = FPlatformTime::Seconds();
+    CellTerrain.SetNum(NumCells);
+
+    const FFlowFieldTerrainSampler Sampler(World, FlowFieldSettings);
+    const bool bSampledLandscape = Sampler.SampleLandscapes(LandscapeLayerCosts, bParallelTraversalBake, CellTerrain);
+
+    bool bSampledNavMesh = false;
+    if (bUseNavAreaCosts)
+    {
+        const float HalfCellSize = FlowFieldSettings.CellSize * 0.5f;
+        bSampledNavMesh = Sampler.SampleNavAreaCosts(FVector(HalfCellSize, HalfCellSize, FMath::Max(TerrainTraceHeight, HalfCellSize)), bBlockCellsOutsideNavMesh, CellTerrain);
+    }
+
+    UE_LOG(LogTemp, Log, TEXT("AFlowFieldManager: sampled the terrain data of %d cells in %.2f ms (landscape: %d, navmesh: %d)."),
+        NumCells, (FPlatformTime::Seconds() - StartTime) * 1000.0, bSampledLandscape, bSampledNavMesh);
+}
+
+AFlowFieldManager::FTraversalBakeContext AFlowFieldManager::MakeTraversalBakeContext(const UWorld* World) const
+{
+    FTraversalBakeContext Context;
+    Context.World = World;
+    Context.WalkableWeight = static_cast<uint8>(FMath::Clamp(DefaultTraversalWeight, 0, 255));
+    Context.CellTerrain = CellTerrain.Num() == FlowFieldSettings.GridSize.X * FlowFieldSettings.GridSize.Y ? &CellTerrain : nullptr;
+
+    Context.bTraceTerrain = bAutoSizeToTerrain && CachedTerrainBounds.IsValid;
+    Context.TraceStartZ = Context.bTraceTerrain ? CachedTerrainBounds.Max.Z + TerrainTraceHeight : 0.0f;
+    Context.TraceEndZ = Context.bTraceTerrain ? CachedTerrainBounds.Min.Z - TerrainTraceDepth : 0.0f;
+
+    Context.TerrainQueryParams = FCollisionQueryParams(SCENE_QUERY_STAT(FlowFieldTerrainTrace), false, this);
+    Context.TerrainQueryParams.AddIgnoredActor(this);
+
+    Context.ObstacleQueryParams = FCollisionQueryParams(SCENE_QUERY_STAT(FlowFieldObstacleOverlap), false, this);
+    Context.ObstacleQueryParams.AddIgnoredActor(this);
+
+    const float HalfCellSize = FlowFieldSettings.CellSize * 0.5f;
+    Context.ObstacleExtents = FVector(HalfCellSize, HalfCellSize, HalfCellSize); // keep overlap tight to reduce cost
+    Context.ObstacleShape = FCollisionShape::MakeBox(Context.ObstacleExtents);
+    return Context;
+}
+
+uint8 AFlowFieldManager::EvaluateCellTraversalWeight(const FTraversalBakeContext& Context, const FIntPoint& Cell) const
+{
+    const FVector CellWorld = CellToWorld(Cell);
+
+    const FFlowFieldCellTerrain* Terrain = Context.CellTerrain ? &(*Context.CellTerrain)[Cell.Y * FlowFieldSettings.GridSize.X + Cell.X] : nullptr;
+    if (Terrain && Terrain->bBlocked)
+    {
+            return 0;
+    }
+
+    bool bWalkable = true;
+    FVector SampleLocation = CellWorld;
+
+    if (Terrain && Terrain->bOnLandscape)
+    {
+            if (Terrain->SlopeDegrees <= MaxWalkableSlopeAngle)
+            {
+                    SampleLocation.Z = Terrain->Height;
+            }
+            else
+            {
+                    bWalkable = false;
+            }
+    }
+    else if (Context.bTraceTerrain)
+    {
+            const FVector TraceStart(CellWorld.X, CellWorld.Y, Context.TraceStartZ);
+            const FVector TraceEnd(CellWorld.X, CellWorld.Y, Context.TraceEndZ);
+
+            FHitResult Hit;
+            const bool bHit = Context.World->LineTraceSingleByChannel(Hit, TraceStart, TraceEnd, TerrainCollisionChannel, Context.TerrainQueryParams);
+            if (bHit)
+            {
+                    const FVector HitNormal = Hit.ImpactNormal.GetSafeNormal();
+                    const float Dot = FVector::DotProduct(HitNormal, FVector::UpVector);
+                    const float ClampedDot = FMath::Clamp(Dot, -1.0f, 1.0f);
+                    const float SlopeAngleDegrees = FMath::RadiansToDegrees(FMath::Acos(ClampedDot));
+                    if (SlopeAngleDegrees <= MaxWalkableSlopeAngle)
+                    {
+                            SampleLocation = Hit.Location;
+                    }
+                    else
+                    {
+                            bWalkable = false;
+                    }
+            }
+            else
+            {
+                    bWalkable = false;
+            }
+    }
+
+    if (bWalkable)
+    {
+            FVector OverlapCenter = SampleLocation;
+            OverlapCenter.Z += Context.ObstacleExtents.Z;
+
+            const bool bBlocked = Context.World->OverlapAnyTestByChannel(OverlapCenter, FQuat::Identity, ObstacleCollisionChannel, Context.ObstacleShape, Context.ObstacleQueryParams);
+            if (bBlocked)
+            {
+                    bWalkable = false;
+            }
+    }
+
+    if (!bWalkable || !Terrain || Context.WalkableWeight == 0)
     {
-        return FVector::ZeroVector;
+            return bWalkable ? Context.WalkableWeight : 0;
     }
 
-    return FlowField.GetDirectionForWorldPosition(WorldPosition);
+    // Expensive ground stays walkable, only blocking layers and areas produce a weight of 0.
+    const float GradedWeight = Context.WalkableWeight / FMath::Max(Terrain->CostMultiplier, UE_KINDA_SMALL_NUMBER);
+    return static_cast<uint8>(FMath::Clamp(FMath::RoundToInt32(GradedWeight), 1, 255));
 }
 
-void AFlowFieldManager::UpdateFlowFieldSettings()
+void AFlowFieldManager::ApplyTraversalWeights()
 {
-    RecalculateTerrainBounds();
-
-    const float ClampedCellSize = FMath::Max(CellSize, KINDA_SMALL_NUMBER);
-    FIntPoint DesiredGridSize = GridSize;
-    DesiredGridSize.X = FMath::Max(1, DesiredGridSize.X);
-    DesiredGridSize.Y = FMath::Max(1, DesiredGridSize.Y);
-
-    FVector DesiredOrigin = GetActorLocation();
-
-    if (bAutoSizeToTerrain && CachedTerrainBounds.IsValid)
+    SharedTraversalWeights = MakeShared<TArray<uint8>>(TraversalWeights);
+    if (bUseHierarchicalField)
     {
-            const FVector BoundsSize = CachedTerrainBounds.GetSize();
-            DesiredGridSize.X = FMath::Max(1, FMath::CeilToInt(BoundsSize.X / ClampedCellSize));
-            DesiredGridSize.Y = FMath::Max(1, FMath::CeilToInt(BoundsSize.Y / ClampedCellSize));
-            DesiredOrigin = CachedTerrainBounds.Min;
+        HierarchicalField.SetSharedTraversalWeights(SharedTraversalWeights);
     }
     else
     {
-            const FVector GridHalfExtent = FVector(DesiredGridSize.X * ClampedCellSize * 0.5f, DesiredGridSize.Y * ClampedCellSize * 0.5f, 0.0f);
-            DesiredOrigin = GetActorLocation() - GridHalfExtent;
+        FlowField.SetSharedTraversalWeights(SharedTraversalWeights);
     }
 
-    GridSize = DesiredGridSize;
-
-    FlowFieldSettings.GridSize = DesiredGridSize;
-    FlowFieldSettings.CellSize = ClampedCellSize;
-
-    FVector FinalOrigin = DesiredOrigin + AdditionalOriginOffset;
-    FinalOrigin.Z = DesiredOrigin.Z + AdditionalOriginOffset.Z;
-    FlowFieldSettings.Origin = FinalOrigin;
-
-    FlowFieldSettings.bAllowDiagonal = bAllowDiagonal;
-    FlowFieldSettings.DiagonalCostMultiplier = DiagonalCostMultiplier;
-    FlowFieldSettings.StepCost = StepCost;
-    FlowFieldSettings.CellTraversalWeightMultiplier = CellTraversalWeightMultiplier;
-    FlowFieldSettings.HeuristicWeight = HeuristicWeight;
-    FlowFieldSettings.bSmoothDirections = bSmoothDirections;
+    UpdateClearanceLayer();
 
-    FlowField.ApplySettings(FlowFieldSettings);
-    bHasBuiltField = false;
-    bHasDebugSnapshot = false;
+    // Flat fields keep serving the previous weights until their rebuild is published; hierarchical ones rebuild lazily.
+    if (bUseHierarchicalField)
+    {
+        ClearFieldCache();
+    }
+    else
+    {
+        RebuildCachedFieldsAsync();
+    }
 }
 
-void AFlowFieldManager::UpdateTraversalWeights()
+void AFlowFieldManager::ApplyTraversalWeightsInRegion(const FIntRect& Region)
 {
-    const int32 NumCells = FlowFieldSettings.GridSize.X * FlowFieldSettings.GridSize.Y;
-    if (NumCells <= 0)
+    if (bUseHierarchicalField)
     {
-            TraversalWeights.Reset();
-            FlowField.SetTraversalWeights(TraversalWeights);
-            return;
+        // The sector graph is rebuilt from scratch anyway, next to which copying the weights is negligible.
+        SharedTraversalWeights = MakeShared<TArray<uint8>>(TraversalWeights);
+        HierarchicalField.SetSharedTraversalWeights(SharedTraversalWeights);
+        ClearFieldCache();
+        return;
     }
 
-    const uint8 WeightValue = static_cast<uint8>(FMath::Clamp(DefaultTraversalWeight, 0, 255));
-    TraversalWeights.Init(WeightValue, NumCells);
-
-    UWorld* World = GetWorld();
-    if (!World)
+    // Worker builds still integrate the previous data, which is only copied while one of them holds it.
+    const bool bWriteInPlace = SharedTraversalWeights.IsValid() && SharedTraversalWeights->Num() == TraversalWeights.Num() && IsSharedTraversalDataIdle();
+    if (bWriteInPlace)
     {
-            FlowField.SetTraversalWeights(TraversalWeights);
-            bHasBuiltField = false;
-            bHasDebugSnapshot = false;
-            return;
+        const int32 GridX = FlowFieldSettings.GridSize.X;
+        for (int32 Row = Region.Min.Y; Row < Region.Max.Y; ++Row)
+        {
+            FMemory::Memcpy(SharedTraversalWeights->GetData() + Row * GridX + Region.Min.X, TraversalWeights.GetData() + Row * GridX + Region.Min.X, Region.Width());
+        }
+    }
+    else
+    {
+        SharedTraversalWeights = MakeShared<TArray<uint8>>(TraversalWeights);
+        FlowField.SetSharedTraversalWeights(SharedTraversalWeights);
     }
 
-    const bool bShouldTraceTerrain = bAutoSizeToTerrain && CachedTerrainBounds.IsValid;
-    const float TraceStartZ = bShouldTraceTerrain ? CachedTerrainBounds.Max.Z + TerrainTraceHeight : 0.0f;
-    const float TraceEndZ = bShouldTraceTerrain ? CachedTerrainBounds.Min.Z - TerrainTraceDepth : 0.0f;
-
-    FCollisionQueryParams TerrainQueryParams(SCENE_QUERY_STAT(FlowFieldTerrainTrace), false, this);
-    TerrainQueryParams.AddIgnoredActor(this);
+    // Clearance classes also change up to MaxClearanceClass cells around the region, which their repairs have to cover.
+    FIntRect ClearanceRegion = Region;
+    if (ClearanceLayer.IsValid())
+    {
+        if (!bWriteInPlace)
+        {
+            ClearanceLayer = MakeShared<FFlowFieldClearance>(*ClearanceLayer);
+            FlowField.SetSharedClearance(ClearanceLayer);
+        }
 
-    FCollisionQueryParams ObstacleQueryParams(SCENE_QUERY_STAT(FlowFieldObstacleOverlap), false, this);
-    ObstacleQueryParams.AddIgnoredActor(this);
+        ClearanceRegion = ClearanceLayer->UpdateRegion(TraversalWeights, Region);
+    }
 
-    const float HalfCellSize = FlowFieldSettings.CellSize * 0.5f;
-    const FVector ObstacleExtents(HalfCellSize, HalfCellSize, HalfCellSize); // keep overlap tight to reduce cost
-    const FCollisionShape ObstacleShape = FCollisionShape::MakeBox(ObstacleExtents);
+    // Compact and fast marching fields would be rebuilt from scratch by MarkCellsDirty, rebuild them off the game thread instead.
+    if (!FlowField.CanRepairInPlace())
+    {
+        RebuildCachedFieldsAsync();
+        return;
+    }
 
-    for (int32 Index = 0; Index < TraversalWeights.Num(); ++Index)
+    for (auto It = FieldCache.CreateIterator(); It; ++It)
     {
-            const int32 CellX = Index % FlowFieldSettings.GridSize.X;
-            const int32 CellY = Index / FlowFieldSettings.GridSize.X;
-            const FIntPoint Cell(CellX, CellY);
-            const FVector CellWorld = FlowField.CellToWorld(Cell);
+        FCachedFlowField& Entry = It.Value();
 
-            bool bWalkable = true;
-            FVector SampleLocation = CellWorld;
+        // A build still running integrates the previous weights, restart it.
+        if (Entry.PendingBuild.IsValid())
+        {
+            StartAsyncBuild(Entry, Entry.PendingBuild->Destination);
+        }
 
-            if (bShouldTraceTerrain)
-            {
-                    const FVector TraceStart(CellWorld.X, CellWorld.Y, TraceStartZ);
-                    const FVector TraceEnd(CellWorld.X, CellWorld.Y, TraceEndZ);
+        if (!Entry.Field.IsValid())
+        {
+            continue;
+        }
 
-                    FHitResult Hit;
-                    const bool bHit = World->LineTraceSingleByChannel(Hit, TraceStart, TraceEnd, TerrainCollisionChannel, TerrainQueryParams);
-                    if (bHit)
-                    {
-                            const FVector HitNormal = Hit.ImpactNormal.GetSafeNormal();
-                            const float Dot = FVector::DotProduct(HitNormal, FVector::UpVector);
-                            const float ClampedDot = FMath::Clamp(Dot, -1.0f, 1.0f);
-                            const float SlopeAngleDegrees = FMath::RadiansToDegrees(FMath::Acos(ClampedDot));
-                            if (SlopeAngleDegrees <= MaxWalkableSlopeAngle)
-                            {
-                                    SampleLocation = Hit.Location;
-                            }
-                            else
-                            {
-                                    bWalkable = false;
-                            }
-                    }
-                    else
-                    {
-                            bWalkable = false;
-                    }
+        Entry.Field->SetSharedTraversalWeights(SharedTraversalWeights);
+        Entry.Field->SetSharedClearance(ClearanceLayer);
+        if (Entry.Field->MarkCellsDirty(Entry.MinClearance > 1 ? ClearanceRegion : Region))
+        {
+            // Area fields drop the goals that became blocked, which can move their representative cell.
+            Entry.Destination = Entry.Field->GetDestination();
+        }
+        else
+        {
+            Entry.Field.Reset();
+        }
+
+        if (It.Key() == ActiveHandle.Key && bHasBuiltField)
+        {
+            if (Entry.Field.IsValid())
+            {
+                RefreshDebugSnapshot();
+            }
+            else if (!Entry.PendingBuild.IsValid())
+            {
+                bHasBuiltField = false;
+                bHasDebugSnapshot = false;
             }
+        }
+
+        if (!Entry.IsReady() && !Entry.PendingBuild.IsValid())
+        {
+            It.RemoveCurrent();
+        }
+    }
+}
 
-            if (bWalkable)
+bool AFlowFieldManager::IsSharedTraversalDataIdle() const
+{
+    // Cancelled worker builds keep their field copy, hence their references, until they ran out.
+    auto IsHeldByGameThreadOnly = [this](const auto& SharedData, auto GetFieldData)
+    {
+        int32 GameThreadReferences = GetFieldData(FlowField) == SharedData ? 2 : 1;
+        for (const TPair<FIntVector, FCachedFlowField>& Pair : FieldCache)
+        {
+            const FCachedFlowField& Entry = Pair.Value;
+            if (Entry.Field.IsValid() && GetFieldData(*Entry.Field) == SharedData)
             {
-                    FVector OverlapCenter = SampleLocation;
-                    OverlapCenter.Z += ObstacleExtents.Z;
+                ++GameThreadReferences;
+            }
 
-                    const bool bBlocked = World->OverlapAnyTestByChannel(OverlapCenter, FQuat::Identity, ObstacleCollisionChannel, ObstacleShape, ObstacleQueryParams);
-                    if (bBlocked)
-                    {
-                            bWalkable = false;
-                    }
+            if (Entry.PendingBuild.IsValid() && Entry.PendingBuild->bTimeSliced && GetFieldData(*Entry.PendingBuild->Field) == SharedData)
+            {
+                ++GameThreadReferences;
             }
+        }
+
+        return SharedData.GetSharedReferenceCount() == GameThreadReferences;
+    };
 
-            TraversalWeights[Index] = bWalkable ? WeightValue : 0;
+    return IsHeldByGameThreadOnly(SharedTraversalWeights, [](const FFlowField& Field) -> const auto& { return Field.GetSharedTraversalWeights(); })
+        && (!ClearanceLayer.IsValid() || IsHeldByGameThreadOnly(ClearanceLayer, [](const FFlowField& Field) -> const auto& { return Field.GetSharedClearance(); }));
+}
+
+void AFlowFieldManager::UpdateClearanceLayer()
+{
+    const int32 NumCells = FlowFieldSettings.GridSize.X * FlowFieldSettings.GridSize.Y;
+    if (bUseHierarchicalField || MaxClearanceClass <= 1 || TraversalWeights.Num() != NumCells)
+    {
+        ClearanceLayer.Reset();
+    }
+    else
+    {
+        TSharedRef<FFlowFieldClearance> NewClearanceLayer = MakeShared<FFlowFieldClearance>();
+        NewClearanceLayer->Build(TraversalWeights, FlowFieldSettings.GridSize, MaxClearanceClass);
+        ClearanceLayer = NewClearanceLayer;
     }
 
-    FlowField.SetTraversalWeights(TraversalWeights);
-    bHasBuiltField = false;
-    bHasDebugSnapshot = false;
+    FlowField.SetSharedClearance(ClearanceLayer);
 }
 
 void AFlowFieldManager::RefreshDebugSnapshot()
 {
-    if (!bEnableDebugDraw)
+    if (!bEnableDebugDraw || bUseHierarchicalField)
+    {
+        bHasDebugSnapshot = false;
+        return;
+    }
+
+    const FCachedFlowField* Entry = FieldCache.Find(ActiveHandle.Key);
+    if (!Entry || !Entry->Field)
     {
         bHasDebugSnapshot = false;
         return;
     }
 
-    DebugSnapshot = FlowField.CreateDebugSnapshot();
+    DebugSnapshot = FFlowFieldDebugSnapshot(Entry->Field);
     bHasDebugSnapshot = true;
+    ++DebugSnapshotVersion;
 }
 
-void AFlowFieldManager::DrawDebug() const
+void AFlowFieldManager::DrawDebug()
 {
+    UpdateDebugVisualization();
+
     if (!bEnableDebugDraw)
     {
         return;
@@ -237,7 +1538,6 @@ void AFlowFieldManager::DrawDebug() const
 
     const float CellSizeLocal = bHasDebugSnapshot ? DebugSnapshot.CellSize : FlowFieldSettings.CellSize;
     const FVector Origin = bHasDebugSnapshot ? DebugSnapshot.Origin : FlowFieldSettings.Origin;
-    const float ArrowLength = CellSizeLocal * DirectionArrowScale;
     const FVector UpOffset(0.0f, 0.0f, DebugHeightOffset);
 
     if (bDrawGrid)
@@ -260,69 +1560,254 @@ void AFlowFieldManager::DrawDebug() const
             }
     }
 
-    if (!bHasDebugSnapshot)
+    if (bHasDebugSnapshot && bDrawIntegrationValues)
     {
-            return;
+            DrawIntegrationValuesNearView(World);
+    }
+
+    if (bDrawDestination && bHasBuiltField)
+    {
+            const FVector DestinationLocation = CachedDestinationWorld + UpOffset;
+            DrawDebugSphere(World, DestinationLocation, DestinationMarkerRadius, 16, DirectionColor, false, 0.0f, 0, DebugLineThickness);
+    }
+}
+
+void AFlowFieldManager::UpdateDebugVisualization()
+{
+    uint32 VisualizationKey = 0;
+    if (bEnableDebugDraw && bHasDebugSnapshot)
+    {
+        const uint32 Options = (bDrawDirections ? 1u : 0u) | (bHighlightBlockedCells ? 2u : 0u) | (bDrawIntegrationHeatmap ? 4u : 0u);
+        VisualizationKey = HashCombineFast(GetTypeHash(DebugSnapshotVersion), Options);
+        VisualizationKey = HashCombineFast(VisualizationKey, HashCombineFast(GetTypeHash(DirectionArrowScale), GetTypeHash(DebugHeightOffset)));
+        VisualizationKey = HashCombineFast(VisualizationKey, HashCombineFast(GetTypeHash(DirectionColor), GetTypeHash(BlockedCellColor)));
+        VisualizationKey = HashCombineFast(VisualizationKey, HashCombineFast(GetTypeHash(DebugArrowMesh), GetTypeHash(DebugBlockedCellMesh)));
+        VisualizationKey = HashCombineFast(VisualizationKey, HashCombineFast(GetTypeHash(DebugHeatmapMaterial), GetTypeHash(DebugHeatmapMesh)));
+        VisualizationKey = FMath::Max(VisualizationKey, 1u);
+    }
+    else
+    {
+        // Do not keep an evicted field alive for the debug view.
+        DebugSnapshot = FFlowFieldDebugSnapshot();
+    }
+
+    if (VisualizationKey == BuiltDebugVisualizationKey)
+    {
+        return;
+    }
+
+    BuiltDebugVisualizationKey = VisualizationKey;
+    EnsureDebugComponents();
+    DebugDirectionInstances->ClearInstances();
+    DebugBlockedInstances->ClearInstances();
+    DebugHeatmapPlane->SetVisibility(false);
+
+    if (VisualizationKey == 0)
+    {
+        return;
+    }
+
+    const FIntPoint Size = DebugSnapshot.GridSize;
+    const float CellSizeLocal = DebugSnapshot.CellSize;
+    const FVector UpOffset(0.0f, 0.0f, DebugHeightOffset);
+    const int32 NumCells = Size.X * Size.Y;
+
+    TArray<FTransform> ArrowTransforms;
+    TArray<FTransform> BlockedTransforms;
+    const float ArrowLength = CellSizeLocal * DirectionArrowScale;
+    const FVector ArrowScale(ArrowLength * 0.004f, ArrowLength * 0.004f, ArrowLength * 0.01f);
+    const FVector BlockedScale(CellSizeLocal * 0.01f, CellSizeLocal * 0.01f, 0.2f);
+    for (int32 Index = 0; Index < NumCells; ++Index)
+    {
+        const FVector CellCenter = DebugSnapshot.Origin + FVector((Index % Size.X + 0.5f) * CellSizeLocal, (Index / Size.X + 0.5f) * CellSizeLocal, 0.0f) + UpOffset;
+        if (!DebugSnapshot.IsWalkable(Index))
+        {
+            if (bHighlightBlockedCells)
+            {
+                BlockedTransforms.Emplace(FQuat::Identity, CellCenter, BlockedScale);
+            }
+
+            continue;
+        }
+
+        const FVector Direction(DebugSnapshot.GetDirection(Index), 0.0f);
+        if (bDrawDirections && !Direction.IsNearlyZero())
+        {
+            ArrowTransforms.Emplace(FRotationMatrix::MakeFromZ(Direction).ToQuat(), CellCenter, ArrowScale);
+        }
+    }
+
+    DebugDirectionInstances->SetStaticMesh(DebugArrowMesh);
+    DebugDirectionInstances->SetVectorParameterValueOnMaterials(TEXT("Color"), FVector(FLinearColor(DirectionColor)));
+    DebugDirectionInstances->AddInstances(ArrowTransforms, false, true, false);
+
+    DebugBlockedInstances->SetStaticMesh(DebugBlockedCellMesh);
+    DebugBlockedInstances->SetVectorParameterValueOnMaterials(TEXT("Color"), FVector(FLinearColor(BlockedCellColor)));
+    DebugBlockedInstances->AddInstances(BlockedTransforms, false, true, false);
+
+    if (bDrawIntegrationHeatmap && DebugHeatmapMaterial && NumCells > 0)
+    {
+        UploadDebugHeatmap();
+    }
+}
+
+void AFlowFieldManager::EnsureDebugComponents()
+{
+    if (DebugDirectionInstances)
+    {
+        return;
     }
 
+    // Placed in world space whether the manager has a root component or not.
+    const auto InitDebugComponent = [](UStaticMeshComponent* Component)
+    {
+        Component->SetUsingAbsoluteLocation(true);
+        Component->SetUsingAbsoluteRotation(true);
+        Component->SetUsingAbsoluteScale(true);
+        Component->SetMobility(EComponentMobility::Movable);
+        Component->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+        Component->SetCanEverAffectNavigation(false);
+        Component->SetCastShadow(false);
+        Component->RegisterComponent();
+    };
+
+    DebugDirectionInstances = NewObject<UHierarchicalInstancedStaticMeshComponent>(this, TEXT("DebugDirectionInstances"), RF_Transient);
+    InitDebugComponent(DebugDirectionInstances);
+
+    DebugBlockedInstances = NewObject<UHierarchicalInstancedStaticMeshComponent>(this, TEXT("DebugBlockedInstances"), RF_Transient);
+    InitDebugComponent(DebugBlockedInstances);
+
+    DebugHeatmapPlane = NewObject<UStaticMeshComponent>(this, TEXT("DebugHeatmapPlane"), RF_Transient);
+    InitDebugComponent(DebugHeatmapPlane);
+}
+
+void AFlowFieldManager::UploadDebugHeatmap()
+{
+    const FIntPoint Size = DebugSnapshot.GridSize;
     const int32 NumCells = Size.X * Size.Y;
+
+    if (!DebugHeatmapTexture || DebugHeatmapTexture->GetSizeX() != Size.X || DebugHeatmapTexture->GetSizeY() != Size.Y)
+    {
+        DebugHeatmapTexture = UTexture2D::CreateTransient(Size.X, Size.Y, PF_B8G8R8A8);
+        DebugHeatmapTexture->Filter = TF_Nearest;
+        DebugHeatmapTexture->UpdateResource();
+    }
+
+    DebugHeatmapPlane->SetStaticMesh(DebugHeatmapMesh);
+    if (!DebugHeatmapMaterialInstance || DebugHeatmapMaterialInstance->Parent != DebugHeatmapMaterial)
+    {
+        DebugHeatmapMaterialInstance = UMaterialInstanceDynamic::Create(DebugHeatmapMaterial, this);
+        DebugHeatmapPlane->SetMaterial(0, DebugHeatmapMaterialInstance);
+    }
+
+    DebugHeatmapMaterialInstance->SetTextureParameterValue(DebugHeatmapTextureParameter, DebugHeatmapTexture);
+
+    // The plane is 100 units wide and centred on its pivot; texel (X, Y) lands on cell (X, Y).
+    const float CellSizeLocal = DebugSnapshot.CellSize;
+    const FVector GridExtent(Size.X * CellSizeLocal, Size.Y * CellSizeLocal, 0.0f);
+    DebugHeatmapPlane->SetWorldLocation(DebugSnapshot.Origin + GridExtent * 0.5f + FVector(0.0f, 0.0f, DebugHeightOffset));
+    DebugHeatmapPlane->SetWorldScale3D(FVector(GridExtent.X * 0.01f, GridExtent.Y * 0.01f, 1.0f));
+    DebugHeatmapPlane->SetVisibility(true);
+
+    float MaxCost = 0.0f;
+    for (int32 Index = 0; Index < NumCells; ++Index)
+    {
+        const float Cost = DebugSnapshot.GetIntegrationCost(Index);
+        if (Cost < TNumericLimits<float>::Max())
+        {
+            MaxCost = FMath::Max(MaxCost, Cost);
+        }
+    }
+
+    // Released by the render thread once uploaded.
+    FColor* Texels = static_cast<FColor*>(FMemory::Malloc(NumCells * sizeof(FColor)));
     for (int32 Index = 0; Index < NumCells; ++Index)
     {
-            const int32 CellX = Index % Size.X;
-            const int32 CellY = Index / Size.X;
+        const float Cost = DebugSnapshot.GetIntegrationCost(Index);
+        if (Cost < TNumericLimits<float>::Max() && DebugSnapshot.IsWalkable(Index))
+        {
+            const float Alpha = MaxCost > 0.0f ? Cost / MaxCost : 0.0f;
+            Texels[Index] = FLinearColor::LerpUsingHSV(FLinearColor::Green, FLinearColor::Red, Alpha).ToFColor(true);
+        }
+        else
+        {
+            Texels[Index] = FColor::Transparent;
+        }
+    }
+
+    FUpdateTextureRegion2D* Region = new FUpdateTextureRegion2D(0, 0, 0, 0, Size.X, Size.Y);
+    DebugHeatmapTexture->UpdateTextureRegions(0, 1, Region, Size.X * sizeof(FColor), sizeof(FColor), reinterpret_cast<uint8*>(Texels),
+        [](uint8* SrcData, const FUpdateTextureRegion2D* Regions)
+        {
+            FMemory::Free(SrcData);
+            delete Regions;
+        });
+}
+
+void AFlowFieldManager::DrawIntegrationValuesNearView(UWorld* World) const
+{
+    FVector ViewLocation;
+    FVector ViewDirection = FVector::ZeroVector;
+    float MinViewCosine = -1.0f;
+    const APlayerController* PlayerController = World->GetFirstPlayerController();
+    if (PlayerController && PlayerController->PlayerCameraManager)
+    {
+        const APlayerCameraManager* Camera = PlayerController->PlayerCameraManager;
+        ViewLocation = Camera->GetCameraLocation();
+        ViewDirection = Camera->GetCameraRotation().Vector();
+
+        // Cone around the frustum diagonal of a 16:9 view, so no visible cell is culled.
+        const float TanHalfFov = FMath::Tan(FMath::DegreesToRadians(FMath::Clamp(Camera->GetFOVAngle(), 1.0f, 170.0f) * 0.5f));
+        MinViewCosine = 1.0f / FMath::Sqrt(1.0f + FMath::Square(TanHalfFov * 1.15f));
+    }
+    else if (World->ViewLocationsRenderedLastFrame.Num() > 0)
+    {
+        // Editor viewports only report their location: the labels are culled by distance alone.
+        ViewLocation = World->ViewLocationsRenderedLastFrame[0];
+    }
+    else
+    {
+        return;
+    }
 
-            const FVector CellCenter = Origin + FVector((CellX + 0.5f) * CellSizeLocal, (CellY + 0.5f) * CellSizeLocal, 0.0f) + UpOffset;
+    const FIntPoint Size = DebugSnapshot.GridSize;
+    const float CellSizeLocal = DebugSnapshot.CellSize;
+    const FVector UpOffset(0.0f, 0.0f, DebugHeightOffset);
+    const float MaxDistanceSquared = FMath::Square(IntegrationTextMaxDistance);
 
-            const bool bIsWalkable = DebugSnapshot.WalkableField.IsValidIndex(Index) && DebugSnapshot.WalkableField[Index] > 0;
+    const FVector ViewExtent(IntegrationTextMaxDistance, IntegrationTextMaxDistance, 0.0f);
+    const FIntRect VisibleCells(
+        FIntPoint(FMath::Max(0, FMath::FloorToInt32((ViewLocation.X - ViewExtent.X - DebugSnapshot.Origin.X) / CellSizeLocal)), FMath::Max(0, FMath::FloorToInt32((ViewLocation.Y - ViewExtent.Y - DebugSnapshot.Origin.Y) / CellSizeLocal))),
+        FIntPoint(FMath::Min(Size.X, FMath::CeilToInt32((ViewLocation.X + ViewExtent.X - DebugSnapshot.Origin.X) / CellSizeLocal)), FMath::Min(Size.Y, FMath::CeilToInt32((ViewLocation.Y + ViewExtent.Y - DebugSnapshot.Origin.Y) / CellSizeLocal))));
 
-            if (bDrawDirections)
+    for (int32 CellY = VisibleCells.Min.Y; CellY < VisibleCells.Max.Y; ++CellY)
+    {
+        for (int32 CellX = VisibleCells.Min.X; CellX < VisibleCells.Max.X; ++CellX)
+        {
+            const FVector CellCenter = DebugSnapshot.Origin + FVector((CellX + 0.5f) * CellSizeLocal, (CellY + 0.5f) * CellSizeLocal, 0.0f) + UpOffset;
+            const FVector ToCell = CellCenter - ViewLocation;
+            const float DistanceSquared = ToCell.SizeSquared();
+            if (DistanceSquared > MaxDistanceSquared || FVector::DotProduct(ToCell, ViewDirection) < MinViewCosine * FMath::Sqrt(DistanceSquared))
             {
-                    if (DebugSnapshot.DirectionField.IsValidIndex(Index))
-                    {
-                            const FVector Direction = FVector(DebugSnapshot.DirectionField[Index], 0.0f);
-                            if (!Direction.IsNearlyZero())
-                            {
-                                    const FVector Start = CellCenter;
-                                    const FVector End = Start + Direction.GetSafeNormal() * ArrowLength;
-                                    DrawDebugDirectionalArrow(World, Start, End, 25.0f, DirectionColor, false, 0.0f, 0, DebugLineThickness);
-                            }
-                    }
+                continue;
             }
 
-            if (bDrawIntegrationValues)
-            {
-                    FString Label;
-                    if (bIsWalkable && DebugSnapshot.IntegrationField.IsValidIndex(Index))
-                    {
-                            const float Cost = DebugSnapshot.IntegrationField[Index];
-                            if (Cost < TNumericLimits<float>::Max())
-                            {
-                                    Label = FString::Printf(TEXT("%.1f"), Cost);
-                            }
-                            else
-                            {
-                                    Label = TEXT("∞");
-                            }
-                    }
-                    else
-                    {
-                            Label = TEXT("X");
-                    }
+            const int32 Index = CellY * Size.X + CellX;
+            const bool bIsWalkable = DebugSnapshot.IsWalkable(Index);
 
-                    const FColor TextColor = bIsWalkable ? IntegrationTextColor : BlockedCellColor;
-                    DrawDebugString(World, CellCenter, Label, nullptr, TextColor, 0.0f, true, DebugTextScale);
+            FString Label;
+            if (bIsWalkable)
+            {
+                const float Cost = DebugSnapshot.GetIntegrationCost(Index);
+                Label = Cost < TNumericLimits<float>::Max() ? FString::Printf(TEXT("%.1f"), Cost) : FString(TEXT("∞"));
             }
-            else if (bHighlightBlockedCells && !bIsWalkable)
+            else
             {
-                    const FVector Extent(CellSizeLocal * 0.5f, CellSizeLocal * 0.5f, 10.0f);
-                    DrawDebugSolidBox(World, CellCenter, Extent, BlockedCellColor, false, 0.0f, 0);
+                Label = TEXT("X");
             }
-    }
 
-    if (bDrawDestination && bHasBuiltField)
-    {
-            const FVector DestinationLocation = CachedDestinationWorld + UpOffset;
-            DrawDebugSphere(World, DestinationLocation, DestinationMarkerRadius, 16, DirectionColor, false, 0.0f, 0, DebugLineThickness);
+            DrawDebugString(World, CellCenter, Label, nullptr, bIsWalkable ? IntegrationTextColor : BlockedCellColor, 0.0f, true, DebugTextScale);
+        }
     }
 }
 
@@ -367,7 +1852,16 @@ void AFlowFieldManager::RecalculateTerrainBounds()
 
     if (!DetectedBounds.IsValid)
     {
-        const FBox ManagerBounds = GetComponentsBoundingBox(true);
+        // The debug visuals span the grid itself, measuring them would grow the grid on every rebuild.
+        FBox ManagerBounds(ForceInit);
+        ForEachComponent<UPrimitiveComponent>(false, [this, &ManagerBounds](const UPrimitiveComponent* Component)
+        {
+            if (Component->IsRegistered() && Component != DebugDirectionInstances && Component != DebugBlockedInstances && Component != DebugHeatmapPlane)
+            {
+                ManagerBounds += Component->Bounds.GetBox();
+            }
+        });
+
         if (ManagerBounds.IsValid)
         {
             DetectedBounds = ManagerBounds;
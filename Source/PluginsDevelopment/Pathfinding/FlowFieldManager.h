@@ -3,17 +3,56 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
 #include "Engine/EngineTypes.h"
+#include "CollisionQueryParams.h"
+#include "CollisionShape.h"
 #include "UObject/ObjectPtr.h"
+#include "Tasks/Task.h"
 
 #include "FlowField.h"
+#include "FlowFieldHierarchy.h"
+#include "FlowFieldTerrainSampler.h"
+#include "Interfaces/GroupMovementProvider.h"
 
 #include "FlowFieldManager.generated.h"
 
+class UFlowFieldBakedData;
+class FFlowFieldClearance;
+class UHierarchicalInstancedStaticMeshComponent;
+class UStaticMeshComponent;
+class UStaticMesh;
+class UMaterialInterface;
+class UMaterialInstanceDynamic;
+class UTexture2D;
+
+/**
+ * Reference to a flow field cached by AFlowFieldManager. Agents keep the handle and sample through the manager, so a field
+ * evicted from the cache is transparently rebuilt the next time it is sampled.
+ */
+USTRUCT(BlueprintType)
+struct PLUGINSDEVELOPMENT_API FFlowFieldHandle
+{
+        GENERATED_BODY()
+
+        /**
+         * Cache key, the destination cell snapped to the cache granularity in X and Y and the clearance class in Z.
+         * Area fields use a hash of their goal cells in X and AreaCacheKeyY in Y.
+         */
+        UPROPERTY(BlueprintReadOnly, Category = "Flow Field")
+        FIntVector Key = FIntVector(-1, -1, 0);
+
+        /** Cell the field leads to. Can differ from the requested cell when a nearby destination was already cached. */
+        UPROPERTY(BlueprintReadOnly, Category = "Flow Field")
+        FIntPoint Destination = FIntPoint(-1, -1);
+
+        bool IsValid() const { return Destination.X >= 0 && Destination.Y >= 0; }
+};
+
 /**
- * Centralised manager that owns a flow field and exposes debug utilities to visualise it in the level.
+ * Centralised manager that owns the flow fields of the level and exposes debug utilities to visualise them.
+ * Fields are cached per destination so agents heading to the same place share one build.
  */
 UCLASS()
-class PLUGINSDEVELOPMENT_API AFlowFieldManager : public AActor
+class PLUGINSDEVELOPMENT_API AFlowFieldManager : public AActor, public IGroupMovementProvider
 {
         GENERATED_BODY()
 
@@ -23,6 +62,7 @@ public:
         virtual void Tick(float DeltaSeconds) override;
         virtual void OnConstruction(const FTransform& Transform) override;
         virtual void BeginPlay() override;
+        virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
         /** Rebuilds the flow field using the supplied destination cell. */
         UFUNCTION(BlueprintCallable, Category = "Flow Field")
@@ -36,26 +76,278 @@ public:
         UFUNCTION(BlueprintCallable, Category = "Flow Field")
         FVector GetDirectionForWorldPosition(const FVector& WorldPosition) const;
 
+        /**
+         * Returns a handle to a field leading to the destination cell, building it only if no cached field already leads there.
+         * Fields built with a MinClearance above 1 keep agents out of the cells narrower than that clearance class, see
+         * GetClearanceForAgentRadius; classes are clamped to MaxClearanceClass.
+         * The returned handle is invalid if the destination is outside the grid or blocked.
+         */
+        UFUNCTION(BlueprintCallable, Category = "Flow Field|Cache")
+        FFlowFieldHandle AcquireFlowFieldToCell(const FIntPoint& DestinationCell, int32 MinClearance = 0);
+
+        /** Same as AcquireFlowFieldToCell using a world destination. */
+        UFUNCTION(BlueprintCallable, Category = "Flow Field|Cache")
+        FFlowFieldHandle AcquireFlowFieldToWorldLocation(const FVector& DestinationLocation, int32 MinClearance = 0);
+
+        /**
+         * Returns a handle to a field leading every cell to the closest cell overlapping WorldBounds, e.g. a formation
+         * footprint or a capture zone, so a whole group shares a single build. Hierarchical fields lead to the first
+         * walkable cell of the area instead, and a single goal cell is the same as AcquireFlowFieldToCell. The handle
+         * is invalid if no cell of the area is walkable.
+         */
+        UFUNCTION(BlueprintCallable, Category = "Flow Field|Cache")
+        FFlowFieldHandle AcquireFlowFieldToArea(const FBox& WorldBounds, int32 MinClearance = 0);
+
+        /** Same as AcquireFlowFieldToArea with an explicit set of goal cells, e.g. every cell around a building. */
+        FFlowFieldHandle AcquireFlowFieldToCells(TConstArrayView<FIntPoint> GoalCells, int32 MinClearance = 0);
+
+        /**
+         * Same as AcquireFlowFieldToCell but integrates the field on a worker task, or in Tick within FieldBuildBudgetMs per
+         * frame when bTimeSliceFieldBuilds is set. The handle is returned immediately and becomes ready once the build is
+         * published on the game thread; poll IsFlowFieldReady before following it, or steer with GetSteeringDirectionForHandle
+         * meanwhile. Hierarchical fields integrate their sectors lazily on the game thread and are always built synchronously.
+         */
+        UFUNCTION(BlueprintCallable, Category = "Flow Field|Cache")
+        FFlowFieldHandle RequestFlowFieldToCellAsync(const FIntPoint& DestinationCell, int32 MinClearance = 0);
+
+        /**
+         * Same as AcquireFlowFieldToArea but builds the field like RequestFlowFieldToCellAsync. Until the build is published,
+         * the destination of the handle is the first walkable cell of the area.
+         */
+        UFUNCTION(BlueprintCallable, Category = "Flow Field|Cache")
+        FFlowFieldHandle RequestFlowFieldToAreaAsync(const FBox& WorldBounds, int32 MinClearance = 0);
+
+        /** Same as RequestFlowFieldToAreaAsync with an explicit set of goal cells. */
+        FFlowFieldHandle RequestFlowFieldToCellsAsync(TConstArrayView<FIntPoint> GoalCells, int32 MinClearance = 0);
+
+        /** Clearance class to request for agents of the supplied radius, 1 for agents no wider than a cell. */
+        UFUNCTION(BlueprintPure, Category = "Flow Field|Clearance")
+        int32 GetClearanceForAgentRadius(float AgentRadius) const;
+
+        /** Returns true if the field referenced by the handle is built and can be sampled. */
+        UFUNCTION(BlueprintCallable, Category = "Flow Field|Cache")
+        bool IsFlowFieldReady(const FFlowFieldHandle& Handle) const;
+
+        /** Returns true while the field referenced by the handle is being built, on a worker task or time-sliced. */
+        UFUNCTION(BlueprintCallable, Category = "Flow Field|Cache")
+        bool IsFlowFieldBuilding(const FFlowFieldHandle& Handle) const;
+
+        /**
+         * Progress in [0, 1] of the build running for the handle, 1 when none is running. Worker builds only report 0 until
+         * they complete; time-sliced builds report their actual progress.
+         */
+        UFUNCTION(BlueprintCallable, Category = "Flow Field|Cache")
+        float GetFlowFieldBuildProgress(const FFlowFieldHandle& Handle) const;
+
+        /** Samples the field referenced by the handle, rebuilding it if it was evicted. Returns zero if it cannot be built. */
+        UFUNCTION(BlueprintCallable, Category = "Flow Field|Cache")
+        FVector GetDirectionForHandle(const FFlowFieldHandle& Handle, const FVector& WorldPosition);
+
+        /**
+         * Same as GetDirectionForHandle, except that agents keep moving while the first build of the field is running: they
+         * follow the part of a time-sliced field already integrated, and head straight for the destination elsewhere.
+         */
+        UFUNCTION(BlueprintCallable, Category = "Flow Field|Cache")
+        FVector GetSteeringDirectionForHandle(const FFlowFieldHandle& Handle, const FVector& WorldPosition);
+
+        /**
+         * Batch version of GetDirectionForWorldPosition for crowds. Directions are bilinearly interpolated between cell
+         * centres. OutDirections must hold at least as many entries as WorldPositions.
+         */
+        void SampleDirections(TConstArrayView<FVector> WorldPositions, TArrayView<FVector> OutDirections) const;
+
+        /** Batch version of GetDirectionForHandle, with the same interpolation as SampleDirections. */
+        void SampleDirectionsForHandle(const FFlowFieldHandle& Handle, TConstArrayView<FVector> WorldPositions, TArrayView<FVector> OutDirections);
+
+        /**
+         * IGroupMovementProvider: group orders share one area field toward their formation footprint. The field is built
+         * asynchronously, followers steer with GetSteeringDirectionForHandle until it is published.
+         */
+        virtual int32 AcquireGroupPath(const FBox& GoalBounds, float AgentRadius) override;
+        virtual void SampleGroupPath(int32 PathId, TConstArrayView<FVector> WorldPositions, TArrayView<FVector> OutDirections) override;
+        virtual void ReleaseGroupPath(int32 PathId) override;
+
+        /** Number of fields currently held by the cache. */
+        int32 GetNumCachedFields() const { return FieldCache.Num(); }
+
         /** Returns the current flow field settings. */
         const FFlowFieldSettings& GetSettings() const { return FlowFieldSettings; }
 
         /** Converts a world position into a cell coordinate using the managed flow field. */
-        FIntPoint WorldToCell(const FVector& WorldPosition) const { return FlowField.WorldToCell(WorldPosition); }
+        FIntPoint WorldToCell(const FVector& WorldPosition) const { return bUseHierarchicalField ? HierarchicalField.WorldToCell(WorldPosition) : FlowField.WorldToCell(WorldPosition); }
 
         /** Converts a cell coordinate into a world position using the managed flow field. */
-        FVector CellToWorld(const FIntPoint& Cell) const { return FlowField.CellToWorld(Cell); }
+        FVector CellToWorld(const FIntPoint& Cell) const { return bUseHierarchicalField ? HierarchicalField.CellToWorld(Cell) : FlowField.CellToWorld(Cell); }
 
         /** Returns true if the supplied cell is walkable within the current traversal weights. */
-        bool IsWalkable(const FIntPoint& Cell) const { return FlowField.IsWalkable(Cell); }
+        bool IsWalkable(const FIntPoint& Cell) const { return bUseHierarchicalField ? HierarchicalField.IsWalkable(Cell) : FlowField.IsWalkable(Cell); }
+
+        /**
+         * Re-evaluates the traversal weights of the cells overlapping WorldBounds, e.g. after a building was placed or
+         * destroyed, and repairs the cached flat fields in place instead of re-tracing the grid and rebuilding them.
+         */
+        UFUNCTION(BlueprintCallable, Category = "Flow Field")
+        void UpdateTraversalWeightsInRegion(const FBox& WorldBounds);
+
+        /**
+         * Traces the traversal weights now and stores them in BakedTraversalData, so BeginPlay loads them instead of tracing.
+         * Run it again whenever the terrain or the static obstacles change; stale data is detected and ignored.
+         */
+        UFUNCTION(CallInEditor, Category = "Flow Field|Baking")
+        void BakeTraversalWeightsToAsset();
+
+        /** Returns true while a time-sliced traversal bake is still running. */
+        bool IsBakingTraversalWeights() const { return NextBakeCell != INDEX_NONE; }
+
+        /** Progress of the running time-sliced bake in [0, 1]; 1 when no bake is running. */
+        float GetTraversalBakeProgress() const;
 
         /** Returns true if the manager currently has a valid built field. */
         bool HasValidField() const { return bHasBuiltField; }
 
 protected:
+        /** Field integrated on a worker task. The task owns it until the game thread publishes it. */
+        struct FAsyncFlowFieldBuild
+        {
+                FIntPoint Destination = FIntPoint(-1, -1);
+                TSharedPtr<const TArray<FIntPoint>> GoalCells;
+                TSharedPtr<FFlowField> Field;
+                std::atomic<bool> bCancelled = false;
+                bool bSucceeded = false;
+
+                /** Advanced by Step in Tick on the game thread instead of running on a worker task. */
+                bool bTimeSliced = false;
+        };
+
+        /**
+         * Field built towards one destination and shared by every handle with the same key.
+         * Field is the front buffer agents sample; PendingBuild is the back buffer being integrated and only replaces
+         * Field on the game thread once complete, so agents keep following the previous field until then.
+         */
+        struct FCachedFlowField
+        {
+                FIntPoint Destination = FIntPoint(-1, -1);
+                TSharedPtr<FFlowField> Field;
+                TUniquePtr<FHierarchicalFlowField> HierarchicalField;
+                TSharedPtr<FAsyncFlowFieldBuild> PendingBuild;
+                UE::Tasks::FTask PendingTask;
+                uint64 LastUsed = 0;
+                int32 MinClearance = 0;
+
+                /** Goal cells of area fields, null for single destination fields. */
+                TSharedPtr<const TArray<FIntPoint>> GoalCells;
+
+                bool IsReady() const { return Field.IsValid() || HierarchicalField.IsValid(); }
+                bool IsPendingBuildComplete() const;
+                FVector GetDirectionForWorldPosition(const FVector& WorldPosition) const;
+                void SampleDirections(TConstArrayView<FVector> WorldPositions, TArrayView<FVector> OutDirections) const;
+                SIZE_T GetAllocatedSize() const;
+        };
+
+        /** Y component of the cache keys of area fields, never a valid destination row. */
+        static constexpr int32 AreaCacheKeyY = -2;
+
+        FIntVector MakeCacheKey(const FIntPoint& DestinationCell, int32 MinClearance) const;
+        FIntVector MakeAreaCacheKey(TConstArrayView<FIntPoint> GoalCells, int32 MinClearance) const;
+
+        /** Cells overlapping WorldBounds in XY, the goals of the area fields. */
+        void GetAreaGoalCells(const FBox& WorldBounds, TArray<FIntPoint>& OutGoalCells) const;
+
+        /** Stores the goals of an area key, dropping the field of another area that hashed to the same key. */
+        void RegisterAreaGoals(const FIntVector& Key, TConstArrayView<FIntPoint> GoalCells);
+
+        /** Whether agents of the clearance class of the key can stand on the cell. */
+        bool IsWalkableForKey(const FIntPoint& Cell, const FIntVector& Key) const;
+
+        /** Adds an entry for a field not cached yet and starts its async build, reserving its size in the cache budget. */
+        FCachedFlowField& AddPendingCachedField(const FIntVector& Key, const FIntPoint& DestinationCell);
+
+        int32 GetClearanceClass(int32 MinClearance) const;
+        FCachedFlowField* FindOrBuildCachedField(const FIntVector& Key, const FIntPoint& DestinationCell);
+        void StartAsyncBuild(FCachedFlowField& Entry, const FIntPoint& DestinationCell);
+        void CancelAsyncBuild(FCachedFlowField& Entry);
+
+        /** Publishes the finished worker builds. Returns false if the entry has no field left and should be dropped. */
+        bool FinishAsyncBuild(FCachedFlowField& Entry, bool bWaitForCompletion);
+        void ProcessAsyncBuilds();
+
+        /** Steps the time-sliced builds within FieldBuildBudgetMs, shared by all of them. */
+        void TickTimeSlicedBuilds();
+        void RebuildCachedFieldsAsync();
+        void EvictCachedFields(SIZE_T IncomingBytes);
+        void ClearFieldCache();
+
+        /** Scene query state shared by every cell evaluated during a bake. */
+        struct FTraversalBakeContext
+        {
+                const UWorld* World = nullptr;
+                bool bTraceTerrain = false;
+                float TraceStartZ = 0.0f;
+                float TraceEndZ = 0.0f;
+                uint8 WalkableWeight = 255;
+
+                /** Landscape and navmesh data of every cell, null when the bake traces the terrain. */
+                const TArray<FFlowFieldCellTerrain>* CellTerrain = nullptr;
+                FCollisionQueryParams TerrainQueryParams;
+                FCollisionQueryParams ObstacleQueryParams;
+                FVector ObstacleExtents = FVector::ZeroVector;
+                FCollisionShape ObstacleShape;
+        };
+
         void UpdateFlowFieldSettings();
         void UpdateTraversalWeights();
+        void ApplyTraversalWeights();
+        void ApplyTraversalWeightsInRegion(const FIntRect& Region);
+
+        /**
+         * Returns true when the shared weights and clearance are only referenced by the manager, its template and the fields
+         * sampled on the game thread, so a region update may write them in place. Any other reference is a worker build.
+         */
+        bool IsSharedTraversalDataIdle() const;
+
+        /** Cells overlapping WorldBounds in XY, clipped to the grid. */
+        FIntRect WorldBoundsToCellRect(const FBox& WorldBounds) const;
+
+        /** Rebuilds the clearance layer from TraversalWeights and shares it with the field template. */
+        void UpdateClearanceLayer();
+
+        /**
+         * Reads the landscape and navmesh data of every cell into CellTerrain when bBakeFromTerrainData is set.
+         * Called once per full bake; region updates reuse the data since the landscape and the navmesh are static.
+         */
+        void SampleCellTerrain();
+        FTraversalBakeContext MakeTraversalBakeContext(const UWorld* World) const;
+        uint8 EvaluateCellTraversalWeight(const FTraversalBakeContext& Context, const FIntPoint& Cell) const;
+
+        /** Evaluates NumCells cells starting at FirstCell into OutWeights, on worker threads when parallel baking is enabled. */
+        void BakeTraversalWeightCells(const FTraversalBakeContext& Context, TArray<uint8>& OutWeights, int32 FirstCell, int32 NumCells) const;
+        void StartTimeSlicedBake();
+        void TickTimeSlicedBake();
+
+        /**
+         * Fingerprint of everything the traced weights depend on: the grid, the bake settings and the transform, mesh and
+         * landscape heightfield of the static primitives colliding with the terrain or obstacle channels inside the grid.
+         */
+        uint32 ComputeTraversalBakeHash() const;
+
+        /** Fingerprint of the paint layers read by bBakeFromTerrainData, kept apart as cooked builds cannot read them. */
+        uint32 ComputeLayerWeightBakeHash() const;
+
+        /** Applies BakedTraversalData if it matches the current level. Returns false when the weights must be traced. */
+        bool TryApplyBakedTraversalWeights();
         void RefreshDebugSnapshot();
-        void DrawDebug() const;
+        void DrawDebug();
+
+        /**
+         * Rebuilds the persistent debug components, instanced arrows and blocked cells and the heat map texture, when the
+         * visualised field or the debug options changed since the last call. The instances are culled by the renderer.
+         */
+        void UpdateDebugVisualization();
+        void EnsureDebugComponents();
+        void UploadDebugHeatmap();
+
+        /** Draws the integration text of the cells in front of the view and within IntegrationTextMaxDistance of it. */
+        void DrawIntegrationValuesNearView(UWorld* World) const;
 
 private:
         /** Automatically resize the flow field to fit the terrain bounds. */
@@ -78,6 +370,51 @@ private:
         UPROPERTY(EditAnywhere, Category = "Flow Field", meta = (EditCondition = "bAutoSizeToTerrain", ClampMin = "0.0"))
         float TerrainTraceDepth = 2000.0f;
 
+        /**
+         * Runs the per cell scene queries of the traversal bake on worker threads so the bake time scales with the core count.
+         */
+        UPROPERTY(EditAnywhere, Category = "Flow Field|Baking")
+        bool bParallelTraversalBake = true;
+
+        /**
+         * Spreads the bake started by BeginPlay over several frames so the level is playable immediately.
+         * Until the bake completes, every cell uses DefaultTraversalWeight.
+         */
+        UPROPERTY(EditAnywhere, Category = "Flow Field|Baking")
+        bool bTimeSliceTraversalBake = false;
+
+        /** Game thread time (in milliseconds) spent on the time-sliced bake each frame. */
+        UPROPERTY(EditAnywhere, Category = "Flow Field|Baking", meta = (EditCondition = "bTimeSliceTraversalBake", ClampMin = "0.1"))
+        float TraversalBakeBudgetMs = 2.0f;
+
+        /**
+         * Offline baked weights loaded instead of tracing the grid. Ignored, with a fall back to tracing, when the grid,
+         * the bake settings or the static geometry changed since BakeTraversalWeightsToAsset was run.
+         */
+        UPROPERTY(EditAnywhere, Category = "Flow Field|Baking")
+        TObjectPtr<UFlowFieldBakedData> BakedTraversalData;
+
+        /**
+         * Derives graded weights from the landscape heightfield, paint layers and navmesh areas instead of tracing the terrain.
+         * A cell weighs DefaultTraversalWeight divided by its cost, so cheap layers need a default below 255 to make a
+         * difference. Cells outside every landscape still trace the terrain; obstacles are still found with overlaps.
+         * Repainting the listed layers invalidates BakedTraversalData in the editor, bake it again afterwards.
+         */
+        UPROPERTY(EditAnywhere, Category = "Flow Field|Baking")
+        bool bBakeFromTerrainData = false;
+
+        /** Traversal costs of the landscape paint layers, unlisted layers cost 1. Only read in the editor. */
+        UPROPERTY(EditAnywhere, Category = "Flow Field|Baking", meta = (EditCondition = "bBakeFromTerrainData"))
+        TArray<FFlowFieldLayerCost> LandscapeLayerCosts;
+
+        /** Multiplies the cost of every cell by the default cost of the nav area under it. */
+        UPROPERTY(EditAnywhere, Category = "Flow Field|Baking", meta = (EditCondition = "bBakeFromTerrainData"))
+        bool bUseNavAreaCosts = false;
+
+        /** Blocks the cells without navmesh under them. */
+        UPROPERTY(EditAnywhere, Category = "Flow Field|Baking", meta = (EditCondition = "bBakeFromTerrainData && bUseNavAreaCosts"))
+        bool bBlockCellsOutsideNavMesh = false;
+
         /** Collision channel used when tracing against the terrain. */
         UPROPERTY(EditAnywhere, Category = "FlowField|Collision", meta = (EditCondition = "bAutoSizeToTerrain"))
         TEnumAsByte<ECollisionChannel> TerrainCollisionChannel = ECC_WorldStatic;
@@ -122,6 +459,58 @@ private:
         UPROPERTY(EditAnywhere, Category = "Flow Field")
         bool bSmoothDirections = true;
 
+        /**
+         * Integration used when building the field. The heap and the bucket queue produce the same field, the bucket queue
+         * being faster on large grids; fast marching produces any angle distances without 45 degree banding.
+         */
+        UPROPERTY(EditAnywhere, Category = "Flow Field")
+        EFlowFieldIntegrationMethod IntegrationMethod = EFlowFieldIntegrationMethod::BucketQueue;
+
+        /**
+         * Stores cached flat fields with quantised directions and integration values, 3 bytes per cell instead of 20.
+         * Weight changes then rebuild the affected fields instead of repairing them.
+         */
+        UPROPERTY(EditAnywhere, Category = "Flow Field")
+        bool bCompactFieldStorage = false;
+
+        /**
+         * Largest clearance class, in cells, fields can be requested with. The clearance layer costs one byte per cell plus
+         * one per class above 1, and is only built for flat fields when this is above 1.
+         */
+        UPROPERTY(EditAnywhere, Category = "Flow Field|Clearance", meta = (ClampMin = "0", ClampMax = "255"))
+        int32 MaxClearanceClass = 0;
+
+        /**
+         * Splits the grid into sectors linked by portals and only integrates the sectors that agents sample.
+         * Intended for very large grids; per cell debug drawing is not available in this mode.
+         */
+        UPROPERTY(EditAnywhere, Category = "Flow Field|Hierarchy")
+        bool bUseHierarchicalField = false;
+
+        /** Number of cells along each side of a sector when the hierarchical field is used. */
+        UPROPERTY(EditAnywhere, Category = "Flow Field|Hierarchy", meta = (EditCondition = "bUseHierarchicalField", ClampMin = "4"))
+        int32 SectorSize = 32;
+
+        /** Memory budget of the field cache. Least recently used fields are evicted when a new field would exceed it. */
+        UPROPERTY(EditAnywhere, Category = "Flow Field|Cache", meta = (ClampMin = "1.0"))
+        float MaxCacheMemoryMB = 256.0f;
+
+        /**
+         * Integrates the builds requested through RequestFlowFieldToCellAsync, and the rebuilds after weight changes, on the
+         * game thread a slice per frame instead of on worker tasks. Meant for servers with few cores, where worker builds
+         * would compete with the game thread; frame time stays bounded whatever the grid size.
+         */
+        UPROPERTY(EditAnywhere, Category = "Flow Field|Cache")
+        bool bTimeSliceFieldBuilds = false;
+
+        /** Game thread time (in milliseconds) spent on the time-sliced field builds each frame. */
+        UPROPERTY(EditAnywhere, Category = "Flow Field|Cache", meta = (EditCondition = "bTimeSliceFieldBuilds", ClampMin = "0.1"))
+        float FieldBuildBudgetMs = 2.0f;
+
+        /** Destinations falling in the same block of this many cells share a single field. 1 only shares exact destinations. */
+        UPROPERTY(EditAnywhere, Category = "Flow Field|Cache", meta = (ClampMin = "1"))
+        int32 CacheDestinationGranularity = 1;
+
         /** Optional offset applied after centering the grid around the actor location. */
         UPROPERTY(EditAnywhere, Category = "Flow Field")
         FVector AdditionalOriginOffset = FVector::ZeroVector;
@@ -146,10 +535,14 @@ private:
         UPROPERTY(EditAnywhere, Category = "Debug", meta = (EditCondition = "bEnableDebugDraw"))
         bool bDrawDirections = true;
 
-        /** Draws integration costs for each cell. */
+        /** Draws integration costs as text for the cells in front of the view, up to IntegrationTextMaxDistance away. */
         UPROPERTY(EditAnywhere, Category = "Debug", meta = (EditCondition = "bEnableDebugDraw"))
         bool bDrawIntegrationValues = false;
 
+        /** Colours the cells by integration cost on a plane over the grid. Requires DebugHeatmapMaterial. */
+        UPROPERTY(EditAnywhere, Category = "Debug", meta = (EditCondition = "bEnableDebugDraw"))
+        bool bDrawIntegrationHeatmap = false;
+
         /** Draws blocked cells with a dedicated colour. */
         UPROPERTY(EditAnywhere, Category = "Debug", meta = (EditCondition = "bEnableDebugDraw"))
         bool bHighlightBlockedCells = true;
@@ -190,13 +583,99 @@ private:
         UPROPERTY(EditAnywhere, Category = "Debug", meta = (ClampMin = "0.0"))
         float DestinationMarkerRadius = 75.0f;
 
+        /** Distance from the view beyond which no integration text is drawn. */
+        UPROPERTY(EditAnywhere, Category = "Debug", meta = (ClampMin = "0.0"))
+        float IntegrationTextMaxDistance = 3000.0f;
+
+        /**
+         * Mesh instanced on every cell with a direction, pointing along +Z like the engine cone. Its material is tinted with
+         * DirectionColor through a "Color" vector parameter, materials without one keep their own colour.
+         */
+        UPROPERTY(EditAnywhere, Category = "Debug")
+        TObjectPtr<UStaticMesh> DebugArrowMesh;
+
+        /**
+         * Mesh instanced on every blocked cell, a 100 unit cube like the engine one. Tinted with BlockedCellColor like
+         * DebugArrowMesh.
+         */
+        UPROPERTY(EditAnywhere, Category = "Debug")
+        TObjectPtr<UStaticMesh> DebugBlockedCellMesh;
+
+        /** Mesh stretched over the grid to draw the heat map, a 100 unit plane like the engine one. */
+        UPROPERTY(EditAnywhere, Category = "Debug")
+        TObjectPtr<UStaticMesh> DebugHeatmapMesh;
+
+        /** Unlit material drawing the texture bound to DebugHeatmapTextureParameter, one texel per cell, over a plane. */
+        UPROPERTY(EditAnywhere, Category = "Debug")
+        TObjectPtr<UMaterialInterface> DebugHeatmapMaterial;
+
+        /** Texture parameter of DebugHeatmapMaterial receiving the heat map. */
+        UPROPERTY(EditAnywhere, Category = "Debug")
+        FName DebugHeatmapTextureParameter = TEXT("FieldTexture");
+
 private:
+        /** Templates holding the settings and shared weights. Cached fields are copies of these and share their weights. */
         FFlowField FlowField;
+        FHierarchicalFlowField HierarchicalField;
+
+        TMap<FIntVector, FCachedFlowField> FieldCache;
+
+        /** Goal cells of every area key handed out, kept when the field is evicted so handles can rebuild it. Reset with the grid. */
+        TMap<FIntVector, TSharedPtr<const TArray<FIntPoint>>> AreaGoals;
+
+        /** Area field followed by a group order, re-acquired from its bounds when the grid changed. */
+        struct FGroupPath
+        {
+                FFlowFieldHandle Handle;
+                FBox GoalBounds = FBox(ForceInit);
+                int32 MinClearance = 0;
+        };
+
+        TMap<int32, FGroupPath> GroupPaths;
+        int32 NextGroupPathId = 0;
+        uint64 CacheUseCounter = 0;
+
+        /** Field driven by BuildFlowFieldToCell, sampled by GetDirectionForWorldPosition and drawn by the debug view. */
+        FFlowFieldHandle ActiveHandle;
         FFlowFieldSettings FlowFieldSettings;
         TArray<uint8> TraversalWeights;
+
+        /** Copy of TraversalWeights shared by the template and the cached fields, written in place by region updates. */
+        TSharedPtr<TArray<uint8>> SharedTraversalWeights;
+
+        /** Terrain sampled by SampleCellTerrain, empty when the weights are traced. */
+        TArray<FFlowFieldCellTerrain> CellTerrain;
+
+        /** Clearance of TraversalWeights shared by the template and the cached fields, null when clearance is disabled. */
+        TSharedPtr<FFlowFieldClearance> ClearanceLayer;
+
+        /** Weights written by the running time-sliced bake, published once NextBakeCell reaches the end. */
+        TArray<uint8> PendingBakeWeights;
+        int32 NextBakeCell = INDEX_NONE;
         FFlowFieldDebugSnapshot DebugSnapshot;
         bool bHasBuiltField = false;
         bool bHasDebugSnapshot = false;
+
+        /** Bumped by RefreshDebugSnapshot. The debug components are rebuilt when it or the debug options change. */
+        uint32 DebugSnapshotVersion = 0;
+        uint32 BuiltDebugVisualizationKey = 0;
+
+        UPROPERTY(Transient)
+        TObjectPtr<UHierarchicalInstancedStaticMeshComponent> DebugDirectionInstances;
+
+        UPROPERTY(Transient)
+        TObjectPtr<UHierarchicalInstancedStaticMeshComponent> DebugBlockedInstances;
+
+        UPROPERTY(Transient)
+        TObjectPtr<UStaticMeshComponent> DebugHeatmapPlane;
+
+        UPROPERTY(Transient)
+        TObjectPtr<UTexture2D> DebugHeatmapTexture;
+
+        /** Instance of DebugHeatmapMaterial on the heat map plane, created once and reused by every upload. */
+        UPROPERTY(Transient)
+        TObjectPtr<UMaterialInstanceDynamic> DebugHeatmapMaterialInstance;
+
         FVector CachedDestinationWorld = FVector::ZeroVector;
         FBox CachedTerrainBounds = FBox(ForceInit);
 
@@ -0,0 +1,354 @@
+#include "FlowFieldTerrainSampler.h"
+
+#include "Async/ParallelFor.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "LandscapeInfo.h"
+#include "LandscapeLayerInfoObject.h"
+#include "LandscapeProxy.h"
+#include "NavigationSystem.h"
+#include "NavAreas/NavArea.h"
+#include "NavAreas/NavArea_Null.h"
+#include "NavMesh/RecastNavMesh.h"
+
+#if WITH_EDITOR
+#include "LandscapeDataAccess.h"
+#include "LandscapeEdit.h"
+#endif
+
+namespace
+{
+        float GradientToSlopeDegrees(float GradientX, float GradientY)
+        {
+                return FMath::RadiansToDegrees(FMath::Atan(FMath::Sqrt(FMath::Square(GradientX) + FMath::Square(GradientY))));
+        }
+
+#if WITH_EDITOR
+        /** Blends the costs of the layers painted on a vertex, the unpainted part of the vertex costing 1. */
+        void ApplyLayerWeights(TConstArrayView<FFlowFieldLayerCost> LayerCosts, const TArray<TArray<uint8>>& LayerWeights, int32 VertexIndex, FFlowFieldCellTerrain& Cell)
+        {
+                float PaintedWeight = 0.0f;
+                float Cost = 0.0f;
+                for (int32 LayerIndex = 0; LayerIndex < LayerCosts.Num(); ++LayerIndex)
+                {
+                        if (LayerWeights[LayerIndex].IsEmpty())
+                        {
+                                continue;
+                        }
+
+                        const float Weight = LayerWeights[LayerIndex][VertexIndex] / 255.0f;
+                        PaintedWeight += Weight;
+                        Cost += Weight * LayerCosts[LayerIndex].CostMultiplier;
+
+                        if (LayerCosts[LayerIndex].bBlocksTraversal && Weight >= 0.5f)
+                        {
+                                Cell.bBlocked = true;
+                        }
+                }
+
+                // Weight blended layers sum to one; non blended layers painted over each other are averaged instead.
+                Cell.CostMultiplier = PaintedWeight > 1.0f ? Cost / PaintedWeight : Cost + (1.0f - PaintedWeight);
+        }
+
+        /**
+         * Inclusive landscape vertex rect covering the grid, with one vertex of margin for the slope gradient, clamped to
+         * the landscape extent. Returns false when less than two vertices wide.
+         */
+        bool GetGridVertexRect(const FFlowFieldSettings& Settings, const FTransform& LandscapeToWorld, int32 MinX, int32 MinY, int32 MaxX, int32 MaxY, int32& OutX1, int32& OutY1, int32& OutX2, int32& OutY2)
+        {
+                const FVector GridExtent(Settings.GridSize.X * Settings.CellSize, Settings.GridSize.Y * Settings.CellSize, 0.0f);
+                FBox LocalGridBounds(ForceInit);
+                for (int32 Corner = 0; Corner < 4; ++Corner)
+                {
+                        const FVector CornerOffset((Corner & 1) ? GridExtent.X : 0.0f, (Corner & 2) ? GridExtent.Y : 0.0f, 0.0f);
+                        LocalGridBounds += LandscapeToWorld.InverseTransformPosition(Settings.Origin + CornerOffset);
+                }
+
+                OutX1 = FMath::Max(MinX, FMath::FloorToInt32(LocalGridBounds.Min.X) - 1);
+                OutY1 = FMath::Max(MinY, FMath::FloorToInt32(LocalGridBounds.Min.Y) - 1);
+                OutX2 = FMath::Min(MaxX, FMath::CeilToInt32(LocalGridBounds.Max.X) + 1);
+                OutY2 = FMath::Min(MaxY, FMath::CeilToInt32(LocalGridBounds.Max.Y) + 1);
+                return OutX2 > OutX1 && OutY2 > OutY1;
+        }
+#endif
+}
+
+FFlowFieldTerrainSampler::FFlowFieldTerrainSampler(UWorld* InWorld, const FFlowFieldSettings& InSettings)
+        : World(InWorld)
+        , Settings(InSettings)
+{
+}
+
+FVector FFlowFieldTerrainSampler::GetCellCenter(int32 Index) const
+{
+        const int32 CellX = Index % Settings.GridSize.X;
+        const int32 CellY = Index / Settings.GridSize.X;
+        return Settings.Origin + FVector((CellX + 0.5f) * Settings.CellSize, (CellY + 0.5f) * Settings.CellSize, 0.0f);
+}
+
+bool FFlowFieldTerrainSampler::SampleLandscapes(TConstArrayView<FFlowFieldLayerCost> LayerCosts, bool bParallel, TArray<FFlowFieldCellTerrain>& InOutCells) const
+{
+        const int32 NumCells = Settings.GridSize.X * Settings.GridSize.Y;
+        if (!World || !ensureMsgf(InOutCells.Num() == NumCells, TEXT("Cell terrain array does not match grid dimensions")))
+        {
+                return false;
+        }
+
+        bool bSampledAny = false;
+
+#if WITH_EDITOR
+        TSet<ULandscapeInfo*> SampledInfos;
+        for (TActorIterator<ALandscapeProxy> It(World); It; ++It)
+        {
+                ULandscapeInfo* Info = It->GetLandscapeInfo();
+                ALandscapeProxy* Proxy = Info ? Info->GetLandscapeProxy() : nullptr;
+                bool bAlreadySampled = false;
+                SampledInfos.Add(Info, &bAlreadySampled);
+
+                int32 MinX = 0;
+                int32 MinY = 0;
+                int32 MaxX = 0;
+                int32 MaxY = 0;
+                if (!Proxy || bAlreadySampled || !Info->GetLandscapeExtent(MinX, MinY, MaxX, MaxY))
+                {
+                        continue;
+                }
+
+                const FTransform LandscapeToWorld = Proxy->LandscapeActorToWorld();
+                int32 X1, Y1, X2, Y2;
+                if (!GetGridVertexRect(Settings, LandscapeToWorld, MinX, MinY, MaxX, MaxY, X1, Y1, X2, Y2))
+                {
+                        continue;
+                }
+
+                const int32 Width = X2 - X1 + 1;
+                const int32 Height = Y2 - Y1 + 1;
+
+                // One bulk copy of the final heightmap and weightmaps, instead of one scene query per cell.
+                FLandscapeEditDataInterface EditData(Info);
+                TArray<uint16> RawHeights;
+                RawHeights.SetNumZeroed(Width * Height);
+                EditData.GetHeightDataFast(X1, Y1, X2, Y2, RawHeights.GetData(), Width);
+
+                TArray<TArray<uint8>> LayerWeights;
+                LayerWeights.SetNum(LayerCosts.Num());
+                for (int32 LayerIndex = 0; LayerIndex < LayerCosts.Num(); ++LayerIndex)
+                {
+                        if (ULandscapeLayerInfoObject* LayerInfo = LayerCosts[LayerIndex].LayerInfo)
+                        {
+                                // Components the layer is not painted on are left untouched, hence the zeroed buffer.
+                                LayerWeights[LayerIndex].SetNumZeroed(Width * Height);
+                                EditData.GetWeightDataFast(LayerInfo, X1, Y1, X2, Y2, LayerWeights[LayerIndex].GetData(), Width);
+                        }
+                }
+
+                TArray<float> WorldHeights;
+                WorldHeights.SetNumUninitialized(Width * Height);
+                for (int32 VertexIndex = 0; VertexIndex < WorldHeights.Num(); ++VertexIndex)
+                {
+                        const FVector LocalVertex(X1 + VertexIndex % Width, Y1 + VertexIndex / Width, LandscapeDataAccess::GetLocalHeight(RawHeights[VertexIndex]));
+                        WorldHeights[VertexIndex] = LandscapeToWorld.TransformPosition(LocalVertex).Z;
+                }
+
+                const FVector Scale = LandscapeToWorld.GetScale3D().GetAbs();
+                auto SampleCell = [&](int32 Index)
+                {
+                        FFlowFieldCellTerrain& Cell = InOutCells[Index];
+                        const FVector Local = LandscapeToWorld.InverseTransformPosition(GetCellCenter(Index));
+                        if (Cell.bOnLandscape || Local.X < MinX || Local.X > MaxX || Local.Y < MinY || Local.Y > MaxY)
+                        {
+                                return;
+                        }
+
+                        const float FX = FMath::Clamp(static_cast<float>(Local.X - X1), 0.0f, static_cast<float>(Width - 1));
+                        const float FY = FMath::Clamp(static_cast<float>(Local.Y - Y1), 0.0f, static_cast<float>(Height - 1));
+                        const int32 IX = FMath::Min(FMath::FloorToInt32(FX), Width - 2);
+                        const int32 IY = FMath::Min(FMath::FloorToInt32(FY), Height - 2);
+                        const float AlphaX = FX - IX;
+                        const float AlphaY = FY - IY;
+
+                        const int32 Base = IY * Width + IX;
+                        const float Top = FMath::Lerp(WorldHeights[Base], WorldHeights[Base + 1], AlphaX);
+                        const float Bottom = FMath::Lerp(WorldHeights[Base + Width], WorldHeights[Base + Width + 1], AlphaX);
+                        Cell.Height = FMath::Lerp(Top, Bottom, AlphaY);
+                        Cell.bOnLandscape = true;
+
+                        // Central differences around the closest vertex, one sided on the border of the copied region.
+                        const int32 RX = FMath::RoundToInt32(FX);
+                        const int32 RY = FMath::RoundToInt32(FY);
+                        const int32 Left = FMath::Max(RX - 1, 0);
+                        const int32 Right = FMath::Min(RX + 1, Width - 1);
+                        const int32 Down = FMath::Max(RY - 1, 0);
+                        const int32 Up = FMath::Min(RY + 1, Height - 1);
+                        const float GradientX = (WorldHeights[RY * Width + Right] - WorldHeights[RY * Width + Left]) / ((Right - Left) * Scale.X);
+                        const float GradientY = (WorldHeights[Up * Width + RX] - WorldHeights[Down * Width + RX]) / ((Up - Down) * Scale.Y);
+                        Cell.SlopeDegrees = GradientToSlopeDegrees(GradientX, GradientY);
+
+                        ApplyLayerWeights(LayerCosts, LayerWeights, RY * Width + RX, Cell);
+                };
+
+                // Every cell only reads the copied buffers and writes its own entry.
+                ParallelFor(NumCells, SampleCell, bParallel ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread);
+                bSampledAny = true;
+        }
+#else
+        if (LayerCosts.Num() > 0)
+        {
+                UE_LOG(LogTemp, Warning, TEXT("FFlowFieldTerrainSampler: landscape layer weights are only readable in the editor, layer costs are ignored."));
+        }
+
+        // Cooked landscapes keep no CPU heightmap, the collision heightfield is read instead. Still no scene query involved.
+        TArray<ALandscapeProxy*> Proxies;
+        for (TActorIterator<ALandscapeProxy> It(World); It; ++It)
+        {
+                Proxies.Add(*It);
+        }
+
+        auto GetHeight = [&Proxies](const FVector& Location, float& OutHeight)
+        {
+                for (const ALandscapeProxy* Proxy : Proxies)
+                {
+                        const TOptional<float> Height = Proxy->GetHeightAtLocation(Location);
+                        if (Height.IsSet())
+                        {
+                                OutHeight = Height.GetValue();
+                                return true;
+                        }
+                }
+                return false;
+        };
+
+        const float HalfCellSize = Settings.CellSize * 0.5f;
+        for (int32 Index = 0; Index < NumCells && Proxies.Num() > 0; ++Index)
+        {
+                FFlowFieldCellTerrain& Cell = InOutCells[Index];
+                const FVector Center = GetCellCenter(Index);
+                if (Cell.bOnLandscape || !GetHeight(Center, Cell.Height))
+                {
+                        continue;
+                }
+
+                Cell.bOnLandscape = true;
+                bSampledAny = true;
+
+                float Left = Cell.Height;
+                float Right = Cell.Height;
+                float Down = Cell.Height;
+                float Up = Cell.Height;
+                const float DistanceX = (GetHeight(Center - FVector(HalfCellSize, 0.0f, 0.0f), Left) ? HalfCellSize : 0.0f) + (GetHeight(Center + FVector(HalfCellSize, 0.0f, 0.0f), Right) ? HalfCellSize : 0.0f);
+                const float DistanceY = (GetHeight(Center - FVector(0.0f, HalfCellSize, 0.0f), Down) ? HalfCellSize : 0.0f) + (GetHeight(Center + FVector(0.0f, HalfCellSize, 0.0f), Up) ? HalfCellSize : 0.0f);
+                const float GradientX = DistanceX > 0.0f ? (Right - Left) / DistanceX : 0.0f;
+                const float GradientY = DistanceY > 0.0f ? (Up - Down) / DistanceY : 0.0f;
+                Cell.SlopeDegrees = GradientToSlopeDegrees(GradientX, GradientY);
+        }
+#endif
+
+        return bSampledAny;
+}
+
+uint32 FFlowFieldTerrainSampler::HashLayerWeights(TConstArrayView<FFlowFieldLayerCost> LayerCosts) const
+{
+        uint32 Hash = 0;
+
+#if WITH_EDITOR
+        if (!World)
+        {
+                return Hash;
+        }
+
+        TSet<ULandscapeInfo*> HashedInfos;
+        TArray<uint8> Weights;
+        for (TActorIterator<ALandscapeProxy> It(World); It; ++It)
+        {
+                ULandscapeInfo* Info = It->GetLandscapeInfo();
+                ALandscapeProxy* Proxy = Info ? Info->GetLandscapeProxy() : nullptr;
+                bool bAlreadyHashed = false;
+                HashedInfos.Add(Info, &bAlreadyHashed);
+
+                int32 MinX = 0;
+                int32 MinY = 0;
+                int32 MaxX = 0;
+                int32 MaxY = 0;
+                int32 X1, Y1, X2, Y2;
+                if (!Proxy || bAlreadyHashed || !Info->GetLandscapeExtent(MinX, MinY, MaxX, MaxY)
+                        || !GetGridVertexRect(Settings, Proxy->LandscapeActorToWorld(), MinX, MinY, MaxX, MaxY, X1, Y1, X2, Y2))
+                {
+                        continue;
+                }
+
+                // Same region and copy as SampleLandscapes, so exactly the weights a bake reads are fingerprinted.
+                const int32 Width = X2 - X1 + 1;
+                FLandscapeEditDataInterface EditData(Info);
+                uint32 LandscapeHash = GetTypeHash(Info->LandscapeGuid);
+                for (int32 LayerIndex = 0; LayerIndex < LayerCosts.Num(); ++LayerIndex)
+                {
+                        if (ULandscapeLayerInfoObject* LayerInfo = LayerCosts[LayerIndex].LayerInfo)
+                        {
+                                Weights.Reset();
+                                Weights.SetNumZeroed(Width * (Y2 - Y1 + 1));
+                                EditData.GetWeightDataFast(LayerInfo, X1, Y1, X2, Y2, Weights.GetData(), Width);
+                                LandscapeHash = FCrc::MemCrc32(Weights.GetData(), Weights.Num(), HashCombineFast(LandscapeHash, LayerIndex));
+                        }
+                }
+
+                // Summed so the result does not depend on the actor iteration order.
+                Hash += LandscapeHash;
+        }
+#endif
+
+        return Hash;
+}
+
+bool FFlowFieldTerrainSampler::SampleNavAreaCosts(const FVector& QueryExtent, bool bBlockOutsideNavMesh, TArray<FFlowFieldCellTerrain>& InOutCells) const
+{
+#if WITH_RECAST
+        UNavigationSystemV1* NavSystem = World ? FNavigationSystem::GetCurrent<UNavigationSystemV1>(World) : nullptr;
+        const ARecastNavMesh* NavMesh = NavSystem ? Cast<ARecastNavMesh>(NavSystem->GetDefaultNavDataInstance()) : nullptr;
+        if (!NavMesh || !ensureMsgf(InOutCells.Num() == Settings.GridSize.X * Settings.GridSize.Y, TEXT("Cell terrain array does not match grid dimensions")))
+        {
+                return false;
+        }
+
+        // Kept on the game thread: the navmesh may be rebuilt by its own tasks while the bake runs.
+        for (int32 Index = 0; Index < InOutCells.Num(); ++Index)
+        {
+                FFlowFieldCellTerrain& Cell = InOutCells[Index];
+                if (Cell.bBlocked)
+                {
+                        continue;
+                }
+
+                FVector Location = GetCellCenter(Index);
+                if (Cell.bOnLandscape)
+                {
+                        Location.Z = Cell.Height;
+                }
+
+                const NavNodeRef Poly = NavMesh->FindNearestPoly(Location, QueryExtent);
+                if (Poly == INVALID_NAVNODEREF)
+                {
+                        Cell.bBlocked = bBlockOutsideNavMesh;
+                        continue;
+                }
+
+                const UClass* AreaClass = NavMesh->GetAreaClass(NavMesh->GetPolyAreaID(Poly));
+                const UNavArea* Area = AreaClass ? AreaClass->GetDefaultObject<UNavArea>() : nullptr;
+                if (!Area)
+                {
+                        continue;
+                }
+
+                if (AreaClass->IsChildOf(UNavArea_Null::StaticClass()))
+                {
+                        Cell.bBlocked = true;
+                        continue;
+                }
+
+                Cell.CostMultiplier *= Area->DefaultCost;
+        }
+
+        return true;
+#else
+        return false;
+#endif
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "FlowField.h"
+
+#include "FlowFieldTerrainSampler.generated.h"
+
+class ULandscapeLayerInfoObject;
+class UWorld;
+
+/** Traversal cost of a landscape paint layer, e.g. cheap roads or expensive mud and forest. */
+USTRUCT(BlueprintType)
+struct PLUGINSDEVELOPMENT_API FFlowFieldLayerCost
+{
+        GENERATED_BODY()
+
+        UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Flow Field")
+        TObjectPtr<ULandscapeLayerInfoObject> LayerInfo = nullptr;
+
+        /** Cost of a fully painted cell relative to unpainted ground, e.g. 0.5 for roads or 3 for mud. */
+        UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Flow Field", meta = (ClampMin = "0.01"))
+        float CostMultiplier = 1.0f;
+
+        /** Blocks the cells painted with at least half of this layer, e.g. deep water. */
+        UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Flow Field")
+        bool bBlocksTraversal = false;
+};
+
+/** Terrain of a grid cell read from the landscape and navmesh data. */
+struct FFlowFieldCellTerrain
+{
+        /** World height of the landscape at the cell centre, only valid when bOnLandscape. */
+        float Height = 0.0f;
+        float SlopeDegrees = 0.0f;
+
+        /** Product of the paint layer and nav area costs, 1 for plain ground. */
+        float CostMultiplier = 1.0f;
+
+        bool bOnLandscape = false;
+        bool bBlocked = false;
+};
+
+/**
+ * Reads the terrain of every cell of a grid straight from the landscape heightfield, the paint layer weightmaps and the
+ * navmesh polygons instead of tracing against the physics scene. Each landscape is read in a single bulk copy covering the
+ * grid, after which the cells are plain array lookups.
+ *
+ * Weightmaps only keep their CPU data in the editor: cooked builds still read the heights from the collision heightfield
+ * but ignore the layer costs, they are expected to load weights baked in the editor instead.
+ */
+class PLUGINSDEVELOPMENT_API FFlowFieldTerrainSampler
+{
+public:
+        FFlowFieldTerrainSampler(UWorld* InWorld, const FFlowFieldSettings& InSettings);
+
+        /**
+         * Writes the height, slope and paint layer cost of the cells covered by a landscape. Cells already on a landscape
+         * keep their value, so the first landscape covering a cell wins. Returns false when no landscape covers the grid.
+         */
+        bool SampleLandscapes(TConstArrayView<FFlowFieldLayerCost> LayerCosts, bool bParallel, TArray<FFlowFieldCellTerrain>& InOutCells) const;
+
+        /** Hashes the painted weights SampleLandscapes reads for LayerCosts. Always 0 in cooked builds, like the weights. */
+        uint32 HashLayerWeights(TConstArrayView<FFlowFieldLayerCost> LayerCosts) const;
+
+        /**
+         * Multiplies the cost of every cell by the default cost of the nav area under its centre. Cells without a navmesh
+         * polygon within QueryExtent are blocked when bBlockOutsideNavMesh is set. Returns false without a navmesh.
+         */
+        bool SampleNavAreaCosts(const FVector& QueryExtent, bool bBlockOutsideNavMesh, TArray<FFlowFieldCellTerrain>& InOutCells) const;
+
+private:
+        FVector GetCellCenter(int32 Index) const;
+
+        UWorld* World = nullptr;
+        FFlowFieldSettings Settings;
+};
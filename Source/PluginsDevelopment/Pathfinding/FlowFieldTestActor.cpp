@@ -34,7 +34,7 @@ void AFlowFieldTestActor::BeginPlay()
                 return;
         }
 
-        bHasDestination = TryAssignNewDestination();
+        TryAssignNewDestination();
 }
 
 void AFlowFieldTestActor::Tick(float DeltaSeconds)
@@ -51,13 +51,38 @@ void AFlowFieldTestActor::Tick(float DeltaSeconds)
                 return;
         }
 
+        if (PendingFlowFieldHandle.IsValid())
+        {
+                if (FlowFieldManager->IsFlowFieldReady(PendingFlowFieldHandle))
+                {
+                        FlowFieldHandle = PendingFlowFieldHandle;
+                        CurrentDestination = FlowFieldManager->CellToWorld(FlowFieldHandle.Destination);
+                        PendingFlowFieldHandle = FFlowFieldHandle();
+                        bHasDestination = true;
+                }
+                else if (!FlowFieldManager->IsFlowFieldBuilding(PendingFlowFieldHandle))
+                {
+                        PendingFlowFieldHandle = FFlowFieldHandle();
+                }
+        }
+
         if (!bHasDestination)
         {
-                bHasDestination = TryAssignNewDestination();
+                if (!PendingFlowFieldHandle.IsValid())
+                {
+                        TryAssignNewDestination();
+                }
+                else
+                {
+                        // Start moving while the field is built, following whatever part of it is already integrated.
+                        const FVector SteeringDirection = FlowFieldManager->GetSteeringDirectionForHandle(PendingFlowFieldHandle, GetActorLocation());
+                        SetActorLocation(GetActorLocation() + SteeringDirection * MovementSpeed * DeltaSeconds);
+                }
+
                 return;
         }
 
-        const FVector FlowDirection = FlowFieldManager->GetDirectionForWorldPosition(GetActorLocation());
+        const FVector FlowDirection = FlowFieldManager->GetDirectionForHandle(FlowFieldHandle, GetActorLocation());
         if (!FlowDirection.IsNearlyZero())
         {
                 const FVector NewLocation = GetActorLocation() + (FlowDirection * MovementSpeed * DeltaSeconds);
@@ -114,12 +139,13 @@ bool AFlowFieldTestActor::TryAssignNewDestination()
                         continue;
                 }
 
-                if (!FlowFieldManager->BuildFlowFieldToCell(Candidate))
+                const FFlowFieldHandle Handle = FlowFieldManager->RequestFlowFieldToCellAsync(Candidate);
+                if (!Handle.IsValid() || Handle.Destination == CurrentCell)
                 {
                         continue;
                 }
 
-                CurrentDestination = FlowFieldManager->CellToWorld(Candidate);
+                PendingFlowFieldHandle = Handle;
                 return true;
         }
 
@@ -3,9 +3,9 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
 
-#include "FlowFieldTestActor.generated.h"
+#include "FlowFieldManager.h"
 
-class AFlowFieldManager;
+#include "FlowFieldTestActor.generated.h"
 
 /**
  * Simple actor that roams around by following a flow field towards random destinations.
@@ -25,7 +25,7 @@ protected:
 	virtual void BeginPlay() override;
 
 private:
-        /** Picks a new destination around the actor and rebuilds the flow field towards it. */
+        /** Picks a new destination around the actor and requests a flow field towards it. */
         bool TryAssignNewDestination();
 
         /** Returns true if the actor reached the current destination. */
@@ -60,6 +60,11 @@ private:
         int32 MaxDestinationAttempts = 24;
 
 private:
+        /** Field followed by this actor, shared with every other actor heading to the same destination. */
+        FFlowFieldHandle FlowFieldHandle;
+
+        /** Field requested for the next destination, adopted once its asynchronous build is ready. */
+        FFlowFieldHandle PendingFlowFieldHandle;
         FVector CurrentDestination = FVector::ZeroVector;
         bool bHasDestination = false;
 };
@@ -16,7 +16,9 @@ public class PluginsDevelopment : ModuleRules
                         "InputCore",
                         "EnhancedInput",
                         "SmartLog",
-                        "Landscape"
+                        "Landscape",
+                        "NavigationSystem",
+                        "JupiterPlugin"
                 });
         }
 }